@@ -0,0 +1,270 @@
+#ifndef CACHE_H
+#define CACHE_H
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <arpa/inet.h>
+#include "type.h"
+#include "limit.h"
+#include "debug.h"
+#include "protocol/message.h"
+#include "protocol/edns.h"
+#include "core/dns_case.h"
+
+/**
+ * **Response cache**
+ *
+ * Whole replies of the authoritative path, keyed by the question of the
+ * query: its name folded to lower case, QTYPE and QCLASS. A hit copies the
+ * reply over the query and patches what belongs to the query, that is the
+ * ID, the RD bit and the question bytes themselves, whose case is the
+ * client's.
+ *
+ * Only plain queries are looked up: one question with an uncompressed name
+ * and no other record but an OPT of our EDNS version. Replies are kept
+ * without their OPT record, which a hit writes anew for the query asking,
+ * if it has one. Truncated replies are not kept, so a reply that is kept
+ * fits any query whose limit, see dns_edns_limit(), it is under.
+ *
+ * Every entry remembers the version of the database it was built from,
+ * and any change of the database changes its version: an entry is only
+ * served for the version it was built from, and is replaced on the next
+ * miss otherwise.
+ *
+ * A cache belongs to one worker, no locking. It is CACHE_WAYS-way set
+ * associative, the way evicted in a set taken in turn.
+ */
+#define CACHE_WAYS            4
+#define CACHE_DEFAULT      1024     ///entries
+#define CACHE_REPLY_LIMIT  EDNS_LIMIT
+
+struct cache_entry {
+    u64_t                 version;  ///0: empty
+    u32_t                    hash;
+    u16_t                    qlen;  ///question bytes, name, QTYPE and QCLASS
+    u16_t                     len;  ///of the reply
+    uchar reply[CACHE_REPLY_LIMIT];
+};
+
+struct cache_stats {
+    unsigned long            hits;
+    unsigned long          misses;
+    unsigned long           stale;  ///misses on an entry of an older version
+    unsigned long         inserts;
+};
+
+struct dns_cache {
+    struct cache_entry     *entry;
+    u8_t                    *next;  ///way to evict next, per set
+    unsigned int            nsets;  ///power of 2
+
+    ///the query missed last, to be filled by cache_insert()
+    bool                  pending;
+    u32_t                    hash;
+    u16_t                    qlen;
+
+    struct cache_stats      stats;
+};
+
+static inline
+struct dns_cache *cache_new(unsigned int entries)
+{
+    struct dns_cache *c = calloc(1, sizeof(*c));
+
+    syserr(!c, "cache_new: calloc\n");
+    for(c->nsets = 1; c->nsets * CACHE_WAYS < entries; c->nsets <<= 1)
+        ;
+    c->entry = calloc((size_t) c->nsets * CACHE_WAYS, sizeof(*c->entry));
+    c->next = calloc(c->nsets, sizeof(*c->next));
+    syserr(!c->entry || !c->next, "cache_new: calloc\n");
+
+    return c;
+}
+
+static inline
+void cache_free(struct dns_cache *c)
+{
+    if(!c)
+        return;
+    free(c->entry);
+    free(c->next);
+    free(c);
+}
+
+/**
+ * Length of the question of a plain query of @len bytes in @buf, or 0 if
+ * it is not one; @e is set from its OPT record.
+ */
+static inline
+size_t cache_question(const uchar *buf, size_t len, struct dns_edns *e)
+{
+    const DNS_HEADER_t *hdr = (const DNS_HEADER_t *) buf;
+    u16_t arcount = ntohs(hdr->arcount);
+    ssize_t nlen;
+    size_t qend;
+
+    *e = (struct dns_edns) { .present = false };
+    if(len < sizeof(DNS_HEADER_t) + 1 + sizeof(DNS_QUESTION_t) ||
+       dns_flag(hdr, DNS_OPCODE) != _STD_QUERY || ntohs(hdr->qdcount) != 1 ||
+       hdr->ancount || hdr->nscount || arcount > 1)
+        return 0;
+
+    nlen = dns_name_skip(buf, len, sizeof(DNS_HEADER_t));
+    if(nlen < 0 ||
+       dns_case_len(buf + sizeof(DNS_HEADER_t)) != nlen - (ssize_t) sizeof(DNS_HEADER_t))
+        return 0;
+    qend = (size_t) nlen + sizeof(DNS_QUESTION_t);
+
+    ///nothing behind the question but an OPT of ours, owned by the root
+    if(arcount) {
+        if(qend + EDNS_OPT_SIZE > len || buf[qend] != 0 || dns_view_u16(buf + qend + 1) != _OPT ||
+           qend + EDNS_OPT_SIZE + dns_view_u16(buf + qend + 9) != len)
+            return 0;
+        dns_edns_read(e, buf + qend + 1);
+        if(e->version != EDNS_VERSION)
+            return 0;
+    }
+    else if(qend != len)
+        return 0;
+
+    return qend - sizeof(DNS_HEADER_t);
+}
+
+static inline
+u32_t cache_hash(const uchar *q, size_t qlen)
+{
+    u32_t h = 2166136261u;
+    size_t nlen = qlen - sizeof(DNS_QUESTION_t);
+
+    for(size_t i = 0; i < qlen; i++)
+        h = (h ^ (i < nlen ? dns_case_fold(q[i]) : q[i])) * 16777619u;
+
+    return h;
+}
+
+static inline
+struct cache_entry *cache_set(struct dns_cache *c, u32_t hash)
+{
+    return &c->entry[(size_t) (hash & (c->nsets - 1)) * CACHE_WAYS];
+}
+
+///is @e the entry of the question @q of @qlen bytes, of any version?
+static inline
+bool cache_match(const struct cache_entry *e, u32_t hash, const uchar *q, size_t qlen)
+{
+    const uchar *k = e->reply + sizeof(DNS_HEADER_t);
+    size_t nlen = qlen - sizeof(DNS_QUESTION_t);
+
+    return e->version && e->hash == hash && e->qlen == qlen &&
+           dns_case_diff_span(k, q, nlen) == nlen &&
+           !memcmp(k + nlen, q + nlen, sizeof(DNS_QUESTION_t));
+}
+
+/**
+ * Answer the query of @len bytes in @buf from the cache, in place, with a
+ * reply of at most @cap bytes built from the database at @version.
+ *
+ * @return reply length, 0 on a miss
+ */
+static inline
+ssize_t cache_lookup(struct dns_cache *c, u64_t version, uchar *buf, size_t len, size_t cap)
+{
+    struct dns_edns edns;
+    size_t qlen = cache_question(buf, len, &edns), qend = sizeof(DNS_HEADER_t) + qlen, opt;
+    struct cache_entry *e;
+    DNS_HEADER_t *hdr = (DNS_HEADER_t *) buf;
+    u16_t id;
+    u8_t rd;
+
+    c->pending = false;
+    if(!qlen)
+        return 0;
+
+    c->hash = cache_hash(buf + sizeof(DNS_HEADER_t), qlen);
+    c->qlen = (u16_t) qlen;
+    e = cache_set(c, c->hash);
+
+    for(int way = 0; way < CACHE_WAYS; way++, e++)
+    {
+        if(!cache_match(e, c->hash, buf + sizeof(DNS_HEADER_t), qlen))
+            continue;
+
+        if(e->version != version) {
+            c->stats.stale++;
+            break;
+        }
+        opt = edns.present ? EDNS_OPT_SIZE : 0;
+        if(e->len + opt > dns_edns_limit(&edns, cap))
+            break;
+
+        id = hdr->id;
+        rd = dns_flag(hdr, DNS_RD);
+        ///the question bytes of the query stay, the rest is the reply
+        memcpy(buf, e->reply, sizeof(DNS_HEADER_t));
+        memcpy(buf + qend, e->reply + qend, e->len - qend);
+        hdr->id = id;
+        dns_flag_set(hdr, DNS_RD, rd);
+        if(opt) {
+            dns_edns_write(buf + e->len, &edns, dns_flag(hdr, DNS_RCODE));
+            hdr->arcount = htons(ntohs(hdr->arcount) + 1);
+        }
+
+        c->stats.hits++;
+        return e->len + opt;
+    }
+
+    c->stats.misses++;
+    c->pending = true;
+    return 0;
+}
+
+/**
+ * Keep the reply of @len bytes in @buf to the query cache_lookup() missed
+ * last, built from the database at @version, before any OPT record.
+ */
+static inline
+void cache_insert(struct dns_cache *c, u64_t version, const uchar *buf, size_t len)
+{
+    struct cache_entry *set, *e;
+    unsigned int s, way;
+
+    if(!c->pending || len > CACHE_REPLY_LIMIT || dns_flag((const DNS_HEADER_t *) buf, DNS_TC))
+        return;
+    c->pending = false;
+
+    set = cache_set(c, c->hash);
+    s = (unsigned int) (set - c->entry) / CACHE_WAYS;
+
+    ///the entry of this question if there is one, else an empty way, else the next
+    for(way = 0; way < CACHE_WAYS; way++)
+        if(cache_match(&set[way], c->hash, buf + sizeof(DNS_HEADER_t), c->qlen))
+            break;
+    for(unsigned int w = 0; way == CACHE_WAYS && w < CACHE_WAYS; w++)
+        if(!set[w].version)
+            way = w;
+    if(way == CACHE_WAYS) {
+        way = c->next[s];
+        c->next[s] = (c->next[s] + 1) % CACHE_WAYS;
+    }
+
+    e = &set[way];
+    e->version = version;
+    e->hash = c->hash;
+    e->qlen = c->qlen;
+    e->len = (u16_t) len;
+    memcpy(e->reply, buf, len);
+    c->stats.inserts++;
+}
+
+static inline
+void cache_stats_show(const struct dns_cache *c)
+{
+    unsigned long n = c->stats.hits + c->stats.misses;
+
+    printf("cache: %u entries, %lu hits / %lu lookups = %.1f%% (%lu stale), %lu inserts\n",
+            c->nsets * CACHE_WAYS, c->stats.hits, n, n ? 100.0 * c->stats.hits / n : 0.0,
+            c->stats.stale, c->stats.inserts);
+}
+
+#endif ///CACHE_H
@@ -9,8 +9,14 @@
  *      foreign name servers.
  */
 #include "protocol/message.h"
+#include "protocol/reply.h"
+#include "protocol/msg_view.h"
+#include "protocol/edns.h"
 #include "dns_util.h"
 #include "dns_impl.h"
+#include "prefilter.h"
+#include "zone.h"
+#include "cache.h"
 #include "debug.h"
 
 #define SERV_PORT 8008
@@ -23,8 +29,100 @@ struct DNS {
     //.query
     ssize_t (*listen)(int sk_fd, uchar buf[], struct sockaddr *addr, socklen_t *len);
     void (*respond)(int sk_fd, uchar buf[], ssize_t buf_len, struct sockaddr * addr, socklen_t len);
+    //.batch
+    int (*listen_batch)(int sk_fd, struct dns_batch *batch);
+    void (*respond_batch)(int sk_fd, struct dns_batch *batch);
+    //.restart
+    void (*drain)(int sk_fd);
 };
 
+///the database queries are answered from, NULL while there is none
+extern struct zone_db *dns_db;
+///the response cache of the worker, if any
+extern __thread struct dns_cache *dns_cache;
+
+/**
+ * Turn the query of @len bytes in @buf into its reply, in place.
+ *
+ * @cap is the limit of the transport: EDNS_LIMIT for a datagram, TCP_LIMIT
+ * for a TCP connection. A datagram reply is held to UDP_LIMIT unless the
+ * query carries an OPT record asking for more, see protocol/edns.h; a
+ * reply which does not fit has to be cut and marked with TC, so the client
+ * retries over TCP.
+ *
+ * Standard queries are answered from dns_db, REFUSED while there is none;
+ * other opcodes get NOTIMP and queries which do not parse FORMERR. With a
+ * dns_cache in the calling worker, replies from dns_db are cached.
+ * Datagrams shorter than a header or with QR already set are dropped.
+ *
+ * The index of the query and the state of its reply are taken from the
+ * message arena of the calling thread, which is reset here for every
+ * message; nothing is allocated from the heap.
+ *
+ * @return reply length, 0 if there is nothing to send back
+ */
+ssize_t dns_process(uchar *buf, ssize_t len, size_t cap)
+{
+    struct arena *arena = msg_arena();
+    struct dns_view *view;
+    struct dns_reply *reply;
+    struct dns_edns edns;
+    size_t limit;
+    ssize_t hit;
+
+    if(len < (ssize_t) sizeof(DNS_HEADER_t) || cap < (size_t) len)
+        return 0;
+    if(dns_header_member(((DNS_HEADER_t *) buf), qr))
+        return 0;
+    if(dns_db && dns_cache && (hit = cache_lookup(dns_cache, dns_db->version, buf, len, cap)) > 0)
+        return hit;
+
+    ///what the last message left in the arena is gone
+    arena_reset(arena);
+    view = (struct dns_view *) arena_alloc(arena, sizeof(*view));
+    reply = (struct dns_reply *) arena_alloc(arena, sizeof(*reply));
+    if(!view || !reply)
+        return 0;
+
+    if(dns_view_parse_query(view, buf, (size_t) len) < 0) {
+        ((DNS_HEADER_t *) buf)->qdcount = 0;
+        dns_reply_start(reply, buf, sizeof(DNS_HEADER_t), cap);
+        dns_reply_rcode(reply, _FORMERR);
+        return (ssize_t) reply->len;
+    }
+    if(dns_edns_parse(&edns, view) < 0) {
+        dns_reply_start(reply, buf, dns_view_qend(view), cap);
+        dns_reply_rcode(reply, _FORMERR);
+        return (ssize_t) reply->len;
+    }
+
+    ///the OPT record of the reply comes last, its room is kept until then
+    limit = dns_edns_limit(&edns, cap);
+    dns_reply_start(reply, buf, dns_view_qend(view), limit - (edns.present ? EDNS_OPT_SIZE : 0));
+    if(edns.present && edns.version > EDNS_VERSION) {
+        reply->cap = limit;
+        dns_edns_put(reply, &edns, _BADVERS);
+        return (ssize_t) reply->len;
+    }
+
+    if(dns_header_member(dns_reply_header(reply), opcode) != _STD_QUERY)
+        dns_reply_rcode(reply, _NOTIMP);
+    else if(dns_db) {
+        zone_answer(dns_db, reply, view);
+        if(dns_cache)
+            cache_insert(dns_cache, dns_db->version, buf, reply->len);
+    }
+    else
+        dns_reply_rcode(reply, _REFUSED);
+
+    if(edns.present) {
+        reply->cap = limit;
+        dns_edns_put(reply, &edns, dns_header_member(dns_reply_header(reply), rcode));
+    }
+
+    return (ssize_t) reply->len;
+}
+
 void dns_header_show(DNS_HEADER_t *hdr)
 {
     printf("**DNS_Header_t %p**\n", hdr);
@@ -100,94 +198,63 @@ void dns_query(char *dns, uchar *buf, size_t len)
 void resolve_message(uchar *buf)
 {
     int locate = 0;
+
+    ///a new message: the records of the last one are given back
+    arena_reset(msg_arena());
     dns_header_declare(header);
     dns_header_locate(header, buf);
     locate += (int) sizeof(header);
     dns_header_show(header);
 }
 
+/**
+ * Print the @rdlen bytes of RDATA of a record of @type, found at *@locate
+ * of the message @buf, through the codec of its type; *@locate is moved
+ * behind them.
+ */
 void rr_rdate_show(RR_TYPE_t type, u16_t rdlen, uchar *rdata, uchar* buf, size_t *locate)
 {
-    size_t _tmp = 0;
-    switch(type) {
-        case _A:
-            printf("rdate = %s\n", inet_ntoa(*((struct in_addr*) rdata)));
-            break;
-        case _NS:
-        case _CNAME:
-            /*uchar *host;
-            if(is_compressive(rdata)) {
-                size_t tmp = *locate;
-                uchar *host = (uchar *) malloc(NAME_LIMIT);
-                dns_to_host_name(host, buf, &tmp);
-            }
-            else {
-                uchar *host = (uchar *) malloc(rdlen + 1);
-                host[rdlen] = '\0';
-                strncpy(host, rdata, rdlen);
-            }*/
-
-        {
-            _tmp = *locate;
-
-            char *_host = (char *) malloc(NAME_LIMIT * sizeof(char));
-            //printf("rdate = %s\n", _host);
-            dns_to_host_name(_host, buf, &_tmp);
-
-            printf("rdate = %s\n", _host);
-
-
-            /*
-            char data;
-            char *ptr;
-                ptr = (&buf[((((u16_t) buf[locate]) << 8) + buf[locate + 1]) & compression_mask]);
-            //data[rdlen] = '\0';
-
-            ///printf("rdate = %s\n", rdata);
-            printf("rdate = ");
-            for(int i = 0; i < rdlen * 4; i++) putchar(*((char *) data + i));
-            putchar('\n');*/
-
-            //free(host);
-            break;
-        }
-        /*
-        case _MD:
-        case _MF:
-        case _SOA:
-        case _MB:
-        case _MG:
-        case _MR:
-        case _NULL:
-        case _WKS:
-        case _PTR:
-        case _HINFO:
-        case _MINFO:
-        case _MX:
-        case _TXT:
-        case _AXFR:
-        case _MAILB:
-        case _MAILA:
-        case _wildcard:*/
-        default:
-            dlog("Cannot find the RR_TYPE corresponded to rdata\n");
-            break;
+    const struct dns_rdata_ops *ops = dns_rdata(type);
+    struct arena *arena = msg_arena();
+    size_t mark = arena_mark(arena), cap = rdlen + RDATA_NAMES * NAME_LIMIT, size;
+    uchar *wire = (uchar *) arena_alloc(arena, cap);
+    char *text = NULL;
+    ssize_t n = -1;
+
+    if(wire && (n = ops->decode(buf, BUF_SIZE, *locate, rdlen, wire, cap)) >= 0) {
+        size = ops->size(wire, (u16_t) n);
+        n = (text = (char *) arena_alloc(arena, size)) ? ops->print(text, size, wire, (u16_t) n) : -1;
     }
 
+    if(n >= 0)
+        printf("rdate = %s\n", text);
+    else
+        dlog("rr_rdate_show: RDATA of type %hu malformed or too large\n", type);
+
+    arena_release(arena, mark);
     *locate += rdlen;
-    ///return 0;
 }
 
 void rr_show(RR_ptr_t *rr, uchar *buf, size_t *locate)
 {
     printf("**RR_ptr_t %p**\n", rr);
 
-    size_t _tmp = *locate;
+    size_t _tmp = *locate, mark = arena_mark(msg_arena());
 
-    char *_host = (char *) malloc(NAME_LIMIT * sizeof(char));
-    dns_to_host_name(_host, buf, &_tmp);
+    char *_host = (char *) arena_alloc(msg_arena(), NAME_TEXT_LIMIT * sizeof(char));
+    if(_host) {
+        dns_to_host_name(_host, buf, &_tmp);
+        printf("RR->name = %s\n", _host);
+    }
+    else {
+        ///the name is not shown, but still stepped over with the rest of the RR
+        ssize_t end = dns_name_skip(buf, BUF_SIZE, _tmp);
 
-    printf("RR->name = %s\n", _host);
+        dlog("rr_show: the message arena is full\n");
+        if(end >= 0)
+            _tmp = (size_t) end;
+    }
+    arena_release(msg_arena(), mark);
     printf("RR->rr->type = %hu(%s)\n", rr_member(rr, type, ntohs), _RR_TYPE[rr_member(rr, type, ntohs)]);
     printf("RR->rr->class = %hu(%s)\n", rr_member(rr, class, ntohs), _RR_CLASS[rr_member(rr, class, ntohs)]);
     printf("RR->rr->ttl = %u\n", rr_member(rr, ttl, ntohl));
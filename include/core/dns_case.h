@@ -0,0 +1,240 @@
+#ifndef DNS_CASE_H
+#define DNS_CASE_H
+
+#include <stdbool.h>
+#include <sys/types.h>
+#include "type.h"
+#include "limit.h"
+
+#if defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+/**
+ * **Case-insensitive names (RFC 1035 2.3.3, RFC 4034 6.1)**
+ *
+ * Helpers over uncompressed wire names, "\3www\3sri\3com\0": fold them to
+ * lower case in place, compare them for equality ignoring case, and order
+ * them canonically.
+ *
+ * Length octets never exceed LABEL_LIMIT, below 'A', so folding or
+ * comparing a whole wire name as one run of bytes treats them like any
+ * other byte. The kernels below work on such runs: AVX2 when the CPU has
+ * it, SSE2 otherwise, bytewise for runs shorter than a vector, for their
+ * tails and on targets without SSE2.
+ */
+
+static inline
+uchar dns_case_fold(uchar ch)
+{
+    return (ch >= 'A' && ch <= 'Z') ? ch + ('a' - 'A') : ch;
+}
+
+static inline
+void dns_case_lower_scalar(uchar *p, size_t n)
+{
+    for(size_t i = 0; i < n; i++)
+        p[i] = dns_case_fold(p[i]);
+}
+
+///index of the first byte where @a and @b differ ignoring case, @n if none
+static inline
+size_t dns_case_diff_scalar(const uchar *a, const uchar *b, size_t n)
+{
+    size_t i = 0;
+
+    while(i < n && dns_case_fold(a[i]) == dns_case_fold(b[i]))
+        i++;
+
+    return i;
+}
+
+#if defined(__SSE2__)
+static inline
+__m128i dns_case_fold_sse2(__m128i c)
+{
+    __m128i upper = _mm_and_si128(_mm_cmpgt_epi8(c, _mm_set1_epi8('A' - 1)),
+                                  _mm_cmplt_epi8(c, _mm_set1_epi8('Z' + 1)));
+
+    return _mm_add_epi8(c, _mm_and_si128(upper, _mm_set1_epi8('a' - 'A')));
+}
+
+static inline
+void dns_case_lower_sse2(uchar *p, size_t n)
+{
+    size_t i = 0;
+
+    for(; i + 16 <= n; i += 16)
+        _mm_storeu_si128((__m128i *) (p + i), dns_case_fold_sse2(_mm_loadu_si128((__m128i *) (p + i))));
+    dns_case_lower_scalar(p + i, n - i);
+}
+
+static inline
+size_t dns_case_diff_sse2(const uchar *a, const uchar *b, size_t n)
+{
+    size_t i = 0;
+
+    for(; i + 16 <= n; i += 16)
+    {
+        __m128i x = dns_case_fold_sse2(_mm_loadu_si128((const __m128i *) (a + i)));
+        __m128i y = dns_case_fold_sse2(_mm_loadu_si128((const __m128i *) (b + i)));
+        unsigned int ne = ~(unsigned int) _mm_movemask_epi8(_mm_cmpeq_epi8(x, y)) & 0xffff;
+
+        if(ne)
+            return i + __builtin_ctz(ne);
+    }
+
+    return i + dns_case_diff_scalar(a + i, b + i, n - i);
+}
+
+__attribute__((target("avx2")))
+static inline
+__m256i dns_case_fold_avx2(__m256i c)
+{
+    __m256i upper = _mm256_and_si256(_mm256_cmpgt_epi8(c, _mm256_set1_epi8('A' - 1)),
+                                     _mm256_cmpgt_epi8(_mm256_set1_epi8('Z' + 1), c));
+
+    return _mm256_add_epi8(c, _mm256_and_si256(upper, _mm256_set1_epi8('a' - 'A')));
+}
+
+__attribute__((target("avx2")))
+static inline
+void dns_case_lower_avx2(uchar *p, size_t n)
+{
+    size_t i = 0;
+
+    for(; i + 32 <= n; i += 32)
+        _mm256_storeu_si256((__m256i *) (p + i), dns_case_fold_avx2(_mm256_loadu_si256((__m256i *) (p + i))));
+    dns_case_lower_sse2(p + i, n - i);
+}
+
+__attribute__((target("avx2")))
+static inline
+size_t dns_case_diff_avx2(const uchar *a, const uchar *b, size_t n)
+{
+    size_t i = 0;
+
+    for(; i + 32 <= n; i += 32)
+    {
+        __m256i x = dns_case_fold_avx2(_mm256_loadu_si256((const __m256i *) (a + i)));
+        __m256i y = dns_case_fold_avx2(_mm256_loadu_si256((const __m256i *) (b + i)));
+        u32_t ne = ~(u32_t) _mm256_movemask_epi8(_mm256_cmpeq_epi8(x, y));
+
+        if(ne)
+            return i + __builtin_ctz(ne);
+    }
+
+    return i + dns_case_diff_sse2(a + i, b + i, n - i);
+}
+#endif ///__SSE2__
+
+///fold the @n bytes at @p to lower case
+static inline
+void dns_case_lower_span(uchar *p, size_t n)
+{
+#if defined(__SSE2__)
+    if(n >= 32 && __builtin_cpu_supports("avx2"))
+        dns_case_lower_avx2(p, n);
+    else if(n >= 16)
+        dns_case_lower_sse2(p, n);
+    else
+#endif
+        dns_case_lower_scalar(p, n);
+}
+
+static inline
+size_t dns_case_diff_span(const uchar *a, const uchar *b, size_t n)
+{
+#if defined(__SSE2__)
+    if(n >= 32 && __builtin_cpu_supports("avx2"))
+        return dns_case_diff_avx2(a, b, n);
+    if(n >= 16)
+        return dns_case_diff_sse2(a, b, n);
+#endif
+    return dns_case_diff_scalar(a, b, n);
+}
+
+/**
+ * Length of the uncompressed wire @name, root label included.
+ *
+ * @return -1 for a pointer, a label over LABEL_LIMIT or a name over NAME_LIMIT
+ */
+static inline
+ssize_t dns_case_len(const uchar *name)
+{
+    size_t off = 0;
+
+    while(name[off])
+    {
+        if(name[off] > LABEL_LIMIT || off + 1 + name[off] >= NAME_LIMIT)
+            return -1;
+        off += 1 + name[off];
+    }
+
+    return off + 1;
+}
+
+/**
+ * Fold the uncompressed wire @name to lower case in place.
+ *
+ * @return its length, -1 if it is malformed and left alone
+ */
+static inline
+ssize_t dns_case_lower(uchar *name)
+{
+    ssize_t len = dns_case_len(name);
+
+    if(len > 0)
+        dns_case_lower_span(name, len);
+
+    return len;
+}
+
+///do the uncompressed wire names @a and @b spell the same name? false if malformed
+static inline
+bool dns_case_equal(const uchar *a, const uchar *b)
+{
+    ssize_t len = dns_case_len(a);
+
+    ///equal length octets in front of every label, so one run compare
+    return len > 0 && len == dns_case_len(b) && dns_case_diff_span(a, b, len) == (size_t) len;
+}
+
+/**
+ * Canonical order of the uncompressed wire names @a and @b: label by label
+ * from the root, each label an octet string in lower case, a label which
+ * is a prefix of another sorting first.
+ *
+ * @return <0, 0 or >0 as @a sorts before, with or after @b; malformed names
+ *         sort after well formed ones
+ */
+static inline
+int dns_case_cmp(const uchar *a, const uchar *b)
+{
+    u8_t at[NAME_LIMIT / 2], bt[NAME_LIMIT / 2];
+    int na = 0, nb = 0;
+
+    if(dns_case_len(a) < 0 || dns_case_len(b) < 0)
+        return (dns_case_len(a) < 0) - (dns_case_len(b) < 0);
+
+    for(size_t off = 0; a[off]; off += 1 + a[off])
+        at[na++] = (u8_t) off;
+    for(size_t off = 0; b[off]; off += 1 + b[off])
+        bt[nb++] = (u8_t) off;
+
+    while(na > 0 && nb > 0)
+    {
+        const uchar *la = a + at[--na], *lb = b + bt[--nb];
+        size_t n = la[0] < lb[0] ? la[0] : lb[0];
+        size_t i = dns_case_diff_span(la + 1, lb + 1, n);
+
+        if(i < n)
+            return dns_case_fold(la[1 + i]) - dns_case_fold(lb[1 + i]);
+        if(la[0] != lb[0])
+            return la[0] - lb[0];
+    }
+
+    return na - nb;
+}
+
+#endif ///DNS_CASE_H
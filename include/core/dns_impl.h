@@ -4,8 +4,12 @@
 #include <unistd.h>
 #include <sys/types.h>
 #include <sys/socket.h>
-//#include <netinet/in.h>
+#include <sys/uio.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <string.h>
 #include "debug.h"
+#include "pktpool.h"
 
 static inline
 int socket_config(int domain, int type, int protocol, struct sockaddr *addr, socklen_t len)
@@ -22,24 +26,300 @@ int socket_config(int domain, int type, int protocol, struct sockaddr *addr, soc
     return fd;
 }
 
+/**
+ * Same as socket_config(), but several sockets may bind the same address;
+ * the kernel spreads incoming datagrams over them by flow hash, so every
+ * worker gets its own receive queue.
+ */
+static inline
+int socket_config_reuseport(int domain, int type, int protocol, struct sockaddr *addr, socklen_t len)
+{
+    int fd, on = 1;
+
+    fd = socket(domain, type, protocol);
+    syserr(fd == -1, "socket_config_reuseport: socket()\n");
+
+    ///let "::" and "0.0.0.0" listeners share the port
+    if(domain == AF_INET6)
+        setsockopt(fd, IPPROTO_IPV6, IPV6_V6ONLY, &on, sizeof(on));
+
+    syserr(
+        setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &on, sizeof(on)) < 0,
+        "socket_config_reuseport: setsockopt(SO_REUSEPORT)\n");
+
+    syserr(
+        bind(fd, addr,len) < 0,
+        "socket_config_reuseport: bind()\n");
+
+    return fd;
+}
+
+/**
+ * Parse "<ipv4>[:port]" or "[<ipv6>][:port]" into @addr.
+ *
+ * @return 0 on success, -1 if @str is not an address
+ */
+static inline
+int socket_addr_parse(const char *str, int port, struct sockaddr_storage *addr, socklen_t *len)
+{
+    char host[INET6_ADDRSTRLEN + 2];
+    const char *p;
+
+    memset(addr, 0, sizeof(*addr));
+
+    if(str[0] == '[') {
+        if(!(p = strchr(str, ']')) || (size_t) (p - str - 1) >= sizeof(host))
+            return -1;
+        memcpy(host, str + 1, p - str - 1);
+        host[p - str - 1] = '\0';
+        p = (p[1] == ':') ? p + 2 : NULL;
+    }
+    else {
+        p = strchr(str, ':');
+        size_t n = p ? (size_t) (p - str) : strlen(str);
+        if(n >= sizeof(host))
+            return -1;
+        memcpy(host, str, n);
+        host[n] = '\0';
+        p = p ? p + 1 : NULL;
+    }
+
+    if(p)
+        port = atoi(p);
+
+    struct sockaddr_in *in4 = (struct sockaddr_in *) addr;
+    struct sockaddr_in6 *in6 = (struct sockaddr_in6 *) addr;
+
+    if(inet_pton(AF_INET, host, &in4->sin_addr) == 1) {
+        in4->sin_family = AF_INET;
+        in4->sin_port = htons(port);
+        *len = sizeof(*in4);
+    }
+    else if(inet_pton(AF_INET6, host, &in6->sin6_addr) == 1) {
+        in6->sin6_family = AF_INET6;
+        in6->sin6_port = htons(port);
+        *len = sizeof(*in6);
+    }
+    else
+        return -1;
+
+    return 0;
+}
+
 static inline
 ssize_t socket_recvfrom(int sk_fd, uchar buf[], struct sockaddr *addr, socklen_t *len)
 {
     ssize_t nBytes;
 
-    syserr(
-        (nBytes = recvfrom(sk_fd, buf, BUF_SIZE, 0, addr, len)) < 0,
-        "socket_recvfrom: recvfrom()\n");
+    nBytes = recvfrom(sk_fd, buf, PKT_LIMIT, 0, addr, len);
+    if(nBytes < 0 && errno == EINTR)
+        return -1;
+    syserr(nBytes < 0, "socket_recvfrom: recvfrom()\n");
 
     return nBytes;
 }
 
+///replies socket_sendto() dropped on errors, per worker
+static __thread unsigned long long socket_tx_errors;
+
+/**
+ * A reply the kernel refuses (ENOBUFS, EPERM of a filter, a bad peer
+ * address, ...) is dropped and counted; only a broken socket is fatal.
+ */
 static inline
 void socket_sendto(int sk_fd, uchar buf[], ssize_t buf_len, struct sockaddr * addr, socklen_t len)
 {
-    syserr(
-        sendto(sk_fd, buf, buf_len, 0, addr, len) < 0,
-        "socket_sendto()\n");
+    while(sendto(sk_fd, buf, buf_len, 0, addr, len) < 0)
+    {
+        if(errno == EINTR)
+            continue;
+        syserr(errno == EBADF || errno == ENOTSOCK || errno == EFAULT, "socket_sendto()\n");
+        dlog("socket_sendto: reply dropped: %s\n", strerror(errno));
+        socket_tx_errors++;
+        break;
+    }
+}
+
+/**
+ * **Batched I/O**
+ *
+ * recvmmsg(2)/sendmmsg(2) move up to `size` datagrams per syscall. Every slot
+ * owns a packet buffer and the peer address; the query is turned into its
+ * reply in the same buffer, so the replies of one batch can be flushed
+ * together after the whole batch is processed. The buffers are packet slots
+ * taken from the worker's pool.
+ */
+struct dns_batch {
+    unsigned int                size;       ///slots in the batch
+    unsigned int               count;       ///datagrams of the last receive
+    unsigned int             pending;       ///replies queued for sending
+    unsigned int               nlive;       ///slots let through by batch_prefilter()
+
+    struct mmsghdr             *rmsg;
+    struct mmsghdr             *wmsg;
+    struct iovec               *riov;
+    struct iovec               *wiov;
+    struct sockaddr_storage    *addr;
+    uchar                     **rbuf;
+    unsigned int               *live;
+
+    ///statistics: packets and syscalls of each direction
+    unsigned long long       rx_pkts;
+    unsigned long long      rx_calls;
+    unsigned long long       tx_pkts;
+    unsigned long long      tx_calls;
+    unsigned long long     tx_errors;     ///replies the kernel refused to send
+};
+
+#define batch_rbuf(b, i) ((b)->rbuf[i])
+#define batch_rlen(b, i) ((ssize_t) (b)->rmsg[i].msg_len)
+
+static inline
+struct dns_batch *batch_new(unsigned int size, struct pktpool *pool)
+{
+    struct dns_batch *b = (struct dns_batch *) calloc(1, sizeof(*b));
+    syserr(!b, "batch_new: calloc()\n");
+
+    b->size = size;
+    b->rmsg = (struct mmsghdr *) calloc(size, sizeof(*b->rmsg));
+    b->wmsg = (struct mmsghdr *) calloc(size, sizeof(*b->wmsg));
+    b->riov = (struct iovec *) calloc(size, sizeof(*b->riov));
+    b->wiov = (struct iovec *) calloc(size, sizeof(*b->wiov));
+    b->addr = (struct sockaddr_storage *) calloc(size, sizeof(*b->addr));
+    b->rbuf = (uchar **) calloc(size, sizeof(*b->rbuf));
+    b->live = (unsigned int *) calloc(size, sizeof(*b->live));
+    syserr(!b->rmsg || !b->wmsg || !b->riov || !b->wiov || !b->addr
+            || !b->rbuf || !b->live, "batch_new: malloc()\n");
+
+    for(unsigned int i = 0; i < size; i++)
+    {
+        b->rbuf[i] = pkt_get(pool);
+        syserr(!b->rbuf[i], "batch_new: packet pool too small\n");
+
+        b->riov[i].iov_base = batch_rbuf(b, i);
+        b->riov[i].iov_len = PKT_LIMIT;
+        b->rmsg[i].msg_hdr.msg_iov = &b->riov[i];
+        b->rmsg[i].msg_hdr.msg_iovlen = 1;
+        b->rmsg[i].msg_hdr.msg_name = &b->addr[i];
+    }
+
+    return b;
+}
+
+static inline
+void batch_free(struct dns_batch *b, struct pktpool *pool)
+{
+    for(unsigned int i = 0; i < b->size; i++)
+        pkt_put(pool, b->rbuf[i]);
+
+    free(b->rmsg);
+    free(b->wmsg);
+    free(b->riov);
+    free(b->wiov);
+    free(b->addr);
+    free(b->rbuf);
+    free(b->live);
+    free(b);
+}
+
+/**
+ * Queue the reply of slot @i; @len bytes are already in batch_rbuf(b, i).
+ */
+static inline
+void batch_reply(struct dns_batch *b, unsigned int i, ssize_t len)
+{
+    struct mmsghdr *m = &b->wmsg[b->pending];
+
+    b->wiov[b->pending].iov_base = batch_rbuf(b, i);
+    b->wiov[b->pending].iov_len = (size_t) len;
+
+    m->msg_hdr.msg_iov = &b->wiov[b->pending];
+    m->msg_hdr.msg_iovlen = 1;
+    m->msg_hdr.msg_name = &b->addr[i];
+    m->msg_hdr.msg_namelen = b->rmsg[i].msg_hdr.msg_namelen;
+    b->pending++;
+}
+
+/**
+ * Block until at least one datagram arrives, then take whatever else is
+ * already queued on the socket, up to the batch size.
+ *
+ * On a non-blocking socket it returns at once when nothing is queued.
+ *
+ * @return the number of datagrams, -1 if interrupted by a signal or nothing
+ *         is queued on a non-blocking socket
+ */
+static inline
+int socket_recvmmsg(int sk_fd, struct dns_batch *b)
+{
+    int n;
+
+    for(unsigned int i = 0; i < b->size; i++)
+        b->rmsg[i].msg_hdr.msg_namelen = sizeof(b->addr[i]);
+
+    n = recvmmsg(sk_fd, b->rmsg, b->size, MSG_WAITFORONE, NULL);
+    if(n < 0 && (errno == EINTR || errno == EAGAIN))
+        return -1;
+    syserr(n < 0, "socket_recvmmsg: recvmmsg()\n");
+
+    b->count = (unsigned int) n;
+    b->pending = 0;
+    b->rx_pkts += n;
+    b->rx_calls++;
+
+    return n;
+}
+
+/**
+ * Flush every queued reply; sendmmsg(2) may stop early, so keep going until
+ * the whole batch is out. When a non-blocking socket runs out of send
+ * buffer the rest of the batch is dropped, as the network would do.
+ *
+ * sendmmsg(2) fails only for the first message it was given: that reply is
+ * counted and skipped, the ones behind it still go out. Only an error of
+ * the socket itself is fatal.
+ */
+static inline
+void socket_sendmmsg(int sk_fd, struct dns_batch *b)
+{
+    unsigned int sent = 0;
+
+    while(sent < b->pending)
+    {
+        int n = sendmmsg(sk_fd, &b->wmsg[sent], b->pending - sent, 0);
+        if(n < 0 && errno == EINTR)
+            continue;
+        if(n < 0 && errno == EAGAIN)
+            break;
+        if(n < 0) {
+            syserr(errno == EBADF || errno == ENOTSOCK || errno == EFAULT,
+                    "socket_sendmmsg: sendmmsg()\n");
+            dlog("socket_sendmmsg: reply dropped: %s\n", strerror(errno));
+            b->tx_errors++;
+            n = 1;
+        }
+        else
+            b->tx_pkts += n;
+
+        sent += (unsigned int) n;
+        b->tx_calls++;
+    }
+
+    b->pending = 0;
+}
+
+static inline
+void batch_stats_show(struct dns_batch *b)
+{
+    printf("batch size %u\n", b->size);
+    printf("  recvmmsg: %llu packets / %llu syscalls = %.2f packets/syscall\n",
+            b->rx_pkts, b->rx_calls,
+            b->rx_calls ? (double) b->rx_pkts / b->rx_calls : 0.0);
+    printf("  sendmmsg: %llu packets / %llu syscalls = %.2f packets/syscall\n",
+            b->tx_pkts, b->tx_calls,
+            b->tx_calls ? (double) b->tx_pkts / b->tx_calls : 0.0);
+    if(b->tx_errors)
+        printf("  sendmmsg: %llu replies dropped on errors\n", b->tx_errors);
 }
 
 #endif ///DNS_IMPL_H
@@ -3,6 +3,7 @@
 
 #include <string.h>
 #include <arpa/inet.h>
+#include "protocol/name.h"
 
 /**
  * TODO: IMPORTANT, but why
@@ -24,32 +25,23 @@ void host_to_dns_name(char *dns, char *host)
     *dns = '\0';
 }
 
+/**
+ * Convert the name at *@locate of @buf, a message of at most BUF_SIZE bytes,
+ * from "3www6google3com0" (or a pointer to it) to "www.google.com", and
+ * step *@locate over it. @host holds NAME_TEXT_LIMIT bytes; a malformed
+ * name leaves it empty and *@locate untouched.
+ */
 static inline
 void dns_to_host_name(char *host, uchar *buf, size_t *locate)
 {
-    u16_t offset = 0xFFFF;
-    if( is_compressive(&buf[*locate])) {
-        offset = ((((u16_t) buf[*locate]) << 8) + buf[*locate + 1]) & compression_mask;
-        *locate += 2;
-    }
-    else
-        *locate += strlen((char *) &buf[*locate]) - 1;
-
-    uchar *dn = offset != 0xFFFF ? &buf[offset]: &buf[*locate];
+    size_t end;
 
-    int i = 0;
-    //Convert 3www6google3com0 to www.google.com
-    ///FIXME: Is it possible for >10
-
-    for(uchar count = dn[0]; count != 0; count = dn[i])
-    {
-        while(count-- != 0) {
-            host[i] = dn[i + 1];
-            i++;
-        }
-        host[i++] = '.';
-    }
-    host[i - 1] = '\0';
+    ///the end is known before the name is, store it only once all of it decoded
+    if(dns_name_decode(buf, BUF_SIZE, *locate, (uchar *) host, NAME_TEXT_LIMIT,
+                NAME_TEXT, &end) < 0)
+        host[0] = '\0';
+    else
+        *locate = end;
 }
 
 #endif ///DNS_UTIL_H
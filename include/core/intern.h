@@ -0,0 +1,282 @@
+#ifndef INTERN_H
+#define INTERN_H
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include "type.h"
+#include "limit.h"
+#include "debug.h"
+#include "core/dns_case.h"
+
+/**
+ * **Interned names**
+ *
+ * Every distinct owner or target name is stored once, in canonical wire
+ * form (uncompressed, lower case), together with the offset of each of its
+ * labels, its hash and its parent: the name with the first label removed,
+ * itself interned. Interning a name interns all its ancestors up to the
+ * root, so names sharing a suffix share the ancestors too.
+ *
+ * Two interned names are equal iff their pointers are. The label count and
+ * the parent link make dns_name_is_subdomain() a walk of at most as many
+ * steps as there are labels, comparing pointers and never bytes.
+ *
+ * Names live in chunks of INTERN_CHUNK bytes, bump allocated and never
+ * moved, so the pointers handed out stay valid until dns_intern_free().
+ * The table is built single threaded, e.g. while loading zones, and may
+ * then be read by any number of workers.
+ */
+#define INTERN_CHUNK (64 * 1024)
+
+struct dns_name {
+    const struct dns_name  *parent;     ///NULL for the root
+    u32_t                     hash;
+    u8_t                       len;     ///of the wire form, root label included
+    u8_t                   nlabels;     ///root excluded
+    ///label offsets into wire[], nlabels of them, then the wire form
+    u8_t                    data[];
+};
+
+struct dns_intern_chunk {
+    struct dns_intern_chunk  *next;
+    size_t                    used;
+    uchar                      mem[];
+};
+
+struct dns_intern {
+    const struct dns_name  **slot;
+    size_t                   nslot;     ///power of 2
+    size_t                   count;
+    size_t                   bytes;     ///of names, headers included
+    struct dns_intern_chunk *chunk;
+};
+
+static inline
+const uchar *dns_name_wire(const struct dns_name *n)
+{
+    return n->data + n->nlabels;
+}
+
+///label @i, 0 being the leftmost, as a length octet and its bytes
+static inline
+const uchar *dns_name_label(const struct dns_name *n, unsigned int i)
+{
+    return dns_name_wire(n) + n->data[i];
+}
+
+///the ancestor with @depth labels, NULL if @n has fewer
+static inline
+const struct dns_name *dns_name_ancestor(const struct dns_name *n, unsigned int depth)
+{
+    if(depth > n->nlabels)
+        return NULL;
+    for(unsigned int i = n->nlabels - depth; i > 0; i--)
+        n = n->parent;
+
+    return n;
+}
+
+///is @n @zone itself or below it?
+static inline
+bool dns_name_is_subdomain(const struct dns_name *n, const struct dns_name *zone)
+{
+    return dns_name_ancestor(n, zone->nlabels) == zone;
+}
+
+///hash of the label at @label followed by the name hashed to @parent
+static inline
+u32_t dns_intern_hash(const uchar *label, u32_t parent)
+{
+    u32_t h = parent ^ 2166136261u;
+
+    for(unsigned int i = 0; i <= label[0]; i++)
+        h = (h ^ label[i]) * 16777619u;
+
+    return h;
+}
+
+static inline
+struct dns_intern *dns_intern_new(size_t hint)
+{
+    struct dns_intern *t = calloc(1, sizeof(*t));
+
+    syserr(!t, "dns_intern_new: calloc\n");
+    for(t->nslot = 64; t->nslot < hint * 2; t->nslot <<= 1)
+        ;
+    syserr(!(t->slot = calloc(t->nslot, sizeof(t->slot[0]))), "dns_intern_new: calloc\n");
+
+    return t;
+}
+
+static inline
+void dns_intern_free(struct dns_intern *t)
+{
+    if(!t)
+        return;
+    for(struct dns_intern_chunk *c = t->chunk, *next; c; c = next)
+    {
+        next = c->next;
+        free(c);
+    }
+    free(t->slot);
+    free(t);
+}
+
+static inline
+void *dns_intern_alloc(struct dns_intern *t, size_t size)
+{
+    struct dns_intern_chunk *c = t->chunk;
+
+    size = (size + _Alignof(struct dns_name) - 1) & ~(_Alignof(struct dns_name) - 1);
+    if(!c || c->used + size > INTERN_CHUNK) {
+        syserr(!(c = malloc(sizeof(*c) + INTERN_CHUNK)), "dns_intern_alloc: malloc\n");
+        c->next = t->chunk;
+        c->used = 0;
+        t->chunk = c;
+    }
+    c->used += size;
+    t->bytes += size;
+
+    return c->mem + c->used - size;
+}
+
+static inline
+void dns_intern_grow(struct dns_intern *t)
+{
+    size_t nslot = t->nslot * 2;
+    const struct dns_name **slot = calloc(nslot, sizeof(slot[0]));
+
+    syserr(!slot, "dns_intern_grow: calloc\n");
+    for(size_t i = 0; i < t->nslot; i++)
+    {
+        size_t s;
+
+        if(!t->slot[i])
+            continue;
+        for(s = t->slot[i]->hash & (nslot - 1); slot[s]; s = (s + 1) & (nslot - 1))
+            ;
+        slot[s] = t->slot[i];
+    }
+    free(t->slot);
+    t->slot = slot;
+    t->nslot = nslot;
+}
+
+/**
+ * Slot of the canonical wire name @wire of @len bytes, whose first label
+ * hashed onto @hash: the slot holding it, or the empty one it would take.
+ */
+static inline
+size_t dns_intern_slot(const struct dns_intern *t, const uchar *wire, size_t len, u32_t hash)
+{
+    size_t s = hash & (t->nslot - 1);
+
+    for(; t->slot[s]; s = (s + 1) & (t->nslot - 1))
+    {
+        const struct dns_name *n = t->slot[s];
+
+        if(n->hash == hash && n->len == len && !memcmp(dns_name_wire(n), wire, len))
+            break;
+    }
+
+    return s;
+}
+
+/**
+ * Look the uncompressed wire @name up, any case, interning it unless
+ * @insert is false. @closest, if not NULL, is set to its deepest interned
+ * ancestor, @name itself included; NULL if @name is malformed.
+ *
+ * @return the interned name, NULL if @name is malformed or not interned
+ */
+static inline
+const struct dns_name *dns_intern_lookup(struct dns_intern *t, const uchar *name, bool insert,
+                                         const struct dns_name **closest)
+{
+    uchar wire[NAME_LIMIT];
+    u8_t at[NAME_LIMIT / 2];
+    u32_t hash[NAME_LIMIT / 2 + 1];
+    const struct dns_name *n = NULL;
+    ssize_t len = dns_case_len(name);
+    int nlabels = 0;
+
+    if(closest)
+        *closest = NULL;
+    if(len < 0)
+        return NULL;
+    memcpy(wire, name, len);
+    dns_case_lower_span(wire, len);
+
+    for(size_t off = 0; wire[off]; off += 1 + wire[off])
+        at[nlabels++] = (u8_t) off;
+    hash[nlabels] = dns_intern_hash(wire + len - 1, 0);
+    for(int i = nlabels - 1; i >= 0; i--)
+        hash[i] = dns_intern_hash(wire + at[i], hash[i + 1]);
+
+    ///from the root down, each parent before its child
+    for(int i = nlabels; i >= 0; i--)
+    {
+        size_t off = i < nlabels ? at[i] : (size_t) len - 1;
+        size_t s = dns_intern_slot(t, wire + off, len - off, hash[i]);
+        struct dns_name *m;
+
+        if(t->slot[s]) {
+            n = t->slot[s];
+            if(closest)
+                *closest = n;
+            continue;
+        }
+        if(!insert)
+            return NULL;
+
+        m = dns_intern_alloc(t, sizeof(*m) + (nlabels - i) + (len - off));
+        m->parent = n;
+        m->hash = hash[i];
+        m->len = (u8_t) (len - off);
+        m->nlabels = (u8_t) (nlabels - i);
+        for(int k = i; k < nlabels; k++)
+            m->data[k - i] = (u8_t) (at[k] - off);
+        memcpy(m->data + m->nlabels, wire + off, len - off);
+
+        t->slot[s] = n = m;
+        if(closest)
+            *closest = n;
+        if(++t->count * 2 > t->nslot)
+            dns_intern_grow(t);
+    }
+
+    return n;
+}
+
+///intern the uncompressed wire @name; NULL if it is malformed
+static inline
+const struct dns_name *dns_intern(struct dns_intern *t, const uchar *name)
+{
+    return dns_intern_lookup(t, name, true, NULL);
+}
+
+///the interned @name, NULL if it never was
+static inline
+const struct dns_name *dns_intern_find(struct dns_intern *t, const uchar *name)
+{
+    return dns_intern_lookup(t, name, false, NULL);
+}
+
+///the deepest interned ancestor of @name, @name itself included
+static inline
+const struct dns_name *dns_intern_closest(struct dns_intern *t, const uchar *name)
+{
+    const struct dns_name *closest;
+
+    dns_intern_lookup(t, name, false, &closest);
+    return closest;
+}
+
+static inline
+void dns_intern_stats_show(const struct dns_intern *t)
+{
+    printf("intern: %zu names in %zu bytes, %zu slots\n", t->count, t->bytes, t->nslot);
+}
+
+#endif ///INTERN_H
@@ -0,0 +1,106 @@
+#ifndef PKTPOOL_H
+#define PKTPOOL_H
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include "type.h"
+#include "limit.h"
+#include "debug.h"
+
+/**
+ * **Packet Buffer Pool**
+ *
+ * Fixed-size packet slots carved out of one cache-line aligned block when a
+ * worker starts. Free slots are kept on a stack of indices, so taking and
+ * giving back a slot is O(1) and never calls malloc.
+ *
+ * A pool belongs to one worker and is not locked.
+ */
+#define CACHE_LINE 64
+
+///slot size rounded up to whole cache lines
+#define PKT_SLOT_SIZE(size) (((size) + CACHE_LINE - 1) & ~((size_t) CACHE_LINE - 1))
+
+struct pktpool {
+    uchar                 *mem;
+    size_t           slot_size;
+    u32_t               nslots;
+    u32_t                nfree;
+    u32_t                *free;     ///stack of free slot indices
+
+    ///statistics
+    u32_t           high_water;     ///most slots ever in use at once
+    unsigned long long    gets;
+    unsigned long long  misses;     ///pkt_get() found the pool empty
+};
+
+static inline
+struct pktpool *pktpool_new(u32_t nslots, size_t size)
+{
+    struct pktpool *p = (struct pktpool *) calloc(1, sizeof(*p));
+    syserr(!p, "pktpool_new: calloc()\n");
+
+    p->slot_size = PKT_SLOT_SIZE(size);
+    p->nslots = nslots;
+    p->mem = (uchar *) aligned_alloc(CACHE_LINE, p->slot_size * nslots);
+    p->free = (u32_t *) malloc(nslots * sizeof(*p->free));
+    syserr(!p->mem || !p->free, "pktpool_new: malloc()\n");
+
+    ///hand out the lowest slots first
+    for(u32_t i = 0; i < nslots; i++)
+        p->free[i] = nslots - 1 - i;
+    p->nfree = nslots;
+
+    return p;
+}
+
+static inline
+void pktpool_free(struct pktpool *p)
+{
+    free(p->mem);
+    free(p->free);
+    free(p);
+}
+
+/**
+ * @return a slot of p->slot_size bytes, NULL if every slot is in use
+ */
+static inline
+uchar *pkt_get(struct pktpool *p)
+{
+    u32_t used;
+
+    if(p->nfree == 0) {
+        p->misses++;
+        return NULL;
+    }
+
+    p->gets++;
+    used = p->nslots - --p->nfree;
+    if(used > p->high_water)
+        p->high_water = used;
+
+    return p->mem + (size_t) p->free[p->nfree] * p->slot_size;
+}
+
+static inline
+void pkt_put(struct pktpool *p, uchar *slot)
+{
+    p->free[p->nfree++] = (u32_t) ((size_t) (slot - p->mem) / p->slot_size);
+}
+
+static inline
+bool pkt_owns(struct pktpool *p, uchar *buf)
+{
+    return buf >= p->mem && buf < p->mem + p->slot_size * p->nslots;
+}
+
+static inline
+void pktpool_stats_show(struct pktpool *p)
+{
+    printf("pool: %u slots of %zu bytes, high-water %u, %u in use, %llu gets, %llu misses\n",
+            p->nslots, p->slot_size, p->high_water, p->nslots - p->nfree, p->gets, p->misses);
+}
+
+#endif ///PKTPOOL_H
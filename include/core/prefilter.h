@@ -0,0 +1,111 @@
+#ifndef PREFILTER_H
+#define PREFILTER_H
+
+#include <stdio.h>
+#include <string.h>
+#include "type.h"
+#include "limit.h"
+#include "protocol/message.h"
+#include "dns_impl.h"
+
+/**
+ * **Batch pre-filter**
+ *
+ * Runs over a received batch before any slot is parsed and drops the
+ * datagrams that cannot be queries we answer: too short for a header and a
+ * question, QR already set, an opcode other than a standard query, a
+ * QDCOUNT of 0 or more than the datagram can hold, or a first question
+ * running past its end. The header checks are folded into one word of
+ * reasons without a branch, only a clean header pays for the scan of the
+ * question name, so a flood of junk costs a few loads and compares per
+ * datagram instead of a parse and a reply.
+ *
+ * The slots let through are listed in batch->live, in the order received.
+ * Only the batched UDP paths filter: a client over TCP or in blocking mode
+ * still gets its FORMERR or NOTIMP from dns_process().
+ */
+enum {
+    FILTER_SHORT,
+    FILTER_QR,
+    FILTER_OPCODE,
+    FILTER_QDCOUNT,
+    FILTER_QUESTION,
+    FILTER_PASS,        ///not a reason: let through
+};
+
+static const char *const filter_verdict[FILTER_PASS + 1] = {
+    "short", "qr", "opcode", "qdcount", "question", "passed",
+};
+
+///datagrams of each verdict
+struct prefilter_stats {
+    unsigned long long   count[FILTER_PASS + 1];
+};
+
+///the smallest query: a header, the root name, QTYPE and QCLASS
+#define FILTER_MIN_LEN (sizeof(DNS_HEADER_t) + 1 + sizeof(DNS_QUESTION_t))
+
+/**
+ * Why the datagram of @len bytes in @buf is dropped, FILTER_PASS if it
+ * is not. @buf is a packet slot, its header can be read whatever @len is.
+ */
+static inline
+unsigned int prefilter_check(const uchar *buf, size_t len)
+{
+    const DNS_HEADER_t *hdr = (const DNS_HEADER_t *) buf;
+    u16_t flags = ntohs(hdr->flags), qd = ntohs(hdr->qdcount);
+    size_t off = sizeof(DNS_HEADER_t);
+    unsigned int why;
+
+    why = (unsigned int) (len < FILTER_MIN_LEN) << FILTER_SHORT |
+          (unsigned int) !!(flags & DNS_QR) << FILTER_QR |
+          (unsigned int) !!(flags & DNS_OPCODE) << FILTER_OPCODE |
+          (unsigned int) (qd == 0 || qd > (len - off) / (1 + sizeof(DNS_QUESTION_t))) << FILTER_QDCOUNT;
+    if(why)
+        return (unsigned int) __builtin_ctz(why);
+
+    ///a first name nothing can point back to: plain labels up to the root
+    while(buf[off] != 0)
+    {
+        if(buf[off] > LABEL_LIMIT)
+            return FILTER_QUESTION;
+        off += 1 + buf[off];
+        if(off + 1 + sizeof(DNS_QUESTION_t) > len)
+            return FILTER_QUESTION;
+    }
+
+    return FILTER_PASS;
+}
+
+/**
+ * Filter the datagrams of the last receive into @b, counting into @st.
+ *
+ * @return the number of slots let through, batch->nlive
+ */
+static inline
+unsigned int batch_prefilter(struct dns_batch *b, struct prefilter_stats *st)
+{
+    unsigned int n = 0;
+
+    for(unsigned int i = 0; i < b->count; i++)
+    {
+        unsigned int why = prefilter_check(batch_rbuf(b, i), (size_t) batch_rlen(b, i));
+
+        b->live[n] = i;
+        n += why == FILTER_PASS;
+        st->count[why]++;
+    }
+
+    b->nlive = n;
+    return n;
+}
+
+static inline
+void prefilter_stats_show(const struct prefilter_stats *st)
+{
+    printf("prefilter: %llu passed, dropped", st->count[FILTER_PASS]);
+    for(int i = 0; i < FILTER_PASS; i++)
+        printf(" %llu %s%s", st->count[i], filter_verdict[i], i < FILTER_PASS - 1 ? "," : "\n");
+}
+
+#endif ///PREFILTER_H
@@ -0,0 +1,643 @@
+#ifndef REACTOR_H
+#define REACTOR_H
+
+#include <sys/epoll.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/uio.h>
+#include <stdbool.h>
+#include <time.h>
+#include "list.h"
+#include "debug.h"
+#include "core/rrl.h"
+#include "core/prefilter.h"
+
+/**
+ * **Reactor**
+ *
+ * One non-blocking epoll loop per worker. It multiplexes every listener of
+ * the worker (UDP and TCP, on several addresses) and the TCP connections it
+ * accepted, so a slow TCP client only ever costs the reactor one wakeup and
+ * never blocks the UDP service.
+ *
+ * The reactor knows nothing about DNS itself; every complete query is handed
+ * to `process`, which has the same contract as dns_process(): the query is
+ * turned into its reply in place.
+ */
+#define REACTOR_EVENTS   64
+///UDP batches drained per readiness event before other fds get their turn
+#define REACTOR_UDP_ROUNDS 4
+
+enum {
+    REACTOR_UDP,
+    REACTOR_TCP_LISTEN,
+    REACTOR_TCP_CONN,
+};
+
+///epoll_event.data.ptr points at this, first member of every watched object
+struct reactor_fd {
+    int                   kind;
+    int                     fd;
+};
+
+/**
+ * A reply waiting to be written, length prefix included. It lives in a
+ * packet slot of the worker; only replies which do not fit one, or arrive
+ * when the pool is empty, are malloc'ed.
+ */
+struct conn_reply {
+    struct list_head      list;
+    size_t                 len;
+    size_t                 off;
+    bool                pooled;
+    uchar               data[0];
+};
+
+/**
+ * A TCP client (RFC 7766).
+ *
+ * Queries are framed by a 2 octet length (RFC 1035 4.2.2). A client may
+ * pipeline many queries without waiting; each one is answered as soon as it
+ * is complete and its reply is queued independently, so replies leave in the
+ * order they finish, not in the order queries arrived. Reading pauses while
+ * PIPELINE_LIMIT replies are queued.
+ *
+ * Connections sit on the reactor list least recently active first, so the
+ * idle ones are always at the head.
+ */
+struct dns_conn {
+    struct reactor_fd      rfd;
+    struct list_head      list;
+    u64_t               active;     ///ms, last time the connection made progress
+    u32_t               events;     ///epoll events currently watched
+    bool                   eof;     ///client shut its side down
+    bool              draining;     ///taking only what the client already sent
+    bool                linger;     ///answered and shut down, input is dropped
+
+    uchar                *rbuf;     ///received, not yet answered bytes
+    size_t                rlen;
+    size_t                rcap;
+
+    struct list_head   replies;
+    unsigned int      nreplies;
+};
+
+///read buffer of a connection, grown when a bigger query arrives
+#define CONN_RBUF_SIZE 1024
+///replies gathered by one writev
+#define CONN_IOV 16
+
+typedef ssize_t (*dns_process_t)(uchar *buf, ssize_t len, size_t cap);
+
+struct reactor {
+    int                           epfd;
+    dns_process_t              process;
+    struct pktpool               *pool;
+    struct dns_batch            *batch;
+
+    struct reactor_fd   lfd[2 * LISTEN_LIMIT];
+    unsigned int                  nlfd;
+
+    struct list_head             conns;
+    unsigned int                nconns;
+    u64_t                      idle_ms;
+    uchar                     *scratch;     ///TCP queries are answered here
+    struct rrl                    *rrl;     ///limits UDP replies, may be NULL
+
+    ///statistics
+    unsigned long long        accepted;
+    unsigned long long         refused;
+    unsigned long long        timeouts;
+    unsigned long long     tcp_queries;
+    unsigned int          max_pipeline;
+    struct rrl_stats         rrl_stats;
+    struct prefilter_stats filter_stats;
+};
+
+static inline
+u64_t reactor_now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC_COARSE, &ts);
+    return (u64_t) ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static inline
+void reactor_nonblock(int fd)
+{
+    int flags = fcntl(fd, F_GETFL);
+
+    syserr(flags < 0 || fcntl(fd, F_SETFL, flags | O_NONBLOCK) < 0,
+            "reactor_nonblock: fcntl()\n");
+}
+
+static inline
+void reactor_watch(struct reactor *r, int op, struct reactor_fd *rfd, u32_t events)
+{
+    struct epoll_event ev = { .events = events, .data.ptr = rfd };
+
+    syserr(epoll_ctl(r->epfd, op, rfd->fd, &ev) < 0, "reactor_watch: epoll_ctl()\n");
+}
+
+/**
+ * @pool: packet slots of the worker, at least @batch + POOL_TCP_SLOTS
+ * @idle: seconds a TCP connection may stay without progress
+ */
+static inline
+struct reactor *reactor_new(dns_process_t process, struct pktpool *pool,
+                            unsigned int batch, unsigned int idle)
+{
+    struct reactor *r = (struct reactor *) calloc(1, sizeof(*r));
+    syserr(!r, "reactor_new: calloc()\n");
+
+    r->epfd = epoll_create1(EPOLL_CLOEXEC);
+    syserr(r->epfd < 0, "reactor_new: epoll_create1()\n");
+
+    r->process = process;
+    r->pool = pool;
+    r->batch = batch_new(batch, pool);
+    r->idle_ms = (u64_t) idle * 1000;
+    r->scratch = (uchar *) malloc(2 + TCP_LIMIT);
+    syserr(!r->scratch, "reactor_new: malloc()\n");
+    INIT_LIST_HEAD(&r->conns);
+
+    return r;
+}
+
+/**
+ * Watch an already bound socket; SOCK_STREAM sockets are put to listen.
+ */
+static inline
+void reactor_add_listener(struct reactor *r, int fd, int type)
+{
+    struct reactor_fd *rfd;
+
+    syserr(r->nlfd == ARRAY_SIZE(r->lfd), "reactor_add_listener: too many listeners\n");
+    rfd = &r->lfd[r->nlfd++];
+
+    reactor_nonblock(fd);
+    if(type == SOCK_STREAM)
+        syserr(listen(fd, SOMAXCONN) < 0, "reactor_add_listener: listen()\n");
+
+    rfd->fd = fd;
+    rfd->kind = (type == SOCK_STREAM) ? REACTOR_TCP_LISTEN : REACTOR_UDP;
+    reactor_watch(r, EPOLL_CTL_ADD, rfd, EPOLLIN);
+}
+
+static inline
+void conn_reply_free(struct reactor *r, struct conn_reply *rp)
+{
+    if(rp->pooled)
+        pkt_put(r->pool, (uchar *) rp);
+    else
+        free(rp);
+}
+
+static inline
+void conn_close(struct reactor *r, struct dns_conn *c)
+{
+    struct conn_reply *rp, *n;
+
+    dlog("reactor: close connection %d\n", c->rfd.fd);
+
+    close(c->rfd.fd);
+    list_del(&c->list);
+    r->nconns--;
+
+    list_for_each_entry_safe(rp, n, &c->replies, list)
+        conn_reply_free(r, rp);
+    free(c->rbuf);
+    free(c);
+}
+
+///the connection made progress: it is the most recently active one now
+static inline
+void conn_touch(struct reactor *r, struct dns_conn *c)
+{
+    c->active = reactor_now();
+    list_move_tail(&c->list, &r->conns);
+}
+
+/**
+ * Watch for input while the pipeline has room, for output while replies
+ * are stuck in the queue.
+ */
+static inline
+void conn_update(struct reactor *r, struct dns_conn *c, bool blocked)
+{
+    u32_t events = c->eof ? 0 : EPOLLRDHUP;
+
+    if(!c->eof && c->nreplies < PIPELINE_LIMIT)
+        events |= EPOLLIN;
+    if(blocked)
+        events |= EPOLLOUT;
+
+    if(events != c->events) {
+        c->events = events;
+        reactor_watch(r, EPOLL_CTL_MOD, &c->rfd, events);
+    }
+}
+
+static inline
+void reactor_accept(struct reactor *r, struct reactor_fd *lfd)
+{
+    int fd, on = 1;
+
+    while((fd = accept4(lfd->fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC)) >= 0)
+    {
+        struct dns_conn *c;
+
+        if(r->nconns >= CONN_LIMIT || !(c = (struct dns_conn *) calloc(1, sizeof(*c)))) {
+            r->refused++;
+            close(fd);
+            continue;
+        }
+
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+
+        c->rfd.fd = fd;
+        c->rfd.kind = REACTOR_TCP_CONN;
+        c->events = EPOLLIN | EPOLLRDHUP;
+        INIT_LIST_HEAD(&c->replies);
+        list_add_tail(&c->list, &r->conns);
+        c->active = reactor_now();
+        r->nconns++;
+        r->accepted++;
+
+        reactor_watch(r, EPOLL_CTL_ADD, &c->rfd, c->events);
+        dlog("reactor: accept connection %d\n", fd);
+    }
+}
+
+///a complete query is waiting in the read buffer
+static inline
+bool conn_has_query(struct dns_conn *c)
+{
+    return c->rlen >= 2 && c->rlen >= 2 + (((size_t) c->rbuf[0] << 8) | c->rbuf[1]);
+}
+
+/**
+ * Write as many queued replies as the socket takes, several per writev.
+ *
+ * @return -1 if the connection is gone or finished, 0 otherwise
+ */
+static inline
+int conn_write(struct reactor *r, struct dns_conn *c)
+{
+    struct iovec iov[CONN_IOV];
+    struct conn_reply *rp, *n;
+    bool blocked = false;
+
+    while(c->nreplies > 0)
+    {
+        int cnt = 0;
+        ssize_t len;
+
+        list_for_each_entry(rp, &c->replies, list)
+        {
+            iov[cnt].iov_base = rp->data + rp->off;
+            iov[cnt].iov_len = rp->len - rp->off;
+            if(++cnt == CONN_IOV)
+                break;
+        }
+
+        len = writev(c->rfd.fd, iov, cnt);
+        if(len < 0 && errno == EINTR)
+            continue;
+        if(len < 0 && errno == EAGAIN) {
+            blocked = true;
+            break;
+        }
+        if(len < 0)
+            return -1;
+
+        conn_touch(r, c);
+        list_for_each_entry_safe(rp, n, &c->replies, list)
+        {
+            size_t left = rp->len - rp->off;
+
+            if((size_t) len < left) {
+                rp->off += len;
+                break;
+            }
+            len -= left;
+            list_del(&rp->list);
+            conn_reply_free(r, rp);
+            c->nreplies--;
+        }
+    }
+
+    ///the client is done sending and has all of its answers
+    if(c->eof && c->nreplies == 0 && !conn_has_query(c)) {
+        if(!c->draining)
+            return -1;
+
+        /**
+         * The client may still be sending: closing with unread input would
+         * reset the connection and lose the replies it did not read yet.
+         * Send a FIN after them and wait for the client to close instead.
+         */
+        if(shutdown(c->rfd.fd, SHUT_WR) < 0)
+            return -1;
+        c->linger = true;
+        c->events = EPOLLIN | EPOLLRDHUP;
+        reactor_watch(r, EPOLL_CTL_MOD, &c->rfd, c->events);
+        return 0;
+    }
+
+    conn_update(r, c, blocked);
+    return 0;
+}
+
+/**
+ * Answer one complete query and queue its reply.
+ */
+static inline
+int conn_answer(struct reactor *r, struct dns_conn *c, uchar *query, size_t qlen)
+{
+    struct conn_reply *rp;
+    ssize_t len;
+
+    ///the query sits in the middle of the read stream, answer it aside
+    r->tcp_queries++;
+    memcpy(r->scratch + 2, query, qlen);
+    len = r->process(r->scratch + 2, (ssize_t) qlen, TCP_LIMIT);
+    if(len <= 0)
+        return 0;
+
+    rp = NULL;
+    if(sizeof(*rp) + 2 + len <= r->pool->slot_size)
+        rp = (struct conn_reply *) pkt_get(r->pool);
+    if(rp)
+        rp->pooled = true;
+    else if((rp = (struct conn_reply *) malloc(sizeof(*rp) + 2 + len)))
+        rp->pooled = false;
+    else
+        return -1;
+
+    rp->data[0] = (uchar) (len >> 8);
+    rp->data[1] = (uchar) len;
+    memcpy(rp->data + 2, r->scratch + 2, len);
+    rp->len = (size_t) len + 2;
+    rp->off = 0;
+
+    list_add_tail(&rp->list, &c->replies);
+    if(++c->nreplies > r->max_pipeline)
+        r->max_pipeline = c->nreplies;
+
+    return 0;
+}
+
+///drop the input of a lingering connection until the client closes it
+static inline
+int conn_discard(struct reactor *r, struct dns_conn *c)
+{
+    ssize_t n;
+
+    while((n = read(c->rfd.fd, r->scratch, 2 + TCP_LIMIT)) > 0 || (n < 0 && errno == EINTR))
+        ;
+
+    return (n < 0 && errno == EAGAIN) ? 0 : -1;
+}
+
+/**
+ * Answer every complete query already received, then read more while the
+ * pipeline has room.
+ *
+ * @return -1 if the connection should be closed, 0 otherwise
+ */
+static inline
+int conn_read(struct reactor *r, struct dns_conn *c)
+{
+    ssize_t n;
+    size_t off, want;
+
+    if(c->linger)
+        return conn_discard(r, c);
+
+    if(!c->rbuf) {
+        c->rcap = CONN_RBUF_SIZE;
+        if(!(c->rbuf = (uchar *) malloc(c->rcap)))
+            return -1;
+    }
+
+    while(1)
+    {
+        for(off = 0; c->rlen - off >= 2 && c->nreplies < PIPELINE_LIMIT; off += 2 + want)
+        {
+            want = ((size_t) c->rbuf[off] << 8) | c->rbuf[off + 1];
+            if(c->rlen - off < 2 + want)
+                break;
+            if(conn_answer(r, c, c->rbuf + off + 2, want) < 0)
+                return -1;
+        }
+
+        c->rlen -= off;
+        memmove(c->rbuf, c->rbuf + off, c->rlen);
+
+        ///make room for a query larger than the buffer
+        if(c->rlen >= 2) {
+            want = 2 + (((size_t) c->rbuf[0] << 8) | c->rbuf[1]);
+            if(want > c->rcap) {
+                uchar *nbuf = (uchar *) realloc(c->rbuf, want);
+                if(!nbuf)
+                    return -1;
+                c->rbuf = nbuf;
+                c->rcap = want;
+            }
+        }
+
+        ///a full pipeline: go on answering if the replies could be sent
+        if(c->nreplies >= PIPELINE_LIMIT) {
+            if(conn_write(r, c) < 0)
+                return -1;
+            if(c->nreplies < PIPELINE_LIMIT)
+                continue;
+            break;
+        }
+        if(c->eof)
+            break;
+
+        n = read(c->rfd.fd, c->rbuf + c->rlen, c->rcap - c->rlen);
+        if(n < 0 && errno == EINTR)
+            continue;
+        if(n < 0 && errno == EAGAIN) {
+            ///all that was sent before the handoff is read
+            if(c->draining)
+                c->eof = true;
+            break;
+        }
+        if(n < 0)
+            return -1;
+        ///nothing can be left unread: the connection may just be closed
+        if(n == 0)
+            c->eof = true, c->draining = false;
+        else {
+            c->rlen += n;
+            conn_touch(r, c);
+        }
+    }
+
+    return conn_write(r, c);
+}
+
+/**
+ * Close every connection which made no progress for the idle timeout.
+ *
+ * @return ms until the next connection expires, -1 if there is none
+ */
+static inline
+int reactor_expire(struct reactor *r)
+{
+    u64_t now = reactor_now();
+    struct dns_conn *c, *n;
+
+    list_for_each_entry_safe(c, n, &r->conns, list)
+    {
+        if(c->active + r->idle_ms > now)
+            return (int) (c->active + r->idle_ms - now);
+
+        r->timeouts++;
+        conn_close(r, c);
+    }
+
+    return -1;
+}
+
+static inline
+void reactor_udp(struct reactor *r, struct reactor_fd *rfd)
+{
+    struct dns_batch *b = r->batch;
+    ssize_t len;
+
+    for(int round = 0; round < REACTOR_UDP_ROUNDS; round++)
+    {
+        if(socket_recvmmsg(rfd->fd, b) <= 0)
+            return;
+
+        batch_prefilter(b, &r->filter_stats);
+        for(unsigned int k = 0; k < b->nlive; k++)
+        {
+            unsigned int i = b->live[k];
+
+            len = r->process(batch_rbuf(b, i), batch_rlen(b, i), EDNS_LIMIT);
+            if(len > 0 && r->rrl)
+                len = rrl_apply(r->rrl, &r->rrl_stats, (struct sockaddr *) &b->addr[i],
+                                batch_rbuf(b, i), len);
+            if(len > 0)
+                batch_reply(b, i, len);
+        }
+        socket_sendmmsg(rfd->fd, b);
+
+        if(b->count < b->size)
+            return;
+    }
+}
+
+/**
+ * Stop taking new work, the listeners being left to a successor: every
+ * connection is shut down as soon as the queries it already sent are
+ * answered, those still in the socket buffer included, and closed once the
+ * client closed it too or it went idle.
+ */
+static inline
+void reactor_drain(struct reactor *r)
+{
+    struct dns_conn *c, *n;
+
+    for(unsigned int i = 0; i < r->nlfd; i++)
+        syserr(epoll_ctl(r->epfd, EPOLL_CTL_DEL, r->lfd[i].fd, NULL) < 0,
+                "reactor_drain: epoll_ctl()\n");
+
+    list_for_each_entry_safe(c, n, &r->conns, list)
+    {
+        c->draining = true;
+        if(conn_read(r, c) < 0)
+            conn_close(r, c);
+    }
+}
+
+/**
+ * Run until *@stop is set, or once *@drain is set until the last connection
+ * is closed; a signal interrupting epoll_wait() gets the flags noticed.
+ * epoll_wait() sleeps no longer than the next idle timeout.
+ */
+static inline
+void reactor_run(struct reactor *r, volatile sig_atomic_t *stop, volatile sig_atomic_t *drain)
+{
+    struct epoll_event ev[REACTOR_EVENTS];
+    bool draining = false;
+
+    while(!*stop)
+    {
+        if(*drain && !draining) {
+            reactor_drain(r);
+            draining = true;
+        }
+        ///expire first: the last connection may be the one which timed out
+        int timeout = reactor_expire(r);
+        if(draining && r->nconns == 0)
+            break;
+
+        int n = epoll_wait(r->epfd, ev, REACTOR_EVENTS, timeout);
+        if(n < 0 && errno == EINTR)
+            continue;
+        syserr(n < 0, "reactor_run: epoll_wait()\n");
+
+        for(int i = 0; i < n; i++)
+        {
+            struct reactor_fd *rfd = (struct reactor_fd *) ev[i].data.ptr;
+            struct dns_conn *c;
+
+            switch(rfd->kind) {
+                case REACTOR_UDP:
+                    reactor_udp(r, rfd);
+                    break;
+                case REACTOR_TCP_LISTEN:
+                    reactor_accept(r, rfd);
+                    break;
+                case REACTOR_TCP_CONN:
+                    c = container_of(rfd, struct dns_conn, rfd);
+                    ///a drained queue may let already received queries through
+                    if(ev[i].events & EPOLLERR)
+                        conn_close(r, c);
+                    else if((ev[i].events & EPOLLOUT) && conn_write(r, c) < 0)
+                        conn_close(r, c);
+                    else if(((ev[i].events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP)) || c->rlen)
+                            && conn_read(r, c) < 0)
+                        conn_close(r, c);
+                    break;
+            }
+        }
+    }
+}
+
+static inline
+void reactor_free(struct reactor *r)
+{
+    struct dns_conn *c, *n;
+
+    list_for_each_entry_safe(c, n, &r->conns, list)
+        conn_close(r, c);
+
+    close(r->epfd);
+    batch_free(r->batch, r->pool);
+    free(r->scratch);
+    free(r);
+}
+
+static inline
+void reactor_stats_show(struct reactor *r)
+{
+    printf("reactor: %llu connections accepted, %llu refused, %llu timed out\n",
+            r->accepted, r->refused, r->timeouts);
+    printf("  %llu tcp queries, deepest pipeline %u\n", r->tcp_queries, r->max_pipeline);
+    prefilter_stats_show(&r->filter_stats);
+    if(r->rrl)
+        rrl_stats_show(&r->rrl_stats);
+    batch_stats_show(r->batch);
+}
+
+#endif ///REACTOR_H
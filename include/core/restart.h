@@ -0,0 +1,287 @@
+#ifndef RESTART_H
+#define RESTART_H
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <poll.h>
+#include <string.h>
+#include <unistd.h>
+#include "type.h"
+#include "limit.h"
+#include "macro.h"
+#include "debug.h"
+#include "core/worker.h"
+
+/**
+ * **Hot restart**
+ *
+ * A server started with `-R <path>` keeps a unix stream socket listening on
+ * <path>. A successor started with the same option connects to it once its
+ * configuration and zones are loaded, and is handed every bound socket of
+ * the running server through SCM_RIGHTS:
+ *
+ *  1. the successor connects;
+ *  2. the server sends a restart_hello, the sockets of each worker in one
+ *     message per worker, and last the control socket itself;
+ *  3. the successor starts its workers on them and acknowledges with a byte;
+ *  4. the server stops taking new work, drains what it already took and
+ *     exits.
+ *
+ * Both processes hold the very same sockets, so datagrams and connections
+ * queued in the meantime are served by whichever reads them first and none
+ * is dropped. A successor dying before its acknowledgement leaves the
+ * server serving as if nothing happened.
+ */
+#define RESTART_MAGIC   0x444e5352      ///"DNSR"
+///seconds the server waits for the successor to acknowledge
+#define RESTART_TIMEOUT 30
+
+struct restart_hello {
+    u32_t                  magic;
+    s32_t                   mode;
+    u32_t               nworkers;
+};
+
+struct restart_worker {
+    u32_t                    nsk;
+    s32_t sk_type[2 * LISTEN_LIMIT];
+};
+
+static inline
+int restart_addr(const char *path, struct sockaddr_un *addr)
+{
+    memset(addr, 0, sizeof(*addr));
+    addr->sun_family = AF_UNIX;
+    if(strlen(path) >= sizeof(addr->sun_path))
+        return -1;
+    strcpy(addr->sun_path, path);
+    return 0;
+}
+
+/**
+ * Control socket of the first server; a path left by a dead one is reused.
+ */
+static inline
+int restart_listen(const char *path)
+{
+    struct sockaddr_un addr;
+    int fd;
+
+    syserr(restart_addr(path, &addr) < 0, "restart_listen: path too long\n");
+
+    fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    syserr(fd < 0, "restart_listen: socket()\n");
+
+    unlink(path);
+    syserr(bind(fd, (struct sockaddr *) &addr, sizeof(addr)) < 0, "restart_listen: bind()\n");
+    syserr(listen(fd, 1) < 0, "restart_listen: listen()\n");
+
+    return fd;
+}
+
+/**
+ * @return connection to the running server, -1 if none listens on @path
+ */
+static inline
+int restart_connect(const char *path)
+{
+    struct sockaddr_un addr;
+    int fd;
+
+    syserr(restart_addr(path, &addr) < 0, "restart_connect: path too long\n");
+
+    fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    syserr(fd < 0, "restart_connect: socket()\n");
+
+    if(connect(fd, (struct sockaddr *) &addr, sizeof(addr)) < 0) {
+        close(fd);
+        return -1;
+    }
+
+    return fd;
+}
+
+static inline
+int restart_send(int fd, void *data, size_t len, int *fds, unsigned int nfds)
+{
+    union {
+        struct cmsghdr                       hdr;
+        char buf[CMSG_SPACE(sizeof(int) * 2 * LISTEN_LIMIT)];
+    } ctl;
+    struct iovec iov = { .iov_base = data, .iov_len = len };
+    struct msghdr msg = { .msg_iov = &iov, .msg_iovlen = 1 };
+
+    if(nfds) {
+        struct cmsghdr *cmsg;
+
+        memset(&ctl, 0, sizeof(ctl));
+        msg.msg_control = ctl.buf;
+        msg.msg_controllen = CMSG_SPACE(sizeof(int) * nfds);
+        cmsg = CMSG_FIRSTHDR(&msg);
+        cmsg->cmsg_level = SOL_SOCKET;
+        cmsg->cmsg_type = SCM_RIGHTS;
+        cmsg->cmsg_len = CMSG_LEN(sizeof(int) * nfds);
+        memcpy(CMSG_DATA(cmsg), fds, sizeof(int) * nfds);
+    }
+
+    return sendmsg(fd, &msg, MSG_NOSIGNAL) == (ssize_t) len ? 0 : -1;
+}
+
+/**
+ * Receive @len bytes and the descriptors sent along, storing up to @cap of
+ * them in @fds. Descriptors beyond @cap are closed, and so is every one
+ * received when the message is short or its control data was truncated.
+ *
+ * @return number of descriptors stored in @fds, -1 on failure
+ */
+static inline
+int restart_recv(int fd, void *data, size_t len, int *fds, unsigned int cap)
+{
+    union {
+        struct cmsghdr                       hdr;
+        char buf[CMSG_SPACE(sizeof(int) * 2 * LISTEN_LIMIT)];
+    } ctl;
+    struct iovec iov = { .iov_base = data, .iov_len = len };
+    struct msghdr msg = { .msg_iov = &iov, .msg_iovlen = 1 };
+    struct cmsghdr *cmsg;
+    unsigned int nfds = 0;
+    ssize_t n;
+
+    msg.msg_control = ctl.buf;
+    msg.msg_controllen = sizeof(ctl.buf);
+
+    if((n = recvmsg(fd, &msg, MSG_CMSG_CLOEXEC | MSG_WAITALL)) < 0)
+        return -1;
+
+    ///the descriptors are ours even when the message is not what we wanted
+    for(cmsg = CMSG_FIRSTHDR(&msg); cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg))
+    {
+        if(cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS)
+            continue;
+
+        for(size_t j = 0; j < (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int); j++)
+        {
+            int d;
+
+            memcpy(&d, CMSG_DATA(cmsg) + j * sizeof(int), sizeof(d));
+            if(nfds < cap)
+                fds[nfds++] = d;
+            else
+                close(d);
+        }
+    }
+
+    if(n != (ssize_t) len || (msg.msg_flags & MSG_CTRUNC)) {
+        for(unsigned int j = 0; j < nfds; j++)
+            close(fds[j]);
+        return -1;
+    }
+
+    return (int) nfds;
+}
+
+/**
+ * Server side: hand the sockets of the @n workers and the control socket
+ * @lfd over the connection @fd, then wait for the acknowledgement.
+ *
+ * @return 0 if the successor took over, -1 if it did not
+ */
+static inline
+int restart_handoff(int fd, int lfd, int mode, struct dns_worker *w, unsigned int n)
+{
+    struct restart_hello hello = {
+        .magic = RESTART_MAGIC,
+        .mode = mode,
+        .nworkers = n,
+    };
+    struct pollfd pfd = { .fd = fd, .events = POLLIN };
+    char ack;
+
+    if(restart_send(fd, &hello, sizeof(hello), NULL, 0) < 0)
+        return -1;
+
+    for(unsigned int i = 0; i < n; i++)
+    {
+        struct restart_worker rw = { .nsk = w[i].nsk };
+
+        memcpy(rw.sk_type, w[i].sk_type, sizeof(rw.sk_type));
+        if(restart_send(fd, &rw, sizeof(rw), w[i].sk_fd, w[i].nsk) < 0)
+            return -1;
+    }
+
+    if(restart_send(fd, &hello, sizeof(hello), &lfd, 1) < 0)
+        return -1;
+
+    if(poll(&pfd, 1, RESTART_TIMEOUT * 1000) != 1)
+        return -1;
+    return read(fd, &ack, 1) == 1 ? 0 : -1;
+}
+
+/**
+ * Successor side: adopt the workers and sockets of the running server. The
+ * socket layout depends on the mode, so a successor may switch between the
+ * modes serving UDP alone but not in or out of epoll mode.
+ *
+ * @return 0 with *@w, *@n and the control socket *@lfd set, -1 on failure
+ */
+static inline
+int restart_takeover(int fd, int mode, struct dns_worker **w, unsigned int *n, int *lfd)
+{
+    struct restart_hello hello;
+    struct dns_worker *ws;
+    unsigned int i;
+
+    if(restart_recv(fd, &hello, sizeof(hello), NULL, 0) != 0 || hello.magic != RESTART_MAGIC)
+        return -1;
+    if(hello.nworkers == 0 || hello.nworkers > WORKER_LIMIT) {
+        fprintf(stderr, "restart: the running server claims %u workers\n", hello.nworkers);
+        return -1;
+    }
+    if((hello.mode == WORKER_EPOLL) != (mode == WORKER_EPOLL)) {
+        fprintf(stderr, "restart: the running server is %sin epoll mode\n",
+                hello.mode == WORKER_EPOLL ? "" : "not ");
+        return -1;
+    }
+
+    ws = (struct dns_worker *) calloc(hello.nworkers, sizeof(*ws));
+    syserr(!ws, "restart_takeover: calloc()\n");
+
+    for(i = 0; i < hello.nworkers; i++)
+    {
+        struct restart_worker rw;
+        int nfds = restart_recv(fd, &rw, sizeof(rw), ws[i].sk_fd, ARRAY_SIZE(ws[i].sk_fd));
+
+        if(nfds < 0)
+            goto fail;
+        ws[i].nsk = (unsigned int) nfds;
+        if(nfds == 0 || rw.nsk != ws[i].nsk)
+            goto fail;
+        memcpy(ws[i].sk_type, rw.sk_type, sizeof(rw.sk_type));
+    }
+
+    if(restart_recv(fd, &hello, sizeof(hello), lfd, 1) != 1)
+        goto fail;
+
+    *w = ws;
+    *n = hello.nworkers;
+    return 0;
+
+fail:
+    ///the workers up to i hold received descriptors
+    for(unsigned int k = 0; k < hello.nworkers && k <= i; k++)
+        for(unsigned int j = 0; j < ws[k].nsk; j++)
+            close(ws[k].sk_fd[j]);
+    free(ws);
+    return -1;
+}
+
+///successor side: serving, the old server may go
+static inline
+void restart_ack(int fd)
+{
+    if(send(fd, "", 1, MSG_NOSIGNAL) != 1)
+        dlog("restart: the old server is already gone\n");
+    close(fd);
+}
+
+#endif ///RESTART_H
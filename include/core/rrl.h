@@ -0,0 +1,267 @@
+#ifndef RRL_H
+#define RRL_H
+
+#include <stdatomic.h>
+#include <endian.h>
+#include <string.h>
+#include <time.h>
+#include <sys/random.h>
+#include <netinet/in.h>
+#include "type.h"
+#include "debug.h"
+#include "protocol/reply.h"
+
+/**
+ * **Response rate limiting**
+ *
+ * Every UDP reply is charged to a token bucket keyed by the client prefix
+ * (/24 for IPv4, /56 for IPv6) and the kind of reply. A bucket holds at most
+ * `rate` tokens and gains `rate` tokens per second; a reply finding its
+ * bucket empty is dropped, except every `slip`-th one which leaves
+ * truncated so a real client behind a spoofed prefix retries over TCP.
+ *
+ * The buckets live in one table shared by all workers, since a flood from
+ * one prefix is spread over every SO_REUSEPORT socket. A bucket is a single
+ * 64-bit word updated by compare-and-swap:
+ *
+ *      63        40 39         16 15       0
+ *     +------------+-------------+----------+
+ *     |  key tag   |  refill ms  |  tokens  |
+ *     +------------+-------------+----------+
+ *
+ * so admission is a hash, a few loads and a CAS, without locks. The table
+ * has a fixed size, so a key may take any of RRL_WAYS neighbouring slots:
+ * the one whose tag matches, else the first empty or idle one, i.e. one
+ * whose bucket refilled completely. Only when every way holds a busy bucket
+ * of another key is the key charged to one of them, so spoofing many
+ * prefixes has to fill a whole set before a real client shares a bucket
+ * with it, and slips still send that client over to TCP.
+ *
+ * Slips are counted per thread, not per bucket: out of the replies over
+ * the limit a worker sees, every `slip`-th one slips, whichever prefix it
+ * goes to. The refill time is kept modulo 2^24 ms (4.6 hours), the coarse
+ * clock costs no syscall.
+ */
+#define RRL_SLOTS      (1 << 16)        ///power of 2
+#define RRL_WAYS       4                ///slots a key may take, power of 2
+#define RRL_RATE_LIMIT 0xffff
+
+///kinds of reply with buckets of their own
+enum {
+    RRL_ANSWER,
+    RRL_NODATA,
+    RRL_NXDOMAIN,
+    RRL_ERROR,
+};
+
+///what to do with the reply
+enum {
+    RRL_PASS,
+    RRL_DROP,
+    RRL_SLIP,
+};
+
+struct rrl {
+    u32_t                        rate;     ///replies per second and prefix
+    u32_t                        slip;     ///0: drop every reply over the limit
+    u64_t                        seed;
+    _Atomic u64_t   slot[RRL_SLOTS];
+};
+
+struct rrl_stats {
+    unsigned long long         passed;
+    unsigned long long        dropped;
+    unsigned long long        slipped;
+};
+
+#define RRL_TAG(h)       ((h) >> 40)
+#define RRL_TIME_MASK    0xffffffULL
+
+static inline
+struct rrl *rrl_new(u32_t rate, u32_t slip)
+{
+    struct rrl *rl = (struct rrl *) calloc(1, sizeof(*rl));
+    syserr(!rl, "rrl_new: calloc()\n");
+
+    rl->rate = rate;
+    rl->slip = slip;
+    ///a secret seed: nobody can aim at the bucket of another prefix
+    syserr(getrandom(&rl->seed, sizeof(rl->seed), 0) != sizeof(rl->seed), "rrl_new: getrandom()\n");
+
+    return rl;
+}
+
+static inline
+void rrl_free(struct rrl *rl)
+{
+    free(rl);
+}
+
+static inline
+u64_t rrl_now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC_COARSE, &ts);
+    return (u64_t) ts.tv_sec * 1000 + (u64_t) ts.tv_nsec / 1000000;
+}
+
+/**
+ * Hash of the prefix of @addr and the reply kind @kind.
+ */
+static inline
+u64_t rrl_hash(struct rrl *rl, const struct sockaddr *addr, int kind)
+{
+    u64_t k;
+
+    if(addr->sa_family == AF_INET6) {
+        const uchar *a = ((const struct sockaddr_in6 *) addr)->sin6_addr.s6_addr;
+
+        memcpy(&k, a, sizeof(k));
+        k &= htobe64(0xffffffffffffff00ULL);
+        k ^= 6;
+    }
+    else
+        k = ((const struct sockaddr_in *) addr)->sin_addr.s_addr & htonl(0xffffff00);
+
+    ///murmur3 finalizer
+    k ^= rl->seed ^ ((u64_t) kind << 56);
+    k ^= k >> 33;
+    k *= 0xff51afd7ed558ccdULL;
+    k ^= k >> 33;
+    k *= 0xc4ceb9fe1a85ec53ULL;
+    k ^= k >> 33;
+
+    return k;
+}
+
+/**
+ * Tokens of the bucket @old at @t ms into @tokens and the time they were
+ * earned by into @last, keeping the fraction of a token not earned yet.
+ */
+static inline
+void rrl_refill(struct rrl *rl, u64_t old, u64_t t, u64_t *tokens, u64_t *last)
+{
+    u64_t add;
+
+    if(old == 0) {
+        *tokens = rl->rate;
+        *last = t;
+        return;
+    }
+
+    *tokens = old & 0xffff;
+    *last = (old >> 16) & RRL_TIME_MASK;
+    add = ((t - *last) & RRL_TIME_MASK) * rl->rate / 1000;
+
+    if(*tokens + add >= rl->rate) {
+        *tokens = rl->rate;
+        *last = t;
+    }
+    else if(add) {
+        *tokens += add;
+        *last = (*last + add * 1000 / rl->rate) & RRL_TIME_MASK;
+    }
+}
+
+/**
+ * Take one token from the bucket of @hash at @now ms.
+ *
+ * @return RRL_PASS, or RRL_DROP/RRL_SLIP when the bucket is empty
+ */
+static inline
+int rrl_admit(struct rrl *rl, u64_t hash, u64_t now)
+{
+    static __thread u32_t over;
+    _Atomic u64_t *set = &rl->slot[hash & (RRL_SLOTS - RRL_WAYS)];
+    _Atomic u64_t *slot = NULL, *idle = NULL;
+    u64_t tag = RRL_TAG(hash);
+    u64_t t = now & RRL_TIME_MASK;
+    u64_t old, bucket, tokens, last;
+
+    for(int i = 0; i < RRL_WAYS; i++) {
+        old = atomic_load_explicit(&set[i], memory_order_relaxed);
+        if(old && RRL_TAG(old) == tag) {
+            slot = &set[i];
+            break;
+        }
+        if(!idle) {
+            rrl_refill(rl, old, t, &tokens, &last);
+            if(tokens == rl->rate)
+                idle = &set[i];
+        }
+    }
+    ///every way busy with another key: share the one of the hash
+    if(!slot)
+        slot = idle ? idle : &set[(hash >> 16) & (RRL_WAYS - 1)];
+
+    old = atomic_load_explicit(slot, memory_order_relaxed);
+    do {
+        u64_t owner = RRL_TAG(old);
+
+        rrl_refill(rl, old, t, &tokens, &last);
+        ///only an idle bucket changes hands
+        if(tokens == rl->rate)
+            owner = tag;
+
+        if(tokens == 0)
+            return (rl->slip && ++over % rl->slip == 0) ? RRL_SLIP : RRL_DROP;
+
+        bucket = owner << 40 | last << 16 | (tokens - 1);
+    } while(!atomic_compare_exchange_weak_explicit(slot, &old, bucket,
+                memory_order_relaxed, memory_order_relaxed));
+
+    return RRL_PASS;
+}
+
+static inline
+int rrl_kind(const uchar *buf)
+{
+    const DNS_HEADER_t *hdr = (const DNS_HEADER_t *) buf;
+    u16_t rcode = dns_flag(hdr, DNS_RCODE);
+
+    if(rcode == _NXDOMAIN)
+        return RRL_NXDOMAIN;
+    if(rcode != _NOERROR)
+        return RRL_ERROR;
+    return hdr->ancount ? RRL_ANSWER : RRL_NODATA;
+}
+
+/**
+ * Charge the reply of @len bytes in @buf, going to @addr, to its bucket.
+ *
+ * @return length of what is to be sent: @len, the length of the truncated
+ *         reply for a slip, 0 for a drop
+ */
+static inline
+ssize_t rrl_apply(struct rrl *rl, struct rrl_stats *st, const struct sockaddr *addr,
+                  uchar *buf, ssize_t len)
+{
+    struct dns_reply r;
+    RCODE_t rcode;
+
+    switch(rrl_admit(rl, rrl_hash(rl, addr, rrl_kind(buf)), rrl_now())) {
+        case RRL_PASS:
+            st->passed++;
+            return len;
+        case RRL_DROP:
+            st->dropped++;
+            return 0;
+    }
+
+    ///header and question only, TC set
+    st->slipped++;
+    rcode = (RCODE_t) dns_flag((DNS_HEADER_t *) buf, DNS_RCODE);
+    dns_reply_init(&r, buf, (size_t) len, (size_t) len);
+    dns_reply_rcode(&r, rcode);
+    dns_reply_truncate(&r);
+    return (ssize_t) r.len;
+}
+
+static inline
+void rrl_stats_show(struct rrl_stats *st)
+{
+    printf("rrl: %llu passed, %llu dropped, %llu slipped\n", st->passed, st->dropped, st->slipped);
+}
+
+#endif ///RRL_H
@@ -0,0 +1,552 @@
+#ifndef URING_H
+#define URING_H
+
+#include <linux/io_uring.h>
+#include <sys/syscall.h>
+#include <sys/mman.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include "debug.h"
+#include "pktpool.h"
+
+/**
+ * **io_uring backend**
+ *
+ * Drop-in implementation of `init_service`/`listen`/`respond` of struct DNS.
+ *
+ * Every worker thread owns one ring, created by its first listen():
+ *
+ *  - one multishot RECVMSG stays armed on the socket and picks its buffers
+ *    from a buffer ring registered with the kernel (IORING_REGISTER_PBUF_RING),
+ *    built from packet slots of the worker;
+ *  - respond() only queues a SENDMSG, the reply being copied into a packet
+ *    slot which is released when the send completes;
+ *  - when no received datagram is left, listen() submits every queued reply
+ *    and waits for new completions with a single io_uring_enter().
+ *
+ * So one syscall serves as many datagrams as arrived since the last one,
+ * instead of a recvfrom/sendto pair per datagram.
+ *
+ * A kernel which rejects multishot RECVMSG makes the thread fall back to
+ * socket_recvfrom()/socket_sendto() for good.
+ *
+ * uring_drain() cancels the receive when the sockets are handed over to a
+ * successor, the datagrams the ring already took are still answered.
+ */
+#define URING_ENTRIES   256
+#define URING_BUFS      256     ///power of 2, receive buffers in the buffer ring
+#define URING_SENDS     256     ///replies in flight
+#define URING_BGID        0
+
+///user_data of the multishot receive and of its cancellation; send
+///completions carry their slot
+#define URING_RECV_TAG    1
+#define URING_CANCEL_TAG  2
+
+struct uring_send {
+    struct msghdr               msg;
+    struct iovec                iov;
+    struct sockaddr_storage    addr;
+    uchar                   data[0];
+};
+
+struct uring {
+    int                          fd;
+    int                       sk_fd;
+    bool                   fallback;
+    bool                   draining;     ///no receive is armed again
+
+    ///submission queue
+    u32_t                   *sq_head;
+    u32_t                   *sq_tail;
+    u32_t                    sq_mask;
+    u32_t                  *sq_array;
+    struct io_uring_sqe        *sqes;
+    u32_t                   sqe_tail;     ///next sqe to fill, not yet published
+    u32_t                   sq_ready;     ///filled, not yet submitted
+
+    ///completion queue
+    u32_t                   *cq_head;
+    u32_t                   *cq_tail;
+    u32_t                    cq_mask;
+    struct io_uring_cqe        *cqes;
+
+    void                    *sq_ring;
+    size_t                   sq_size;
+    void                    *cq_ring;
+    size_t                   cq_size;
+    size_t                  sqes_size;
+
+    ///receive buffers, bid i is rbuf[i]
+    struct io_uring_buf_ring     *br;
+    uchar            *rbuf[URING_BUFS];
+    struct msghdr          recv_msg;
+    bool                      armed;
+
+    ///received datagrams not handed to listen() yet: bid and length
+    u16_t           ready_bid[URING_BUFS];
+    s32_t           ready_len[URING_BUFS];
+    u32_t                ready_head;
+    u32_t                ready_tail;
+
+    struct pktpool            *pool;
+
+    ///statistics
+    unsigned long long      packets;
+    unsigned long long       enters;
+};
+
+static pthread_key_t uring_key;
+static pthread_once_t uring_key_once = PTHREAD_ONCE_INIT;
+
+static inline
+int uring_setup(u32_t entries, struct io_uring_params *p)
+{
+    return (int) syscall(__NR_io_uring_setup, entries, p);
+}
+
+static inline
+int uring_enter(int fd, u32_t submit, u32_t complete, u32_t flags)
+{
+    return (int) syscall(__NR_io_uring_enter, fd, submit, complete, flags, NULL, 0);
+}
+
+static inline
+int uring_register(int fd, u32_t op, void *arg, u32_t nargs)
+{
+    return (int) syscall(__NR_io_uring_register, fd, op, arg, nargs);
+}
+
+/**
+ * Can this kernel run the backend: io_uring itself, buffer rings and the
+ * RECVMSG/SENDMSG opcodes? Multishot support is found out by the first
+ * receive.
+ */
+static inline
+bool uring_supported(void)
+{
+    struct io_uring_params p = {0};
+    struct io_uring_probe *probe;
+    bool ok = false;
+    int fd;
+
+    if((fd = uring_setup(4, &p)) < 0)
+        return false;
+
+    probe = (struct io_uring_probe *) calloc(1, sizeof(*probe) + 256 * sizeof(struct io_uring_probe_op));
+    if(probe && uring_register(fd, IORING_REGISTER_PROBE, probe, 256) == 0
+            && probe->last_op >= IORING_OP_RECVMSG
+            && (probe->ops[IORING_OP_RECVMSG].flags & IO_URING_OP_SUPPORTED)
+            && (probe->ops[IORING_OP_SENDMSG].flags & IO_URING_OP_SUPPORTED))
+    {
+        size_t size = 4096;
+        void *ring = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        struct io_uring_buf_reg reg = {
+            .ring_addr = (u64_t) (uintptr_t) ring,
+            .ring_entries = 1,
+            .bgid = URING_BGID,
+        };
+
+        ok = ring != MAP_FAILED && uring_register(fd, IORING_REGISTER_PBUF_RING, &reg, 1) == 0;
+        if(ring != MAP_FAILED)
+            munmap(ring, size);
+    }
+
+    free(probe);
+    close(fd);
+    return ok;
+}
+
+static inline
+void uring_release(void *arg)
+{
+    struct uring *u = (struct uring *) arg;
+
+    if(u->packets)
+        printf("io_uring: %llu packets / %llu io_uring_enter = %.2f packets/syscall\n",
+                u->packets, u->enters, u->enters ? (double) u->packets / u->enters : 0.0);
+
+    close(u->fd);
+    if(u->cq_ring != u->sq_ring)
+        munmap(u->cq_ring, u->cq_size);
+    munmap(u->sq_ring, u->sq_size);
+    munmap(u->sqes, u->sqes_size);
+    munmap(u->br, URING_BUFS * sizeof(struct io_uring_buf));
+    pktpool_free(u->pool);
+    free(u);
+}
+
+static inline
+void uring_key_init(void)
+{
+    pthread_key_create(&uring_key, uring_release);
+}
+
+/**
+ * Give receive buffer @bid back to the kernel.
+ */
+static inline
+void uring_buf_recycle(struct uring *u, u16_t bid)
+{
+    u16_t tail = u->br->tail;
+    struct io_uring_buf *buf = &u->br->bufs[tail & (URING_BUFS - 1)];
+
+    buf->addr = (u64_t) (uintptr_t) u->rbuf[bid];
+    buf->len = (u32_t) u->pool->slot_size;
+    buf->bid = bid;
+    __atomic_store_n(&u->br->tail, (u16_t) (tail + 1), __ATOMIC_RELEASE);
+}
+
+/**
+ * Publish the filled sqes, submit them and wait for @wait completions.
+ */
+static inline
+int uring_submit(struct uring *u, u32_t wait)
+{
+    int n;
+
+    __atomic_store_n(u->sq_tail, u->sqe_tail, __ATOMIC_RELEASE);
+
+    n = uring_enter(u->fd, u->sq_ready, wait, wait ? IORING_ENTER_GETEVENTS : 0);
+    u->enters++;
+    if(n < 0)
+        return -1;
+
+    u->sq_ready -= (u32_t) n;
+    return 0;
+}
+
+static inline
+struct io_uring_sqe *uring_get_sqe(struct uring *u)
+{
+    struct io_uring_sqe *sqe;
+
+    ///ring full: let the kernel consume what is there
+    while(u->sqe_tail - __atomic_load_n(u->sq_head, __ATOMIC_ACQUIRE) > u->sq_mask)
+        if(uring_submit(u, 0) < 0 && errno != EINTR && errno != EAGAIN)
+            return NULL;
+
+    sqe = &u->sqes[u->sqe_tail & u->sq_mask];
+    memset(sqe, 0, sizeof(*sqe));
+    u->sq_array[u->sqe_tail & u->sq_mask] = u->sqe_tail & u->sq_mask;
+    u->sqe_tail++;
+    u->sq_ready++;
+
+    return sqe;
+}
+
+static inline
+void uring_arm_recv(struct uring *u)
+{
+    struct io_uring_sqe *sqe = uring_get_sqe(u);
+
+    syserr(!sqe, "uring_arm_recv: io_uring_enter()\n");
+
+    sqe->opcode = IORING_OP_RECVMSG;
+    sqe->fd = u->sk_fd;
+    sqe->addr = (u64_t) (uintptr_t) &u->recv_msg;
+    sqe->len = 1;
+    sqe->ioprio = IORING_RECV_MULTISHOT;
+    sqe->flags = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = URING_BGID;
+    sqe->user_data = URING_RECV_TAG;
+    u->armed = true;
+}
+
+static inline
+struct uring *uring_new(int sk_fd)
+{
+    struct io_uring_params p = {0};
+    struct uring *u = (struct uring *) calloc(1, sizeof(*u));
+    syserr(!u, "uring_new: calloc()\n");
+
+    u->sk_fd = sk_fd;
+    p.flags = IORING_SETUP_CQSIZE;
+    p.cq_entries = 4 * URING_ENTRIES;
+
+    u->fd = uring_setup(URING_ENTRIES, &p);
+    syserr(u->fd < 0, "uring_new: io_uring_setup()\n");
+
+    u->sq_size = p.sq_off.array + p.sq_entries * sizeof(u32_t);
+    u->cq_size = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    if(p.features & IORING_FEAT_SINGLE_MMAP)
+        u->sq_size = u->cq_size = MAX(u->sq_size, u->cq_size);
+
+    u->sq_ring = mmap(NULL, u->sq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                      u->fd, IORING_OFF_SQ_RING);
+    syserr(u->sq_ring == MAP_FAILED, "uring_new: mmap(sq)\n");
+
+    if(p.features & IORING_FEAT_SINGLE_MMAP)
+        u->cq_ring = u->sq_ring;
+    else {
+        u->cq_ring = mmap(NULL, u->cq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                          u->fd, IORING_OFF_CQ_RING);
+        syserr(u->cq_ring == MAP_FAILED, "uring_new: mmap(cq)\n");
+    }
+
+    u->sqes_size = p.sq_entries * sizeof(struct io_uring_sqe);
+    u->sqes = (struct io_uring_sqe *) mmap(NULL, u->sqes_size, PROT_READ | PROT_WRITE,
+                                           MAP_SHARED | MAP_POPULATE, u->fd, IORING_OFF_SQES);
+    syserr(u->sqes == MAP_FAILED, "uring_new: mmap(sqes)\n");
+
+    u->sq_head  = (u32_t *) ((char *) u->sq_ring + p.sq_off.head);
+    u->sq_tail  = (u32_t *) ((char *) u->sq_ring + p.sq_off.tail);
+    u->sq_mask  = *(u32_t *) ((char *) u->sq_ring + p.sq_off.ring_mask);
+    u->sq_array = (u32_t *) ((char *) u->sq_ring + p.sq_off.array);
+    u->sqe_tail = *u->sq_tail;
+
+    u->cq_head  = (u32_t *) ((char *) u->cq_ring + p.cq_off.head);
+    u->cq_tail  = (u32_t *) ((char *) u->cq_ring + p.cq_off.tail);
+    u->cq_mask  = *(u32_t *) ((char *) u->cq_ring + p.cq_off.ring_mask);
+    u->cqes     = (struct io_uring_cqe *) ((char *) u->cq_ring + p.cq_off.cqes);
+
+    ///receive buffers registered as a buffer ring, reply slots behind them
+    u->pool = pktpool_new(URING_BUFS + URING_SENDS, PKT_LIMIT);
+
+    u->br = (struct io_uring_buf_ring *) mmap(NULL, URING_BUFS * sizeof(struct io_uring_buf),
+                                              PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    syserr(u->br == MAP_FAILED, "uring_new: mmap(buffer ring)\n");
+
+    struct io_uring_buf_reg reg = {
+        .ring_addr = (u64_t) (uintptr_t) u->br,
+        .ring_entries = URING_BUFS,
+        .bgid = URING_BGID,
+    };
+    syserr(uring_register(u->fd, IORING_REGISTER_PBUF_RING, &reg, 1) < 0,
+            "uring_new: io_uring_register(PBUF_RING)\n");
+
+    for(u16_t i = 0; i < URING_BUFS; i++)
+    {
+        u->rbuf[i] = pkt_get(u->pool);
+        uring_buf_recycle(u, i);
+    }
+
+    ///layout of every receive buffer: io_uring_recvmsg_out, peer name, payload
+    u->recv_msg.msg_namelen = sizeof(struct sockaddr_storage);
+
+    uring_arm_recv(u);
+    dlog("io_uring: ring %d on socket %d\n", u->fd, sk_fd);
+
+    return u;
+}
+
+/**
+ * The ring of the calling thread, made on first use.
+ */
+static inline
+struct uring *uring_self(int sk_fd)
+{
+    struct uring *u;
+
+    pthread_once(&uring_key_once, uring_key_init);
+    if(!(u = (struct uring *) pthread_getspecific(uring_key))) {
+        u = uring_new(sk_fd);
+        pthread_setspecific(uring_key, u);
+    }
+
+    return u;
+}
+
+/**
+ * A multishot receive buffer holds io_uring_recvmsg_out, the peer name,
+ * control data and the payload; make sure all of it is there.
+ */
+static inline
+struct io_uring_recvmsg_out *uring_recvmsg_out(uchar *buf, s32_t len, struct msghdr *msg)
+{
+    struct io_uring_recvmsg_out *out = (struct io_uring_recvmsg_out *) buf;
+    size_t hdr = sizeof(*out) + msg->msg_namelen + msg->msg_controllen;
+
+    if(len < 0 || (size_t) len < hdr || out->payloadlen > (size_t) len - hdr)
+        return NULL;
+
+    return out;
+}
+
+/**
+ * Move every completion off the completion queue: received datagrams go to
+ * the ready queue, finished sends give their slot back.
+ */
+static inline
+void uring_reap(struct uring *u)
+{
+    u32_t head = *u->cq_head;
+    u32_t tail = __atomic_load_n(u->cq_tail, __ATOMIC_ACQUIRE);
+
+    for(; head != tail; head++)
+    {
+        struct io_uring_cqe *cqe = &u->cqes[head & u->cq_mask];
+
+        if(cqe->user_data == URING_CANCEL_TAG)
+            continue;
+        if(cqe->user_data != URING_RECV_TAG) {
+            pkt_put(u->pool, (uchar *) (uintptr_t) cqe->user_data);
+            continue;
+        }
+
+        if(!(cqe->flags & IORING_CQE_F_MORE))
+            u->armed = false;
+
+        if(cqe->res == -EINVAL || cqe->res == -EOPNOTSUPP) {
+            dlog("io_uring: multishot recvmsg unsupported, using recvfrom/sendto\n");
+            u->fallback = true;
+            continue;
+        }
+
+        if(cqe->res >= 0 && (cqe->flags & IORING_CQE_F_BUFFER)) {
+            u->ready_bid[u->ready_tail & (URING_BUFS - 1)] = (u16_t) (cqe->flags >> IORING_CQE_BUFFER_SHIFT);
+            u->ready_len[u->ready_tail & (URING_BUFS - 1)] = cqe->res;
+            u->ready_tail++;
+        }
+    }
+
+    __atomic_store_n(u->cq_head, head, __ATOMIC_RELEASE);
+
+    ///multishot stops when the buffer ring ran dry: arm it again
+    if(!u->armed && !u->fallback && !u->draining)
+        uring_arm_recv(u);
+}
+
+/**
+ * Same as `init_service` of the socket backend; the ring is attached to the
+ * socket by the first listen() of the worker.
+ */
+static inline
+int uring_config(int domain, int type, int protocol, struct sockaddr *addr, socklen_t len)
+{
+    return socket_config_reuseport(domain, type, protocol, addr, len);
+}
+
+/**
+ * Submit the queued replies and wait until every one of them is sent.
+ */
+static inline
+void uring_flush(struct uring *u)
+{
+    while(u->pool->nfree < u->pool->nslots - URING_BUFS)
+    {
+        if(uring_submit(u, 1) < 0)
+            syserr(errno != EINTR && errno != EAGAIN && errno != EBUSY,
+                    "uring_flush: io_uring_enter()\n");
+        uring_reap(u);
+    }
+}
+
+static inline
+ssize_t uring_recvfrom(int sk_fd, uchar buf[], struct sockaddr *addr, socklen_t *len)
+{
+    struct uring *u = uring_self(sk_fd);
+    struct io_uring_recvmsg_out *out;
+    ssize_t nBytes;
+    u16_t bid;
+
+    while(u->ready_head == u->ready_tail)
+    {
+        if(u->fallback)
+            return socket_recvfrom(sk_fd, buf, addr, len);
+        if(u->draining) {
+            uring_flush(u);
+            errno = EAGAIN;
+            return -1;
+        }
+
+        if(uring_submit(u, 1) < 0) {
+            if(errno == EINTR)
+                return -1;
+            syserr(errno != EAGAIN && errno != EBUSY, "uring_recvfrom: io_uring_enter()\n");
+        }
+        uring_reap(u);
+    }
+
+    bid = u->ready_bid[u->ready_head & (URING_BUFS - 1)];
+    out = uring_recvmsg_out(u->rbuf[bid], u->ready_len[u->ready_head & (URING_BUFS - 1)], &u->recv_msg);
+    u->ready_head++;
+
+    nBytes = -1;
+    errno = EMSGSIZE;
+    if(out && !(out->flags & MSG_TRUNC)) {
+        nBytes = (ssize_t) out->payloadlen;
+        memcpy(buf, (uchar *) (out + 1) + u->recv_msg.msg_namelen + u->recv_msg.msg_controllen, nBytes);
+        *len = MIN(*len, (socklen_t) out->namelen);
+        memcpy(addr, out + 1, *len);
+        u->packets++;
+    }
+
+    uring_buf_recycle(u, bid);
+    return nBytes;
+}
+
+/**
+ * Queue the reply; it is submitted by the next listen() together with the
+ * other replies of the round.
+ */
+static inline
+void uring_sendto(int sk_fd, uchar buf[], ssize_t buf_len, struct sockaddr *addr, socklen_t len)
+{
+    struct uring *u = uring_self(sk_fd);
+    struct io_uring_sqe *sqe;
+    struct uring_send *s;
+
+    if(u->fallback
+        || buf_len > (ssize_t) (u->pool->slot_size - sizeof(*s))
+        || !(s = (struct uring_send *) pkt_get(u->pool)))
+    {
+        socket_sendto(sk_fd, buf, buf_len, addr, len);
+        return;
+    }
+
+    if(!(sqe = uring_get_sqe(u))) {
+        pkt_put(u->pool, (uchar *) s);
+        socket_sendto(sk_fd, buf, buf_len, addr, len);
+        return;
+    }
+
+    memcpy(s->data, buf, buf_len);
+    memcpy(&s->addr, addr, len);
+    s->iov.iov_base = s->data;
+    s->iov.iov_len = (size_t) buf_len;
+    memset(&s->msg, 0, sizeof(s->msg));
+    s->msg.msg_name = &s->addr;
+    s->msg.msg_namelen = len;
+    s->msg.msg_iov = &s->iov;
+    s->msg.msg_iovlen = 1;
+
+    sqe->opcode = IORING_OP_SENDMSG;
+    sqe->fd = sk_fd;
+    sqe->addr = (u64_t) (uintptr_t) &s->msg;
+    sqe->len = 1;
+    sqe->user_data = (u64_t) (uintptr_t) s;
+}
+
+/**
+ * Leave the socket to a successor: cancel the multishot receive of the
+ * thread. listen() keeps handing out the datagrams received so far, then
+ * sends every queued reply and fails with EAGAIN.
+ */
+static inline
+void uring_drain(int sk_fd)
+{
+    struct io_uring_sqe *sqe;
+    struct uring *u;
+
+    pthread_once(&uring_key_once, uring_key_init);
+    if(!(u = (struct uring *) pthread_getspecific(uring_key)) || u->fallback)
+        return;
+
+    u->draining = true;
+    if(u->armed && (sqe = uring_get_sqe(u))) {
+        sqe->opcode = IORING_OP_ASYNC_CANCEL;
+        sqe->addr = URING_RECV_TAG;
+        sqe->user_data = URING_CANCEL_TAG;
+    }
+
+    while(u->armed)
+    {
+        if(uring_submit(u, 1) < 0)
+            syserr(errno != EINTR && errno != EAGAIN && errno != EBUSY,
+                    "uring_drain: io_uring_enter()\n");
+        uring_reap(u);
+    }
+}
+
+#endif ///URING_H
@@ -0,0 +1,229 @@
+#ifndef WORKER_H
+#define WORKER_H
+
+#include <pthread.h>
+#include <sched.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <linux/mempolicy.h>
+#include "debug.h"
+
+/**
+ * **Worker**
+ *
+ * Every worker is a thread owning its own SO_REUSEPORT sockets bound to the
+ * service addresses together with its own buffers, so nothing on the query
+ * path is shared between workers.
+ *
+ * Workers keep SIGINT/SIGTERM blocked; the main thread waits for them and
+ * interrupts the blocking receive of each worker with WORKER_SIGNAL.
+ *
+ * A placed worker runs on one CPU only, its sockets ask the kernel for the
+ * packets processed on that CPU (SO_INCOMING_CPU) and the memory it
+ * allocates comes from the NUMA node of the CPU; every buffer, pool and
+ * cache of a worker is allocated by its own thread for that reason.
+ */
+#define WORKER_SIGNAL SIGUSR1
+
+struct DNS;
+struct rrl;
+
+///how a worker waits for queries
+enum {
+    WORKER_BLOCK,       ///blocking receive on its single UDP socket
+    WORKER_EPOLL,       ///reactor over all of its UDP and TCP sockets
+    WORKER_URING,       ///blocking loop over the io_uring backend
+};
+
+struct dns_worker {
+    int                     id;
+    pthread_t              tid;
+    struct DNS            *dns;
+    int                   mode;
+    unsigned int         batch;
+    unsigned int          idle;     ///TCP idle timeout, seconds
+    int                    cpu;     ///-1: not pinned
+    int                   node;     ///NUMA node of cpu, -1: unknown
+    struct rrl            *rrl;     ///shared by every worker, NULL: no limit
+
+    ///sockets of the worker, sk_type[i] is SOCK_DGRAM or SOCK_STREAM
+    int  sk_fd[2 * LISTEN_LIMIT];
+    int sk_type[2 * LISTEN_LIMIT];
+    unsigned int           nsk;
+};
+
+static inline
+unsigned int worker_count_online(void)
+{
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+
+    return n > 0 ? (unsigned int) n : 1;
+}
+
+/**
+ * Parse a CPU list like `0,2,8-11`, or `auto` for every CPU the process may
+ * run on.
+ *
+ * @return number of CPUs stored in @cpus, -1 on a malformed list or a CPU
+ *         the process may not run on
+ */
+static inline
+int worker_parse_cpus(const char *spec, int *cpus, unsigned int max)
+{
+    unsigned int n = 0;
+    cpu_set_t set;
+
+    syserr(sched_getaffinity(0, sizeof(set), &set) < 0, "sched_getaffinity()\n");
+
+    if(!strcmp(spec, "auto")) {
+        for(int cpu = 0; cpu < CPU_SETSIZE && n < max; cpu++)
+            if(CPU_ISSET(cpu, &set))
+                cpus[n++] = cpu;
+        return (int) n;
+    }
+
+    while(*spec)
+    {
+        char *end;
+        long lo, hi;
+
+        lo = hi = strtol(spec, &end, 10);
+        if(end == spec || lo < 0)
+            return -1;
+        if(*end == '-') {
+            spec = end + 1;
+            hi = strtol(spec, &end, 10);
+            if(end == spec || hi < lo)
+                return -1;
+        }
+        if(hi >= CPU_SETSIZE || n + (hi - lo + 1) > max)
+            return -1;
+
+        for(long cpu = lo; cpu <= hi; cpu++)
+        {
+            if(!CPU_ISSET(cpu, &set))
+                return -1;
+            cpus[n++] = (int) cpu;
+        }
+
+        if(*end == ',')
+            end++;
+        else if(*end)
+            return -1;
+        spec = end;
+    }
+
+    return n ? (int) n : -1;
+}
+
+///NUMA node of @cpu as sysfs links it, -1 without NUMA
+static inline
+int worker_cpu_node(int cpu)
+{
+    char path[64];
+    struct dirent *e;
+    DIR *dir;
+    int node = -1;
+
+    snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d", cpu);
+    if(!(dir = opendir(path)))
+        return -1;
+
+    while((e = readdir(dir)))
+        if(sscanf(e->d_name, "node%d", &node) == 1)
+            break;
+    closedir(dir);
+
+    return e ? node : -1;
+}
+
+/**
+ * Put the worker on @cpu: its sockets prefer the packets of that CPU, its
+ * thread is pinned by worker_start().
+ */
+static inline
+void worker_place(struct dns_worker *w, int cpu)
+{
+    w->cpu = cpu;
+    w->node = worker_cpu_node(cpu);
+
+    for(unsigned int i = 0; i < w->nsk; i++)
+        if(setsockopt(w->sk_fd[i], SOL_SOCKET, SO_INCOMING_CPU, &cpu, sizeof(cpu)) < 0)
+            dlog("worker %d: SO_INCOMING_CPU: %s\n", w->id, strerror(errno));
+}
+
+/**
+ * Called by the worker thread first: later page faults of the thread are
+ * served from the node of its CPU.
+ */
+static inline
+void worker_bind_memory(struct dns_worker *w)
+{
+    unsigned long mask[1024 / (8 * sizeof(unsigned long))] = {0};
+
+    if(w->node < 0 || w->node >= (int) (8 * sizeof(mask)))
+        return;
+
+    mask[w->node / (8 * sizeof(long))] |= 1UL << (w->node % (8 * sizeof(long)));
+    if(syscall(SYS_set_mempolicy, MPOL_PREFERRED, mask, 8 * sizeof(mask)) < 0)
+        dlog("worker %d: set_mempolicy: %s\n", w->id, strerror(errno));
+}
+
+static inline
+void worker_start(struct dns_worker *w, void *(*fn)(void *))
+{
+    pthread_attr_t attr;
+    int err;
+
+    pthread_attr_init(&attr);
+    if(w->cpu >= 0) {
+        cpu_set_t set;
+
+        CPU_ZERO(&set);
+        CPU_SET(w->cpu, &set);
+        pthread_attr_setaffinity_np(&attr, sizeof(set), &set);
+    }
+
+    err = pthread_create(&w->tid, &attr, fn, w);
+    pthread_attr_destroy(&attr);
+
+    errno = err;
+    syserr(err != 0, "worker_start: pthread_create()\n");
+    dlog("worker %d started\n", w->id);
+}
+
+/**
+ * Wake every worker until it notices the stop or drain flag and leaves,
+ * then join it.
+ * The signal is repeated because a worker may be just about to block when
+ * the first one arrives.
+ */
+static inline
+void worker_stop_all(struct dns_worker *w, unsigned int n)
+{
+    for(unsigned int i = 0; i < n; i++)
+    {
+        struct timespec ts;
+
+        do {
+            pthread_kill(w[i].tid, WORKER_SIGNAL);
+            clock_gettime(CLOCK_REALTIME, &ts);
+            ts.tv_nsec += 100 * 1000 * 1000;
+            if(ts.tv_nsec >= 1000 * 1000 * 1000) {
+                ts.tv_sec++;
+                ts.tv_nsec -= 1000 * 1000 * 1000;
+            }
+        } while(pthread_timedjoin_np(w[i].tid, NULL, &ts) == ETIMEDOUT);
+
+        dlog("worker %d stopped\n", w[i].id);
+    }
+}
+
+#endif ///WORKER_H
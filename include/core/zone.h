@@ -0,0 +1,453 @@
+#ifndef ZONE_H
+#define ZONE_H
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <arpa/inet.h>
+#include "type.h"
+#include "limit.h"
+#include "debug.h"
+#include "protocol/message.h"
+#include "protocol/reply.h"
+#include "protocol/msg_view.h"
+#include "protocol/rdata.h"
+#include "protocol/name.h"
+#include "core/intern.h"
+
+/**
+ * **Zone database**
+ *
+ * Records are kept per owner node and per RRset, every RRset already in
+ * its final wire form: for each record TYPE, CLASS, TTL, RDLENGTH and the
+ * RDATA, all in network order, the owner left out. Names inside the RDATA
+ * of the RFC 1035 types are stored uncompressed and listed as fixups, so
+ * they are compressed against the reply they end up in.
+ *
+ * Answering is then a memcpy per record behind its owner, which for the
+ * answer section is a pointer to the question; only fixups are encoded at
+ * answer time, and RDLENGTH is patched behind them.
+ *
+ * The database is filled single threaded, then read by every worker. Each
+ * change bumps @version, which starts from a generation of its own for
+ * every database, so no two databases of a process share a version.
+ */
+#define ZONE_NODE_MIN   1024
+#define ZONE_CNAME_LIMIT   8   ///CNAMEs followed in one answer
+
+///the fixed part of a record behind its owner
+#define ZONE_RR_FIXED   ((size_t) sizeof(RR_t))
+
+struct zone_fixup {
+    u32_t                         at;   ///offset of the name in the wire form
+    const struct dns_name      *name;
+};
+
+struct zone_rrset {
+    struct zone_rrset          *next;
+    u16_t                       type;
+    u16_t                      class;
+    u16_t                      count;
+    u16_t                     nfixup;
+    u32_t                       size;
+    uchar                      *wire;   ///@count records, owners left out
+    struct zone_fixup         *fixup;   ///in order of @at
+};
+
+///every ancestor of an owner has a node, empty or not
+struct zone_node {
+    const struct dns_name      *name;
+    struct zone_rrset        *rrsets;
+    bool                        apex;   ///owns an SOA
+};
+
+struct zone_db {
+    struct dns_intern         *names;
+    struct zone_node         **slot;    ///open addressing on the name hash
+    size_t                     nslot;
+    size_t                     count;
+    size_t                   nrrsets;
+    size_t                     bytes;   ///of wire forms
+    u64_t                    version;
+};
+
+static inline
+struct zone_db *zone_db_new(void)
+{
+    static u64_t generation = 0;
+    struct zone_db *db = calloc(1, sizeof(*db));
+
+    syserr(!db, "zone_db_new: calloc\n");
+    ///2^32 changes per database before two could meet
+    db->version = __atomic_add_fetch(&generation, 1, __ATOMIC_RELAXED) << 32;
+    db->names = dns_intern_new(ZONE_NODE_MIN);
+    db->nslot = ZONE_NODE_MIN * 2;
+    syserr(!(db->slot = calloc(db->nslot, sizeof(db->slot[0]))), "zone_db_new: calloc\n");
+
+    return db;
+}
+
+static inline
+void zone_db_free(struct zone_db *db)
+{
+    if(!db)
+        return;
+    for(size_t i = 0; i < db->nslot; i++)
+    {
+        struct zone_node *node = db->slot[i];
+
+        if(!node)
+            continue;
+        for(struct zone_rrset *set = node->rrsets, *next; set; set = next)
+        {
+            next = set->next;
+            free(set->wire);
+            free(set->fixup);
+            free(set);
+        }
+        free(node);
+    }
+    dns_intern_free(db->names);
+    free(db->slot);
+    free(db);
+}
+
+static inline
+size_t zone_node_slot(const struct zone_db *db, const struct dns_name *name)
+{
+    size_t s = name->hash & (db->nslot - 1);
+
+    while(db->slot[s] && db->slot[s]->name != name)
+        s = (s + 1) & (db->nslot - 1);
+
+    return s;
+}
+
+///node of the interned @name, NULL if neither it nor a name below owns data
+static inline
+struct zone_node *zone_node_find(const struct zone_db *db, const struct dns_name *name)
+{
+    return db->slot[zone_node_slot(db, name)];
+}
+
+static inline
+void zone_node_grow(struct zone_db *db)
+{
+    struct zone_node **old = db->slot;
+    size_t nold = db->nslot;
+
+    db->nslot *= 2;
+    syserr(!(db->slot = calloc(db->nslot, sizeof(db->slot[0]))), "zone_node_grow: calloc\n");
+    for(size_t i = 0; i < nold; i++)
+        if(old[i])
+            db->slot[zone_node_slot(db, old[i]->name)] = old[i];
+    free(old);
+}
+
+static inline
+struct zone_node *zone_node_get(struct zone_db *db, const struct dns_name *name)
+{
+    size_t s = zone_node_slot(db, name);
+
+    if(!db->slot[s]) {
+        syserr(!(db->slot[s] = calloc(1, sizeof(struct zone_node))), "zone_node_get: calloc\n");
+        db->slot[s]->name = name;
+        if(++db->count * 2 > db->nslot) {
+            struct zone_node *node = db->slot[s];
+
+            zone_node_grow(db);
+            return node;
+        }
+    }
+
+    return db->slot[s];
+}
+
+static inline
+struct zone_rrset *zone_rrset_find(const struct zone_node *node, u16_t type)
+{
+    struct zone_rrset *set = node ? node->rrsets : NULL;
+
+    while(set && set->type != type)
+        set = set->next;
+
+    return set;
+}
+
+/**
+ * Add the record of @rdlen bytes of @rdata owned by the uncompressed wire
+ * name @owner. Names inside @rdata are uncompressed as well; they are
+ * interned, and written in lower case.
+ *
+ * @return 0, -1 if @owner or @rdata is malformed
+ */
+static inline
+int zone_add(struct zone_db *db, const uchar *owner, u16_t type, u16_t class, u32_t ttl,
+             const uchar *rdata, u16_t rdlen)
+{
+    const struct dns_name *name = dns_intern(db->names, owner), *target[RDATA_NAMES];
+    struct zone_node *node;
+    struct zone_rrset *set;
+    u16_t at[RDATA_NAMES];
+    int n = dns_rdata(type)->names(rdata, rdlen, at);
+    RR_t rr;
+    uchar *p;
+
+    if(!name || n < 0)
+        return -1;
+    for(int i = 0; i < n; i++)
+        if(!(target[i] = dns_intern(db->names, rdata + at[i])))
+            return -1;
+
+    node = zone_node_get(db, name);
+    for(const struct dns_name *up = name->parent; up && !zone_node_find(db, up); up = up->parent)
+        zone_node_get(db, up);
+    if(!(set = zone_rrset_find(node, type))) {
+        syserr(!(set = calloc(1, sizeof(*set))), "zone_add: calloc\n");
+        set->type = type;
+        set->class = class;
+        set->next = node->rrsets;
+        node->rrsets = set;
+        db->nrrsets++;
+    }
+    node->apex |= type == _SOA;
+
+    syserr(!(p = realloc(set->wire, set->size + ZONE_RR_FIXED + rdlen)), "zone_add: realloc\n");
+    set->wire = p;
+    if(n) {
+        struct zone_fixup *f = realloc(set->fixup, (set->nfixup + n) * sizeof(*f));
+
+        syserr(!f, "zone_add: realloc\n");
+        set->fixup = f;
+        for(int i = 0; i < n; i++)
+        {
+            f[set->nfixup].at = set->size + ZONE_RR_FIXED + at[i];
+            f[set->nfixup++].name = target[i];
+        }
+    }
+
+    rr.type = htons(type);
+    rr.class = htons(class);
+    rr.ttl = htonl(ttl);
+    rr.rdlength = htons(rdlen);
+    p += set->size;
+    memcpy(p, &rr, ZONE_RR_FIXED);
+    memcpy(p + ZONE_RR_FIXED, rdata, rdlen);
+    for(int i = 0; i < n; i++)
+        memcpy(p + ZONE_RR_FIXED + at[i], dns_name_wire(target[i]), target[i]->len);
+
+    set->size += ZONE_RR_FIXED + rdlen;
+    set->count++;
+    db->bytes += ZONE_RR_FIXED + rdlen;
+    db->version++;
+
+    return 0;
+}
+
+/**
+ * Append the records of @set owned by @owner to @section of @r; a NULL
+ * @owner is the question name. A record which does not fit ends the RRset
+ * and sets TC, unless @optional, as for glue in the additional section.
+ *
+ * @return 0, -1 if the RRset did not fit whole
+ */
+static inline
+int zone_put_rrset(struct dns_reply *r, int section, const struct zone_rrset *set,
+                   const struct dns_name *owner, bool optional)
+{
+    static const uchar question[2] = { 0xC0, sizeof(DNS_HEADER_t) };
+    struct dns_comp *comp = dns_reply_comp(r);
+    const struct zone_fixup *f = set->fixup, *fend = set->fixup + set->nfixup;
+    size_t at = 0;
+
+    for(unsigned int i = 0; i < set->count; i++)
+    {
+        size_t rdlen = (set->wire[at + 8] << 8) | set->wire[at + 9];
+        size_t end = at + ZONE_RR_FIXED + rdlen, p = at;
+        size_t start = r->len, rdata;
+        unsigned int mark = dns_comp_mark(comp);
+        ssize_t n;
+
+        if(!owner) {
+            if(r->len + sizeof(question) > r->cap)
+                goto full;
+            memcpy(r->buf + r->len, question, sizeof(question));
+            r->len += sizeof(question);
+        }
+        else if((n = dns_comp_put(comp, r->buf, r->len, r->cap, dns_name_wire(owner))) < 0)
+            goto full;
+        else
+            r->len += n;
+        rdata = r->len + ZONE_RR_FIXED;
+
+        ///the wire form up to each name, the name, the rest
+        for(; f < fend && f->at < end; f++)
+        {
+            if(r->len + (f->at - p) > r->cap)
+                goto full;
+            memcpy(r->buf + r->len, set->wire + p, f->at - p);
+            r->len += f->at - p;
+            if((n = dns_comp_put(comp, r->buf, r->len, r->cap, dns_name_wire(f->name))) < 0)
+                goto full;
+            r->len += n;
+            p = f->at + f->name->len;
+        }
+        if(r->len + (end - p) > r->cap)
+            goto full;
+        memcpy(r->buf + r->len, set->wire + p, end - p);
+        r->len += end - p;
+
+        if(r->len - rdata != rdlen) {
+            r->buf[rdata - 2] = (uchar) ((r->len - rdata) >> 8);
+            r->buf[rdata - 1] = (uchar) (r->len - rdata);
+        }
+        dns_reply_count(r, section);
+        at = end;
+        continue;
+
+full:
+        r->len = start;
+        dns_comp_rollback(comp, mark);
+        if(!optional)
+            dns_reply_truncate(r);
+        return -1;
+    }
+
+    return 0;
+}
+
+///addresses of the names in the RDATA of @set, for the additional section
+static inline
+void zone_put_glue(const struct zone_db *db, struct dns_reply *r, const struct zone_rrset *set)
+{
+    for(unsigned int i = 0; i < set->nfixup; i++)
+    {
+        struct zone_rrset *a = zone_rrset_find(zone_node_find(db, set->fixup[i].name), _A);
+
+        if(a && zone_put_rrset(r, DNS_ADDITIONAL, a, set->fixup[i].name, true) < 0)
+            return;
+    }
+}
+
+/**
+ * The apex of the zone of @name in @db, NULL if it is in none; *@cut is the
+ * topmost delegation in between, NULL if there is none.
+ */
+static inline
+struct zone_node *zone_apex(const struct zone_db *db, const struct dns_name *name,
+                            struct zone_node **cut)
+{
+    struct zone_node *node;
+
+    *cut = NULL;
+    for(; name; name = name->parent)
+    {
+        node = zone_node_find(db, name);
+        if(node && node->apex)
+            return node;
+        if(zone_rrset_find(node, _NS))
+            *cut = node;
+    }
+
+    return NULL;
+}
+
+/**
+ * Answer the single question of @v, authoritatively from @db, into @r.
+ *
+ * Names outside every zone are REFUSED. Below a zone cut the reply is a
+ * referral: the NS RRset of the cut and its glue. Otherwise the RRset asked
+ * for (every RRset for QTYPE *), CNAMEs followed within @db, or, when the
+ * last name of the chain has no such data or does not exist, the SOA of its
+ * zone in the authority section with NOERROR or NXDOMAIN (RFC 2308, 6604).
+ */
+static inline
+void zone_answer(struct zone_db *db, struct dns_reply *r, const struct dns_view *v)
+{
+    uchar key[NAME_LIMIT];
+    ssize_t klen;
+    const struct dns_name *name, *qname;
+    struct zone_node *node, *apex, *cut;
+    struct zone_rrset *set;
+    u16_t qtype, qclass;
+    int hops;
+
+    if(dns_view_count(v, DNS_QUESTION) != 1 ||
+       (klen = dns_name_decode(v->buf, v->len, dns_view_rr(v, DNS_QUESTION, 0)->name,
+                               key, sizeof(key), NAME_KEY, NULL)) < 0) {
+        dns_reply_rcode(r, _FORMERR);
+        return;
+    }
+    qtype = dns_view_type(v, DNS_QUESTION, 0);
+    qclass = dns_view_class(v, DNS_QUESTION, 0);
+
+    ///the closest name which exists, its zone, the topmost cut in between
+    for(qname = dns_intern_closest(db->names, key); qname && !zone_node_find(db, qname); )
+        qname = qname->parent;
+    apex = zone_apex(db, qname, &cut);
+    if(!apex || (qclass != _IN && qclass != _wildcard)) {
+        dns_reply_rcode(r, _REFUSED);
+        return;
+    }
+
+    if(cut) {
+        set = zone_rrset_find(cut, _NS);
+        if(zone_put_rrset(r, DNS_AUTHORITY, set, cut->name, false) == 0)
+            zone_put_glue(db, r, set);
+        return;
+    }
+
+    dns_reply_aa(r, true);
+    if(qname->len != klen) {
+        dns_reply_rcode(r, _NXDOMAIN);
+        zone_put_rrset(r, DNS_AUTHORITY, zone_rrset_find(apex, _SOA), apex->name, false);
+        return;
+    }
+
+    node = zone_node_find(db, qname);
+    name = NULL;
+    for(hops = 0; node && hops <= ZONE_CNAME_LIMIT; hops++)
+    {
+        if(qtype == _wildcard) {
+            for(set = node->rrsets; set; set = set->next)
+                if(zone_put_rrset(r, DNS_ANSWER, set, name, false) < 0)
+                    return;
+            return;
+        }
+        if((set = zone_rrset_find(node, qtype))) {
+            if(zone_put_rrset(r, DNS_ANSWER, set, name, false) == 0 && (qtype == _NS || qtype == _MX))
+                zone_put_glue(db, r, set);
+            return;
+        }
+        if(!(set = zone_rrset_find(node, _CNAME)) || set->nfixup == 0)
+            break;
+        if(zone_put_rrset(r, DNS_ANSWER, set, name, false) < 0)
+            return;
+        name = set->fixup[0].name;
+        node = zone_node_find(db, name);
+    }
+
+    ///a chain too long ends where it was cut
+    if(node && hops > ZONE_CNAME_LIMIT)
+        return;
+
+    /**
+     * No data at the last name, or past a CNAME no such name. Only a target
+     * in a zone of @db, not delegated, can be answered for; a resolver
+     * follows the others itself.
+     */
+    if(name && (!(apex = zone_apex(db, name, &cut)) || cut))
+        return;
+    if(!node)
+        dns_reply_rcode(r, _NXDOMAIN);
+    zone_put_rrset(r, DNS_AUTHORITY, zone_rrset_find(apex, _SOA), apex->name, false);
+}
+
+static inline
+void zone_stats_show(const struct zone_db *db)
+{
+    printf("zone: %zu names, %zu RRsets, %zu bytes of wire form\n",
+            db->count, db->nrrsets, db->bytes);
+}
+
+#endif ///ZONE_H
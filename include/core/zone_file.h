@@ -0,0 +1,514 @@
+#ifndef ZONE_FILE_H
+#define ZONE_FILE_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <limits.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "type.h"
+#include "limit.h"
+#include "debug.h"
+#include "protocol/message.h"
+#include "protocol/rdata.h"
+#include "core/zone.h"
+
+/**
+ * **Master files**
+ *
+ * The text of RFC 1035 5.1 read in one pass over the file mapped by
+ * mmap(2). A field is a pointer and a length into the map, never a copy;
+ * an entry is split into its fields, then its owner, TTL, class and type
+ * are taken from the front and the rest goes to the scan() codec of the
+ * type, which writes the RDATA into the buffer of the loader. Nothing is
+ * allocated per field or per record, the sink decides what to keep.
+ *
+ * Handled are
+ *
+ *   - entries continued over lines within ( ), comments after ;
+ *   - a blank owner, which is the owner of the entry before
+ *   - names relative to the origin, @ for the origin itself
+ *   - TTL and class in either order, each left out for the last one given
+ *   - $ORIGIN, $TTL, and $INCLUDE <file> [<origin>], the file found next
+ *     to the one including it, which keeps its own origin and owner
+ *   - every type of std_rr.h, and any type in the generic form of RFC 3597
+ *
+ * Lines opening with [ up to the ] are notes of the sample files of
+ * RFC 1033/1035, such as [File "SRI.ZONE"], and are skipped.
+ *
+ * Without $TTL an entry without TTL takes the last one given, the first
+ * SOA without one its MINIMUM.
+ */
+#define ZONE_FIELD_LIMIT   1024     ///fields of one entry
+#define ZONE_INCLUDE_LIMIT    8     ///$INCLUDE nested
+
+///takes every record read, in the order of the file; non-zero stops reading
+typedef int (*zone_sink_t)(void *arg, const uchar *owner, u16_t type, u16_t class, u32_t ttl,
+                           const uchar *rdata, u16_t rdlen);
+
+///state shared by a file and the files it includes
+struct zone_loader {
+    zone_sink_t                 sink;
+    void                        *arg;
+    unsigned int               depth;
+
+    ///statistics
+    size_t                     files;
+    size_t                     bytes;
+    size_t                   records;
+
+    struct rdata_token tok[ZONE_FIELD_LIMIT];
+    uchar                rdata[TCP_LIMIT];
+};
+
+///one file being read
+struct zone_file {
+    struct zone_loader           *ld;
+    const char                 *path;
+    const char                    *p;
+    const char                  *end;
+    unsigned int                line;
+    unsigned int               entry;   ///line the entry in hand starts on
+    unsigned int               paren;
+
+    uchar          origin[NAME_LIMIT];
+    uchar           owner[NAME_LIMIT];
+    bool                   has_owner;
+    u32_t                        ttl;
+    bool                     has_ttl;
+    bool                  dollar_ttl;   ///@ttl is from $TTL
+    u16_t                      class;
+};
+
+static inline
+int zone_file_error(const struct zone_file *zf, unsigned int line, const char *fmt, ...)
+{
+    va_list ap;
+
+    fprintf(stderr, "%s:%u: ", zf->path, line);
+    va_start(ap, fmt);
+    vfprintf(stderr, fmt, ap);
+    va_end(ap);
+    fputc('\n', stderr);
+
+    return -1;
+}
+
+///bytes which end a field outside quotes, or escape the next one
+static const bool zone_delim[256] = {
+    [' '] = true, ['\t'] = true, ['\r'] = true, ['\n'] = true,
+    [';'] = true, ['('] = true, [')'] = true, ['"'] = true, ['\\'] = true,
+};
+
+/**
+ * Split the next entry of @zf into the fields of its loader; *@blank
+ * tells whether it opens with a blank, i.e. has no owner of its own.
+ *
+ * @return the number of fields, 0 for a line without any, -1 if malformed
+ */
+static inline
+int zone_file_entry(struct zone_file *zf, bool *blank)
+{
+    struct rdata_token *tok = zf->ld->tok;
+    const char *p = zf->p, *end = zf->end;
+    int n = 0;
+
+    zf->entry = zf->line;
+    *blank = *p == ' ' || *p == '\t';
+    if(*p == '[') {
+        const char *close = memchr(p, ']', end - p);
+
+        if(!close)
+            return zone_file_error(zf, zf->line, "note without ]");
+        for(; p < close; p++)
+            zf->line += *p == '\n';
+        p = close + 1;
+    }
+
+    while(p < end)
+    {
+        struct rdata_token *t;
+
+        switch(*p) {
+            case ' ': case '\t': case '\r':
+                while(++p < end && (*p == ' ' || *p == '\t'))
+                    ;
+                continue;
+            case ';':
+                p = memchr(p, '\n', end - p);
+                if(!p)
+                    p = end;
+                continue;
+            case '\n':
+                p++;
+                zf->line++;
+                if(!zf->paren)
+                    goto done;
+                continue;
+            case '(':
+                p++;
+                zf->paren++;
+                continue;
+            case ')':
+                if(!zf->paren)
+                    return zone_file_error(zf, zf->line, ") without (");
+                p++;
+                zf->paren--;
+                continue;
+        }
+
+        if(n == ZONE_FIELD_LIMIT)
+            return zone_file_error(zf, zf->line, "more than %d fields", ZONE_FIELD_LIMIT);
+        t = &tok[n++];
+        t->quoted = *p == '"';
+        p += t->quoted;
+        t->s = p;
+
+        ///an escaped byte never ends a field
+        if(t->quoted) {
+            for(; p < end && *p != '"'; p++)
+            {
+                if(*p == '\\' && p + 1 < end)
+                    p++;
+                zf->line += *p == '\n';
+            }
+            if(p == end)
+                return zone_file_error(zf, zf->line, "\" without \"");
+            t->len = (u32_t) (p++ - t->s);
+        }
+        else {
+            for(;;)
+            {
+                while(p < end && !zone_delim[(uchar) *p])
+                    p++;
+                if(p == end || *p != '\\')
+                    break;
+                p += p + 1 < end ? 2 : 1;
+            }
+            t->len = (u32_t) (p - t->s);
+        }
+    }
+
+done:
+    if(p == end && zf->paren)
+        return zone_file_error(zf, zf->line, "( without )");
+    zf->p = p;
+
+    return n;
+}
+
+///up to 8 bytes of @t in upper case as one word, 0 if it is longer
+static inline
+u64_t zone_file_key(const char *s, size_t len)
+{
+    u64_t key = 0;
+
+    if(len > sizeof(key))
+        return 0;
+    for(size_t i = 0; i < len; i++)
+        key = key << 8 | (uchar) (s[i] >= 'a' && s[i] <= 'z' ? s[i] - 'a' + 'A' : s[i]);
+
+    return key;
+}
+
+///the number behind the @n bytes of @prefix of @t, 0 if none
+static inline
+u16_t zone_file_numbered(const struct rdata_token *t, const char *prefix, size_t n)
+{
+    struct rdata_token num = { .s = t->s + n, .len = t->len - n };
+    u32_t v;
+
+    if(t->len > n && !strncasecmp(t->s, prefix, n) && rdata_scan_number(&num, 0xffff, &v))
+        return (u16_t) v;
+    return 0;
+}
+
+///a type of the registry by its mnemonic, or TYPEnnn; 0 if none
+static inline
+u16_t zone_file_type(const struct rdata_token *t)
+{
+    static u64_t key[ARRAY_SIZE(dns_rdata_table)];
+    u64_t k;
+
+    if(t->quoted)
+        return 0;
+    ///the loader runs alone, before any worker
+    if(!key[_A])
+        for(u16_t type = 1; type < ARRAY_SIZE(dns_rdata_table); type++)
+            if(dns_rdata_table[type].name)
+                key[type] = zone_file_key(dns_rdata_table[type].name, strlen(dns_rdata_table[type].name));
+
+    if((k = zone_file_key(t->s, t->len)))
+        for(u16_t type = 1; type < ARRAY_SIZE(dns_rdata_table); type++)
+            if(key[type] == k)
+                return type;
+
+    return zone_file_numbered(t, "TYPE", 4);
+}
+
+///a class by its mnemonic, or CLASSnnn; 0 if none
+static inline
+u16_t zone_file_class(const struct rdata_token *t)
+{
+    if(t->quoted || t->len < 2)
+        return 0;
+    if(t->len == 2)
+        switch(zone_file_key(t->s, 2)) {
+            case 'I' << 8 | 'N': return _IN;
+            case 'C' << 8 | 'S': return _CS;
+            case 'C' << 8 | 'H': return _CH;
+            case 'H' << 8 | 'S': return _HS;
+            default: return 0;
+        }
+
+    return zone_file_numbered(t, "CLASS", 5);
+}
+
+static inline
+int zone_file_read(struct zone_loader *ld, const char *path, const uchar *origin,
+                   const struct zone_file *parent);
+
+///$ORIGIN, $TTL or $INCLUDE, the @n fields of the entry in the loader
+static inline
+int zone_file_directive(struct zone_file *zf, int n)
+{
+    const struct rdata_token *tok = zf->ld->tok;
+    uchar origin[NAME_LIMIT];
+    char path[PATH_MAX], file[PATH_MAX];
+    const char *slash;
+
+    if(rdata_token_is(&tok[0], "$ORIGIN")) {
+        if(n != 2 || rdata_scan_name(&tok[1], zf->origin, origin, sizeof(origin)) < 0)
+            return zone_file_error(zf, zf->entry, "bad $ORIGIN");
+        memcpy(zf->origin, origin, sizeof(origin));
+        return 0;
+    }
+    if(rdata_token_is(&tok[0], "$TTL")) {
+        if(n != 2 || !rdata_scan_ttl(&tok[1], &zf->ttl))
+            return zone_file_error(zf, zf->entry, "bad $TTL");
+        zf->has_ttl = zf->dollar_ttl = true;
+        return 0;
+    }
+    if(!rdata_token_is(&tok[0], "$INCLUDE"))
+        return zone_file_error(zf, zf->entry, "unknown directive %.*s", (int) tok[0].len, tok[0].s);
+
+    if(n < 2 || n > 3 || tok[1].len >= sizeof(file))
+        return zone_file_error(zf, zf->entry, "bad $INCLUDE");
+    if(n == 3 && rdata_scan_name(&tok[2], zf->origin, origin, sizeof(origin)) < 0)
+        return zone_file_error(zf, zf->entry, "bad origin of $INCLUDE");
+    memcpy(file, tok[1].s, tok[1].len);
+    file[tok[1].len] = '\0';
+
+    ///found next to the file including it
+    slash = strrchr(zf->path, '/');
+    if(file[0] != '/' && slash) {
+        if(snprintf(path, sizeof(path), "%.*s/%s", (int) (slash - zf->path), zf->path, file) >= (int) sizeof(path))
+            return zone_file_error(zf, zf->entry, "path of $INCLUDE too long");
+    }
+    else
+        strcpy(path, file);
+
+    if(zf->ld->depth == ZONE_INCLUDE_LIMIT)
+        return zone_file_error(zf, zf->entry, "$INCLUDE nested more than %d deep", ZONE_INCLUDE_LIMIT);
+    return zone_file_read(zf->ld, path, n == 3 ? origin : zf->origin, zf);
+}
+
+///the record of the @n fields of the entry in the loader, to the sink
+static inline
+int zone_file_record(struct zone_file *zf, int n, bool blank)
+{
+    struct zone_loader *ld = zf->ld;
+    const struct rdata_token *tok = ld->tok;
+    u16_t type, class = 0;
+    u32_t ttl = 0;
+    bool has_ttl = false;
+    ssize_t rdlen;
+    int k = 0;
+
+    if(!blank) {
+        if(rdata_scan_name(&tok[k++], zf->origin, zf->owner, sizeof(zf->owner)) < 0)
+            return zone_file_error(zf, zf->entry, "bad owner %.*s", (int) tok[0].len, tok[0].s);
+        zf->has_owner = true;
+    }
+    else if(!zf->has_owner)
+        return zone_file_error(zf, zf->entry, "no owner to inherit");
+
+    ///[<TTL>] [<class>] or [<class>] [<TTL>]
+    for(int i = 0; i < 2 && k < n; i++)
+    {
+        if(!has_ttl && tok[k].len && tok[k].s[0] >= '0' && tok[k].s[0] <= '9') {
+            if(!rdata_scan_ttl(&tok[k++], &ttl))
+                return zone_file_error(zf, zf->entry, "bad TTL");
+            has_ttl = true;
+        }
+        else if(!class && (class = zone_file_class(&tok[k])))
+            k++;
+    }
+    if(k == n || !(type = zone_file_type(&tok[k])))
+        return zone_file_error(zf, zf->entry, "no known type");
+    k++;
+
+    if(k < n && !tok[k].quoted && tok[k].len == 2 && !memcmp(tok[k].s, "\\#", 2))
+        rdlen = rdata_scan_generic(&tok[k + 1], n - k - 1, ld->rdata, sizeof(ld->rdata));
+    else
+        rdlen = dns_rdata(type)->scan(&tok[k], n - k, zf->origin, ld->rdata, sizeof(ld->rdata));
+    if(rdlen < 0 || rdlen > 0xffff)
+        return zone_file_error(zf, zf->entry, "bad RDATA of %.*s", (int) tok[k - 1].len, tok[k - 1].s);
+
+    if(class)
+        zf->class = class;
+    if(has_ttl && !zf->dollar_ttl) {
+        zf->ttl = ttl;
+        zf->has_ttl = true;
+    }
+    else if(!has_ttl && !zf->has_ttl && type == _SOA) {
+        const uchar *min = ld->rdata + rdlen - sizeof(u32_t);
+        u16_t at[RDATA_NAMES];
+
+        ///the generic form may hold anything: MINIMUM only ends a well formed SOA
+        if(dns_rdata(type)->names(ld->rdata, (u16_t) rdlen, at) < 0)
+            return zone_file_error(zf, zf->entry, "bad RDATA of SOA");
+        zf->ttl = ((u32_t) min[0] << 24) | (min[1] << 16) | (min[2] << 8) | min[3];
+        zf->has_ttl = true;
+    }
+    if(!has_ttl) {
+        if(!zf->has_ttl)
+            return zone_file_error(zf, zf->entry, "no TTL, and no $TTL before");
+        ttl = zf->ttl;
+    }
+
+    if(ld->sink(ld->arg, zf->owner, type, zf->class, ttl, ld->rdata, (u16_t) rdlen))
+        return zone_file_error(zf, zf->entry, "record not taken");
+    ld->records++;
+
+    return 0;
+}
+
+///every entry of the text of @zf
+static inline
+int zone_file_parse(struct zone_file *zf)
+{
+    while(zf->p < zf->end)
+    {
+        bool blank;
+        int n = zone_file_entry(zf, &blank);
+
+        if(n < 0)
+            return -1;
+        if(n == 0)
+            continue;
+        if(!blank && !zf->ld->tok[0].quoted && zf->ld->tok[0].s[0] == '$') {
+            if(zone_file_directive(zf, n) < 0)
+                return -1;
+        }
+        else if(zone_file_record(zf, n, blank) < 0)
+            return -1;
+    }
+
+    return 0;
+}
+
+/**
+ * Map the file at @path and read it, relative names against @origin; an
+ * included file starts with the TTL and class of its @parent.
+ */
+static inline
+int zone_file_read(struct zone_loader *ld, const char *path, const uchar *origin,
+                   const struct zone_file *parent)
+{
+    struct zone_file zf = { .ld = ld, .path = path, .line = 1, .class = _IN };
+    struct stat st;
+    void *map;
+    int fd, ret;
+    ssize_t olen = rdata_name_len(origin, NAME_LIMIT);
+
+    if(olen < 0)
+        return -1;
+    memcpy(zf.origin, origin, olen);
+    if(parent) {
+        zf.ttl = parent->ttl, zf.has_ttl = parent->has_ttl, zf.dollar_ttl = parent->dollar_ttl;
+        zf.class = parent->class;
+    }
+
+    if((fd = open(path, O_RDONLY | O_CLOEXEC)) < 0 || fstat(fd, &st) < 0) {
+        perror(path);
+        if(fd >= 0)
+            close(fd);
+        return -1;
+    }
+    if(st.st_size == 0) {
+        close(fd);
+        ld->files++;
+        return 0;
+    }
+    map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE | MAP_POPULATE, fd, 0);
+    close(fd);
+    if(map == MAP_FAILED) {
+        perror(path);
+        return -1;
+    }
+    madvise(map, st.st_size, MADV_SEQUENTIAL);
+
+    zf.p = (const char *) map;
+    zf.end = zf.p + st.st_size;
+    ld->depth++;
+    ret = zone_file_parse(&zf);
+    ld->depth--;
+    ld->files++;
+    ld->bytes += st.st_size;
+
+    munmap(map, st.st_size);
+    return ret;
+}
+
+/**
+ * Read the master file at @path, names relative to the @origin given in
+ * text, handing every record to @sink.
+ *
+ * @return the number of records, -1 on the first error, which is printed
+ *         with its file and line
+ */
+static inline
+ssize_t zone_file_scan(const char *path, const char *origin, zone_sink_t sink, void *arg)
+{
+    struct zone_loader *ld = (struct zone_loader *) malloc(sizeof(*ld));
+    struct rdata_token t = { .s = origin, .len = (u32_t) strlen(origin) };
+    uchar root = 0, name[NAME_LIMIT];
+    ssize_t ret;
+
+    syserr(!ld, "zone_file_scan: malloc()\n");
+    ld->sink = sink, ld->arg = arg;
+    ld->depth = 0;
+    ld->files = ld->bytes = ld->records = 0;
+
+    if(rdata_scan_name(&t, &root, name, sizeof(name)) < 0) {
+        fprintf(stderr, "%s: bad origin %s\n", path, origin);
+        ret = -1;
+    }
+    else
+        ret = zone_file_read(ld, path, name, NULL) < 0 ? -1 : (ssize_t) ld->records;
+
+    free(ld);
+    return ret;
+}
+
+static inline
+int zone_file_add(void *db, const uchar *owner, u16_t type, u16_t class, u32_t ttl,
+                  const uchar *rdata, u16_t rdlen)
+{
+    return zone_add((struct zone_db *) db, owner, type, class, ttl, rdata, rdlen);
+}
+
+///load the master file at @path for the zone @origin into @db
+static inline
+ssize_t zone_file_load(struct zone_db *db, const char *path, const char *origin)
+{
+    return zone_file_scan(path, origin, zone_file_add, db);
+}
+
+#endif ///ZONE_FILE_H
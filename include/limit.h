@@ -8,14 +8,57 @@
  * TTL             positive values of a signed 32 bit number.
  * 
  * UDP messages    512 octets or less
+ *
+ * EDNS0 messages  the UDP payload we advertise in OPT (RFC 6891), the size
+ *                 recommended by the DNS flag day 2020 to stay clear of IP
+ *                 fragmentation
+ *
+ * TCP messages    65535 octets or less (16 bit length prefix)
 */
 
 #define LABEL_LIMIT  63
 #define NAME_LIMIT  255
 #define TTL_LIMIT    32
 #define UDP_LIMIT   512
+#define EDNS_LIMIT 1232
+#define TCP_LIMIT 65535
 
 #define BUF_SIZE 10000
+
+/**
+ * **Packet**
+ *
+ * largest datagram the server receives or sends, the size of a packet slot
+ */
+#define PKT_LIMIT 4096
+
+/**
+ * **Server**
+ *
+ * datagrams moved per recvmmsg/sendmmsg call
+ *
+ * worker threads of one server, one per CPU at most (CPU_SETSIZE)
+ *
+ * addresses a worker may listen on (each one with UDP and TCP)
+ *
+ * TCP connections held by one worker
+ *
+ * replies a TCP connection may have queued before we stop reading from it
+ *
+ * seconds a TCP connection may stay without progress before it is closed
+ *
+ * packet slots a worker keeps for queued TCP replies, besides its batch
+ *
+ * bytes of scratch memory a thread has for one message, see utility/arena.h
+ */
+#define BATCH_LIMIT 1024
+#define WORKER_LIMIT 1024
+#define LISTEN_LIMIT  16
+#define CONN_LIMIT  4096
+#define PIPELINE_LIMIT 64
+#define TCP_IDLE_TIMEOUT 10
+#define POOL_TCP_SLOTS 1024
+#define ARENA_SIZE (64 * 1024)
 /**
  * **FILE** 
  */
@@ -65,15 +65,18 @@
         var = (__typeof__(var)) locate;\
         var;})
 
+#include "utility/arena.h"
+
+/**
+ * Allocation of decode structures: from the message arena of the thread,
+ * given back together by its next reset, see utility/arena.h. NULL when
+ * the arena is full.
+ */
 #define _new(type, var)\
-    type var = (type) malloc(sizeof(*((type) 0)));
-    /*({\
-    type _tmp;\
-    type var = (type) malloc(sizeof(*_tmp));\
-    var;})*/
+    type var = (type) arena_alloc(msg_arena(), sizeof(*((type) 0)));
 
 #define _malloc(type, var)\
     ({\
-        var = (type) malloc(sizeof(*((type) 0)));})
+        var = (type) arena_alloc(msg_arena(), sizeof(*((type) 0)));})
 
 #endif ///MACRO_H
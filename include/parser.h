@@ -9,6 +9,8 @@
 #include "config.h"
 
 #define MAX_BUFF_SIZE 200
+///zones one configuration may load
+#define STARTUP_ZONE_LIMIT 50
 
 typedef enum {
     STARTUP_CFG,
@@ -26,4 +28,14 @@ struct startup {
 
 ///#define parser(type, file) parser_##type(file)
 
+/**
+ * Read the configuration at @in, lines as in config.sample/COMFIG.CMD:
+ *
+ *     load root server list             from file ROOT.SERVERS
+ *     load zone SRI.COM.                from file SRI.ZONE
+ *
+ * the files named relative to the directory of @in.
+ *
+ * @return the paths found, NULL if @in cannot be opened
+ */
 struct startup *startup_parser(char* in);
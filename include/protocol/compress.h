@@ -0,0 +1,251 @@
+#ifndef COMPRESS_H
+#define COMPRESS_H
+
+#include <string.h>
+#include <stdbool.h>
+#include <sys/types.h>
+#include "type.h"
+#include "limit.h"
+#include "core/dns_case.h"
+
+/**
+ * **Name compression (RFC 1035 4.1.4)**
+ *
+ * Every name written into a message leaves its suffixes in a small hash
+ * dictionary, keyed by a case-insensitive hash of the suffix and holding
+ * the offset where it was written. A later name is looked up longest suffix
+ * first; the labels in front of the longest known suffix are written out
+ * and the rest becomes a pointer to it.
+ *
+ * The dictionary is bounded: COMP_SLOTS slots, filled up to COMP_LIMIT, past
+ * which names are still compressed against what is known but add nothing.
+ * Entries are only ever dropped newest first (dns_comp_rollback), which
+ * leaves the open addressing table exactly as it was before them.
+ *
+ * Names handed to the encoder are uncompressed wire names, as written by
+ * host_to_dns_name().
+ */
+#define COMP_SLOTS  128         ///power of 2
+#define COMP_LIMIT   96
+#define COMP_PTR_LIMIT 0x3FFF   ///farthest offset a pointer reaches
+
+struct dns_comp {
+    u16_t               off[COMP_SLOTS];    ///0: empty slot
+    u32_t              hash[COMP_SLOTS];
+    u8_t              order[COMP_LIMIT];    ///slots in insertion order
+    unsigned int                     n;
+};
+
+static inline
+void dns_comp_init(struct dns_comp *c)
+{
+    memset(c->off, 0, sizeof(c->off));
+    c->n = 0;
+}
+
+///hash of one label followed by the suffix hashed to @next
+static inline
+u32_t dns_comp_hash(const uchar *label, u32_t next)
+{
+    u32_t h = next ^ 2166136261u;
+
+    for(unsigned int i = 0; i <= label[0]; i++)
+        h = (h ^ dns_case_fold(label[i])) * 16777619u;
+
+    return h | 1;       ///never 0
+}
+
+/**
+ * Does the name at @off of @buf, pointers followed but never past @len,
+ * spell the uncompressed @name?
+ */
+static inline
+bool dns_comp_match(const uchar *buf, size_t len, size_t off, const uchar *name)
+{
+    for(int hops = 0; off < len; )
+    {
+        uchar l = buf[off];
+
+        if((l & 0xC0) == 0xC0) {
+            if(off + 1 >= len || ++hops > NAME_LIMIT / 2)
+                return false;
+            off = ((size_t) (l & 0x3F) << 8) | buf[off + 1];
+            continue;
+        }
+        if(l != name[0] || off + 1 + l > len)
+            return false;
+        if(l == 0)
+            return true;
+
+        for(unsigned int i = 1; i <= l; i++)
+            if(dns_case_fold(buf[off + i]) != dns_case_fold(name[i]))
+                return false;
+
+        off += 1 + l;
+        name += 1 + l;
+    }
+
+    return false;
+}
+
+static inline
+void dns_comp_add(struct dns_comp *c, u32_t hash, size_t off)
+{
+    unsigned int i = hash & (COMP_SLOTS - 1);
+
+    if(c->n == COMP_LIMIT || off > COMP_PTR_LIMIT || off == 0)
+        return;
+
+    while(c->off[i])
+        i = (i + 1) & (COMP_SLOTS - 1);
+
+    c->off[i] = (u16_t) off;
+    c->hash[i] = hash;
+    c->order[c->n++] = (u8_t) i;
+}
+
+///forget every suffix added since dns_comp_mark() returned @mark
+static inline
+void dns_comp_rollback(struct dns_comp *c, unsigned int mark)
+{
+    while(c->n > mark)
+        c->off[c->order[--c->n]] = 0;
+}
+
+static inline
+unsigned int dns_comp_mark(struct dns_comp *c)
+{
+    return c->n;
+}
+
+/**
+ * Split the uncompressed @name into its labels and hash every suffix.
+ *
+ * @return number of labels, the root excluded; -1 if @name is malformed
+ */
+static inline
+int dns_comp_suffixes(const uchar *name, u16_t *at, u32_t *hash)
+{
+    int n = 0;
+    size_t off = 0;
+
+    while(name[off])
+    {
+        if(name[off] > LABEL_LIMIT || off + 1 + name[off] >= NAME_LIMIT)
+            return -1;
+        at[n++] = (u16_t) off;
+        off += 1 + name[off];
+    }
+
+    for(int i = n - 1; i >= 0; i--)
+        hash[i] = dns_comp_hash(name + at[i], i == n - 1 ? 0 : hash[i + 1]);
+
+    return n;
+}
+
+/**
+ * Write @name at @off of @buf, the end of the message so far, compressed
+ * against the dictionary; then remember its new suffixes. Nothing is
+ * written past @cap.
+ *
+ * @return bytes written, -1 if they do not fit or @name is malformed
+ */
+static inline
+ssize_t dns_comp_put(struct dns_comp *c, uchar *buf, size_t off, size_t cap, const uchar *name)
+{
+    u16_t at[NAME_LIMIT / 2];
+    u32_t hash[NAME_LIMIT / 2];
+    int n = dns_comp_suffixes(name, at, hash);
+    int i, found = -1;
+    size_t ptr = 0, w;
+
+    if(n < 0)
+        return -1;
+
+    ///longest suffix already in the message
+    for(i = 0; i < n && found < 0; i++)
+    {
+        for(unsigned int s = hash[i] & (COMP_SLOTS - 1); c->off[s]; s = (s + 1) & (COMP_SLOTS - 1))
+        {
+            if(c->hash[s] == hash[i] && dns_comp_match(buf, off, c->off[s], name + at[i])) {
+                ptr = c->off[s];
+                found = i;
+                break;
+            }
+        }
+    }
+
+    ///labels in front of it, then the pointer; or the whole name
+    if(found >= 0) {
+        i = found;
+        w = at[i];
+    }
+    else {
+        i = n;
+        w = n ? at[n - 1] + 1 + name[at[n - 1]] : 0;
+    }
+    if(off + w + (found >= 0 ? 2 : 1) > cap)
+        return -1;
+
+    memcpy(buf + off, name, w);
+    if(found >= 0) {
+        buf[off + w] = (uchar) (0xC0 | (ptr >> 8));
+        buf[off + w + 1] = (uchar) ptr;
+    }
+    else
+        buf[off + w] = 0;
+
+    for(int k = 0; k < i; k++)
+        dns_comp_add(c, hash[k], off + at[k]);
+
+    return (ssize_t) w + (found >= 0 ? 2 : 1);
+}
+
+/**
+ * Remember the suffixes of a name already in @buf at @off, e.g. the
+ * question name. Of a name ending in a pointer, the owner of a record say,
+ * the labels in front of the pointer are taken, hashed onto the suffix it
+ * points to. A malformed name, or one whose pointers do not lead strictly
+ * backwards, adds nothing.
+ */
+static inline
+void dns_comp_learn(struct dns_comp *c, const uchar *buf, size_t len, size_t off)
+{
+    u16_t at[NAME_LIMIT / 2];
+    u32_t hash[NAME_LIMIT / 2];
+    int n = 0, front = -1;
+    size_t p = off, run = off, wire = 1;
+
+    while(p < len && buf[p])
+    {
+        if((buf[p] & 0xC0) == 0xC0) {
+            size_t target;
+
+            if(p + 1 >= len)
+                return;
+            target = ((size_t) (buf[p] & 0x3F) << 8) | buf[p + 1];
+            if(target >= run)
+                return;
+            if(front < 0)
+                front = n;
+            p = run = target;
+            continue;
+        }
+        wire += 1 + buf[p];
+        if(buf[p] > LABEL_LIMIT || wire > NAME_LIMIT || p + 1 + buf[p] >= len)
+            return;
+        at[n++] = (u16_t) p;
+        p += 1 + buf[p];
+    }
+    if(p >= len)
+        return;
+    if(front < 0)
+        front = n;
+
+    for(int i = n - 1; i >= 0; i--)
+        hash[i] = dns_comp_hash(buf + at[i], i == n - 1 ? 0 : hash[i + 1]);
+    for(int i = 0; i < front; i++)
+        dns_comp_add(c, hash[i], at[i]);
+}
+
+#endif ///COMPRESS_H
@@ -0,0 +1,127 @@
+#ifndef EDNS_H
+#define EDNS_H
+
+#include <stdbool.h>
+#include <arpa/inet.h>
+#include "type.h"
+#include "limit.h"
+#include "message.h"
+#include "msg_view.h"
+#include "reply.h"
+
+/**
+ * **EDNS0 (RFC 6891)**
+ *
+ * A query may carry one OPT pseudo-RR in its additional section. Its owner
+ * is the root, its CLASS the largest UDP payload the requestor takes, and
+ * its TTL is made of the upper 8 bits of a 12 bit RCODE, the version and
+ * the flags:
+ *
+ *     +--+--+--+--+--+--+--+--+--+--+--+--+--+--+--+--+
+ *     |     EXTENDED-RCODE    |        VERSION        |
+ *     +--+--+--+--+--+--+--+--+--+--+--+--+--+--+--+--+
+ *     | DO|                   Z                       |
+ *     +--+--+--+--+--+--+--+--+--+--+--+--+--+--+--+--+
+ *
+ * A reply over UDP to such a query may take that payload, no less than
+ * UDP_LIMIT and no more than EDNS_LIMIT; it carries an OPT of its own,
+ * advertising EDNS_LIMIT, echoing DO and holding the upper RCODE bits. A
+ * version above ours is answered BADVERS, more than one OPT FORMERR.
+ * Options in the RDATA are skipped, and none is sent.
+ */
+#define EDNS_VERSION    0
+#define EDNS_OPT_SIZE  11       ///root, TYPE, CLASS, TTL, RDLENGTH
+#define EDNS_DO    0x8000
+
+struct dns_edns {
+    bool      present;
+    u8_t      version;
+    u16_t     payload;          ///largest UDP reply the requestor takes
+    u16_t       flags;          ///DO and Z
+};
+
+///fill @e from the OPT record whose TYPE is at @fixed
+static inline
+void dns_edns_read(struct dns_edns *e, const uchar *fixed)
+{
+    e->present = true;
+    e->payload = dns_view_u16(fixed + 2);
+    e->version = fixed[5];
+    e->flags = dns_view_u16(fixed + 6);
+}
+
+/**
+ * Find the OPT record of the query indexed by @v.
+ *
+ * @return 0, with @e->present false if there is none; -1 if there is more
+ *         than one or one not owned by the root (FORMERR)
+ */
+static inline
+int dns_edns_parse(struct dns_edns *e, const struct dns_view *v)
+{
+    *e = (struct dns_edns) { .present = false };
+    for(unsigned int i = 0; i < dns_view_count(v, DNS_ADDITIONAL); i++)
+    {
+        const struct dns_view_rr *rr = dns_view_rr(v, DNS_ADDITIONAL, i);
+
+        if(dns_view_type(v, DNS_ADDITIONAL, i) != _OPT)
+            continue;
+        if(e->present || v->buf[rr->name] != 0)
+            return -1;
+        dns_edns_read(e, v->buf + rr->fixed);
+    }
+
+    return 0;
+}
+
+/**
+ * Largest reply to the query of @e over a transport taking @cap bytes.
+ * A stream, that is a @cap above PKT_LIMIT, takes @cap; a datagram takes
+ * UDP_LIMIT, or the payload of the OPT record if larger, @cap at most.
+ */
+static inline
+size_t dns_edns_limit(const struct dns_edns *e, size_t cap)
+{
+    size_t size = UDP_LIMIT;
+
+    if(cap > PKT_LIMIT)
+        return cap;
+    if(e->present && e->payload > size)
+        size = e->payload;
+
+    return size < cap ? size : cap;
+}
+
+///write the OPT record of the reply to @e at @p, @rcode being the full one
+static inline
+void dns_edns_write(uchar *p, const struct dns_edns *e, u16_t rcode)
+{
+    p[0] = 0;
+    p[1] = (uchar) (_OPT >> 8), p[2] = (uchar) _OPT;
+    p[3] = (uchar) (EDNS_LIMIT >> 8), p[4] = (uchar) EDNS_LIMIT;
+    p[5] = (uchar) (rcode >> 4), p[6] = EDNS_VERSION;
+    p[7] = (uchar) ((e->flags & EDNS_DO) >> 8), p[8] = 0;
+    p[9] = p[10] = 0;
+}
+
+/**
+ * Close the reply @r to the query of @e with the 12 bit @rcode: its lower
+ * bits go into the header, the OPT record into the additional section.
+ * The room for it is the caller's to keep, see dns_process().
+ *
+ * @return 0, -1 if it does not fit
+ */
+static inline
+int dns_edns_put(struct dns_reply *r, const struct dns_edns *e, u16_t rcode)
+{
+    if(r->len + EDNS_OPT_SIZE > r->cap)
+        return -1;
+    dns_reply_rcode(r, (RCODE_t) (rcode & 0xF));
+    dns_edns_write(r->buf + r->len, e, rcode);
+    r->len += EDNS_OPT_SIZE;
+    dns_reply_count(r, DNS_ADDITIONAL);
+
+    return 0;
+}
+
+#endif ///EDNS_H
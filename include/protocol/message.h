@@ -81,6 +81,15 @@
  */
 
 
+///sections of a message, in wire order
+enum {
+    DNS_QUESTION,
+    DNS_ANSWER,
+    DNS_AUTHORITY,
+    DNS_ADDITIONAL,
+    DNS_SECTIONS,
+};
+
 ///FIXME: Use #define to do this.
 /*typedef RR_ptr_t *DNS_ANSWER_ptr_t;
 typedef RR_ptr_t *DNS_AUTHORITY_ptr_t;
@@ -1,3 +1,5 @@
+#include <sys/types.h>
+#include <arpa/inet.h>
 #include "rr.h"
 #include "macro.h"
 
@@ -248,6 +250,7 @@ typedef enum {
     _NXRRSET,
     _NOTAUTH,
     _NOTZONE,/**RFC 2136*/
+    _BADVERS = 16,/**RFC 6891, extended: only with an OPT RR*/
 } RCODE_t;
 
 const char const *_RCODE[16] = {
@@ -265,36 +268,68 @@ const char const *_RCODE[16] = {
     [11 ... 15] = "\0",
 };
 
+/**
+ * The second word of the header holds every flag. It is kept in network
+ * order and read or written whole through the masks below, so the layout
+ * does not depend on how a compiler packs bitfields nor on the byte order
+ * of the host.
+ */
 typedef struct _dns_header {
-///FIXME: IMPORTANT BIT would be affected by BIG ENDIAN
     u16_t       id;
-#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
-    u16_t       qr: 1;
-    u16_t   opcode: 4;
-    u16_t       aa: 1;
-    u16_t       tc: 1;
-    u16_t       rd: 1;
-
-    u16_t       ra: 1;
-    u16_t        z: 3;
-    u16_t    rcode: 4;
-#else
-    u16_t       rd: 1;
-    u16_t       tc: 1;
-    u16_t       aa: 1;
-    u16_t   opcode: 4;
-    u16_t       qr: 1;
-
-    u16_t    rcode: 4;
-    u16_t        z: 3;
-    u16_t       ra: 1;
-#endif
+    u16_t    flags;
     u16_t   qdcount;
     u16_t   ancount;
     u16_t   nscount;
     u16_t   arcount;
 } DNS_HEADER_t;
 
+///flags, in host order
+#define DNS_QR      0x8000
+#define DNS_OPCODE  0x7800
+#define DNS_AA      0x0400
+#define DNS_TC      0x0200
+#define DNS_RD      0x0100
+#define DNS_RA      0x0080
+#define DNS_Z       0x0070
+#define DNS_RCODE   0x000F
+
+///the field of @mask in @hdr, shifted down
+static inline
+u16_t dns_flag(const DNS_HEADER_t *hdr, u16_t mask)
+{
+    return (u16_t) ((ntohs(hdr->flags) & mask) / (mask & -mask));
+}
+
+///set the field of @mask in @hdr to @val, in one store
+static inline
+void dns_flag_set(DNS_HEADER_t *hdr, u16_t mask, unsigned int val)
+{
+    hdr->flags = htons((u16_t) ((ntohs(hdr->flags) & ~mask) | ((val * (mask & -mask)) & mask)));
+}
+
+///the flags word of the fields given, in host order
+static inline
+u16_t dns_flags_make(unsigned int qr, unsigned int opcode, unsigned int aa, unsigned int tc,
+                     unsigned int rd, unsigned int ra, unsigned int z, unsigned int rcode)
+{
+    return (u16_t) ((qr ? DNS_QR : 0) | ((opcode << 11) & DNS_OPCODE) | (aa ? DNS_AA : 0) |
+                    (tc ? DNS_TC : 0) | (rd ? DNS_RD : 0) | (ra ? DNS_RA : 0) |
+                    ((z << 4) & DNS_Z) | (rcode & DNS_RCODE));
+}
+
+/**
+ * Turn the header of a query into the one of its reply in one store: QR
+ * set, OPCODE and RD kept, RCODE @rcode, AA and RA as given in @aa_ra, TC
+ * and Z cleared.
+ */
+static inline
+void dns_header_make_reply(DNS_HEADER_t *hdr, u16_t aa_ra, RCODE_t rcode)
+{
+    u16_t keep = ntohs(hdr->flags) & (DNS_OPCODE | DNS_RD);
+
+    hdr->flags = htons((u16_t) (keep | DNS_QR | (aa_ra & (DNS_AA | DNS_RA)) | (rcode & DNS_RCODE)));
+}
+
 #define dns_header_declare(var) _declare(DNS_HEADER_t *, var)
 
 #define dns_header_locate(var, locate) _locate(var, locate)
@@ -308,14 +343,8 @@ typedef struct _dns_header {
     size_t _s = sizeof(DNS_HEADER_t);\
     \
     protocol_struct_member_assign(var,     id,     _id, htons);\
-    protocol_struct_member_assign(var,     qr,     _qr);\
-    protocol_struct_member_assign(var, opcode, _opcode);\
-    protocol_struct_member_assign(var,     aa,     _aa);\
-    protocol_struct_member_assign(var,     tc,     _tc);\
-    protocol_struct_member_assign(var,     rd,     _rd);\
-    protocol_struct_member_assign(var,     ra,     _ra);\
-    protocol_struct_member_assign(var,      z,      _z);\
-    protocol_struct_member_assign(var,  rcode,  _rcode);\
+    protocol_struct_member_assign(var,  flags, dns_flags_make(_qr, _opcode, _aa, _tc,\
+                                                  _rd, _ra, _z, _rcode), htons);\
     protocol_struct_member_assign(var, qdcount, _qdcount, htons);\
     protocol_struct_member_assign(var, ancount, _ancount, htons);\
     protocol_struct_member_assign(var, nscount, _nscount, htons);\
@@ -333,8 +362,26 @@ typedef struct _dns_header {
                             _ancount, _nscount, _arcount);\
     _s;})
 
+/**
+ * DNS Header Member: a count or the id, through the conversion given; a
+ * flag, shifted down
+ */
 #define dns_header_member(_struct, member, ...)\
-    __VA_ARGS__(_struct->member)
+    dns_header_member_ ## member(_struct, member, __VA_ARGS__)
+
+#define dns_header_member_id(_struct, member, ...)       __VA_ARGS__(_struct->member)
+#define dns_header_member_qdcount(_struct, member, ...)  __VA_ARGS__(_struct->member)
+#define dns_header_member_ancount(_struct, member, ...)  __VA_ARGS__(_struct->member)
+#define dns_header_member_nscount(_struct, member, ...)  __VA_ARGS__(_struct->member)
+#define dns_header_member_arcount(_struct, member, ...)  __VA_ARGS__(_struct->member)
+#define dns_header_member_qr(_struct, member, ...)       dns_flag(_struct, DNS_QR)
+#define dns_header_member_opcode(_struct, member, ...)   dns_flag(_struct, DNS_OPCODE)
+#define dns_header_member_aa(_struct, member, ...)       dns_flag(_struct, DNS_AA)
+#define dns_header_member_tc(_struct, member, ...)       dns_flag(_struct, DNS_TC)
+#define dns_header_member_rd(_struct, member, ...)       dns_flag(_struct, DNS_RD)
+#define dns_header_member_ra(_struct, member, ...)       dns_flag(_struct, DNS_RA)
+#define dns_header_member_z(_struct, member, ...)        dns_flag(_struct, DNS_Z)
+#define dns_header_member_rcode(_struct, member, ...)    dns_flag(_struct, DNS_RCODE)
 
 /**
  * 4.1.2. Question section format
@@ -512,10 +559,6 @@ typedef struct _DNS_QUESTION_ptr {
 #define dns_answer_declare(var) rr_declare(var)
 #define dns_answer_locate(var, locate) rr_locate(var, locate)
 #define dns_answer_new(var) rr_new(var)
-#define dns_answer_assign(var, _name, _type, _class, _ttl, _rd_len, _rdata)\
-    rr_assign(var, _name, _type, _class, _ttl, _rd_len, _rdata)
-#define dns_answer_locate_assign(var, locate, _qname, _qtype, _qclass)\
-    rr_locate_assign(var, locate, _qname, _qtype, _qclass)
 #define dns_answer_init(var, locate, _qname, _qtype, _qclass)\
     rr_init(var, locate, _qname, _qtype, _qclass)
 #define dns_answer_member(_struct, member)\
@@ -527,10 +570,6 @@ typedef struct _DNS_QUESTION_ptr {
 #define dns_authority_declare(var) rr_declare(var)
 #define dns_authority_locate(var, locate) rr_locate(var, locate)
 #define dns_authority_new(var) rr_new(var)
-#define dns_authority_assign(var, _name, _type, _class, _ttl, _rd_len, _rdata)\
-    rr_assign(var, _name, _type, _class, _ttl, _rd_len, _rdata)
-#define dns_authority_locate_assign(var, locate, _qname, _qtype, _qclass)\
-    rr_locate_assign(var, locate, _qname, _qtype, _qclass)
 #define dns_authority_member(_struct, member)\
     rr_member(_struct, member)
 
@@ -540,10 +579,6 @@ typedef struct _DNS_QUESTION_ptr {
 #define dns_additional_declare(var) rr_declare(var)
 #define dns_additional_locate(var, locate) rr_locate(var, locate)
 #define dns_additional_new(var) rr_new(var)
-#define dns_additional_assign(var, _name, _type, _class, _ttl, _rd_len, _rdata)\
-    rr_assign(var, _name, _type, _class, _ttl, _rd_len, _rdata)
-#define dns_additional_locate_assign(var, locate, _qname, _qtype, _qclass)\
-    rr_locate_assign(var, locate, _qname, _qtype, _qclass)
 #define dns_additional_member(_struct, member)\
     rr_member(_struct, member)
 
@@ -648,3 +683,34 @@ bool is_compressive(uchar *byte)
 }
 
 #define compression_mask 0x3FFF
+
+/**
+ * Skip the (possibly compressed) name starting at @off.
+ *
+ * A name ends with the root label or with a pointer, so nothing behind the
+ * first pointer is read.
+ *
+ * @return offset right after the name, -1 if it runs past @len, its labels
+ *         in front of the end exceed NAME_LIMIT or a label is neither a
+ *         length nor a pointer
+ */
+static inline
+ssize_t dns_name_skip(const uchar *buf, size_t len, size_t off)
+{
+    size_t start = off;
+
+    while(off < len && off - start < NAME_LIMIT)
+    {
+        uchar l = buf[off];
+
+        if(l == 0)
+            return (ssize_t) off + 1;
+        if((l & 0xC0) == 0xC0)
+            return off + 2 <= len ? (ssize_t) off + 2 : -1;
+        if(l & 0xC0)
+            return -1;
+        off += 1 + l;
+    }
+
+    return -1;
+}
@@ -0,0 +1,235 @@
+#ifndef MSG_VIEW_H
+#define MSG_VIEW_H
+
+#include <string.h>
+#include <endian.h>
+#include "message.h"
+
+/**
+ * **Message view**
+ *
+ * An immutable index over a received message. dns_view_parse() walks the
+ * packet once, checking every bound, and records where the header, each
+ * question and each answer, authority and additional RR start; afterwards
+ * any field of any record is read in O(1) straight from the packet.
+ *
+ * Nothing is copied or allocated: the index is a small fixed array, so a
+ * view lives on the stack of the code handling the packet and is only
+ * valid as long as the packet is. Messages with more than VIEW_RR_LIMIT
+ * entries are rejected, which no query ever comes close to.
+ *
+ * Fields are read byte by byte in network order and returned in host order,
+ * so records at odd offsets are fine.
+ *
+ * Queries nearly all have one question, no answer or authority and at most
+ * an OPT record; dns_view_parse_query() indexes those on a fast path, see
+ * dns_view_fast(), and every other message through dns_view_parse().
+ */
+#define VIEW_RR_LIMIT 64
+
+struct dns_view_rr {
+    u16_t                   name;     ///offset of the owner name
+    u16_t                  fixed;     ///offset of TYPE, behind the name
+};
+
+struct dns_view {
+    const uchar              *buf;
+    size_t                    len;
+    ///entries of section s are rr[first[s]] up to rr[first[s + 1]]
+    u16_t   first[DNS_SECTIONS + 1];
+    struct dns_view_rr rr[VIEW_RR_LIMIT];
+};
+
+static inline
+u16_t dns_view_u16(const uchar *p)
+{
+    return (u16_t) ((p[0] << 8) | p[1]);
+}
+
+static inline
+u32_t dns_view_u32(const uchar *p)
+{
+    return ((u32_t) p[0] << 24) | ((u32_t) p[1] << 16) | ((u32_t) p[2] << 8) | p[3];
+}
+
+/**
+ * Index the message of @len bytes in @buf.
+ *
+ * @return 0, -1 if the message is cut short, a name is malformed, a record
+ *         runs past the end or there are too many records
+ */
+static inline
+int dns_view_parse(struct dns_view *v, const uchar *buf, size_t len)
+{
+    size_t off = sizeof(DNS_HEADER_t);
+    unsigned int n = 0;
+
+    v->buf = buf;
+    v->len = len;
+    if(len < sizeof(DNS_HEADER_t))
+        return -1;
+
+    for(int s = DNS_QUESTION; s < DNS_SECTIONS; s++)
+    {
+        u16_t count = dns_view_u16(buf + 4 + 2 * s);
+
+        v->first[s] = (u16_t) n;
+        if(count > VIEW_RR_LIMIT - n)
+            return -1;
+
+        for(; count > 0; count--, n++)
+        {
+            ssize_t end = dns_name_skip(buf, len, off);
+
+            if(end < 0)
+                return -1;
+            v->rr[n].name = (u16_t) off;
+            v->rr[n].fixed = (u16_t) end;
+            off = (size_t) end;
+
+            if(s == DNS_QUESTION)
+                off += sizeof(DNS_QUESTION_t);
+            else if(off + sizeof(RR_t) <= len)
+                off += sizeof(RR_t) + dns_view_u16(buf + off + 8);
+            else
+                return -1;
+
+            if(off > len)
+                return -1;
+        }
+    }
+    v->first[DNS_SECTIONS] = (u16_t) n;
+
+    return 0;
+}
+
+///QDCOUNT 1, ANCOUNT 0, NSCOUNT 0, ARCOUNT 0 or 1: the counts as one word
+#define VIEW_FAST_COUNTS 0x0001000000000000ULL
+#define VIEW_FAST_MASK   (~1ULL)
+
+/**
+ * Index the message of @len bytes in @buf if it has the shape of a plain
+ * query: its four counts are checked by one masked compare, the question
+ * name is found by one scan of its labels, which may not be compressed,
+ * and the additional record, if any, is owned by the root.
+ *
+ * @return 0, -1 if the message has another shape or is malformed; it is
+ *         then left to dns_view_parse()
+ */
+static inline
+int dns_view_fast(struct dns_view *v, const uchar *buf, size_t len)
+{
+    size_t off = sizeof(DNS_HEADER_t), qend;
+    u64_t counts;
+
+    if(len < sizeof(DNS_HEADER_t) + 1 + sizeof(DNS_QUESTION_t))
+        return -1;
+    memcpy(&counts, buf + 4, sizeof(counts));
+    counts = be64toh(counts);
+    if((counts & VIEW_FAST_MASK) != VIEW_FAST_COUNTS)
+        return -1;
+
+    ///room for the QTYPE and QCLASS behind the root label is checked once
+    while(buf[off] != 0)
+    {
+        if(buf[off] > LABEL_LIMIT)
+            return -1;
+        off += 1 + buf[off];
+        if(off + 1 + sizeof(DNS_QUESTION_t) > len || off - sizeof(DNS_HEADER_t) >= NAME_LIMIT)
+            return -1;
+    }
+    qend = off + 1 + sizeof(DNS_QUESTION_t);
+
+    v->buf = buf;
+    v->len = len;
+    v->first[DNS_QUESTION] = 0;
+    v->first[DNS_ANSWER] = v->first[DNS_AUTHORITY] = v->first[DNS_ADDITIONAL] = 1;
+    v->rr[0].name = sizeof(DNS_HEADER_t);
+    v->rr[0].fixed = (u16_t) (off + 1);
+
+    if(counts & 1) {
+        if(qend + 1 + sizeof(RR_t) > len || buf[qend] != 0 ||
+           qend + 1 + sizeof(RR_t) + dns_view_u16(buf + qend + 9) > len)
+            return -1;
+        v->rr[1].name = (u16_t) qend;
+        v->rr[1].fixed = (u16_t) (qend + 1);
+    }
+    v->first[DNS_SECTIONS] = (u16_t) (1 + (counts & 1));
+
+    return 0;
+}
+
+///index the query of @len bytes in @buf, on the fast path if it can be
+static inline
+int dns_view_parse_query(struct dns_view *v, const uchar *buf, size_t len)
+{
+    if(dns_view_fast(v, buf, len) == 0)
+        return 0;
+    return dns_view_parse(v, buf, len);
+}
+
+#define dns_view_header(v) ((const DNS_HEADER_t *) (v)->buf)
+
+static inline
+unsigned int dns_view_count(const struct dns_view *v, int section)
+{
+    return v->first[section + 1] - v->first[section];
+}
+
+///entry @i of @section, which must be below dns_view_count()
+static inline
+const struct dns_view_rr *dns_view_rr(const struct dns_view *v, int section, unsigned int i)
+{
+    return &v->rr[v->first[section] + i];
+}
+
+///owner name, possibly compressed; dns_to_host_name() expands it
+static inline
+const uchar *dns_view_name(const struct dns_view *v, int section, unsigned int i)
+{
+    return v->buf + dns_view_rr(v, section, i)->name;
+}
+
+///TYPE of a record, QTYPE of a question
+static inline
+u16_t dns_view_type(const struct dns_view *v, int section, unsigned int i)
+{
+    return dns_view_u16(v->buf + dns_view_rr(v, section, i)->fixed);
+}
+
+static inline
+u16_t dns_view_class(const struct dns_view *v, int section, unsigned int i)
+{
+    return dns_view_u16(v->buf + dns_view_rr(v, section, i)->fixed + 2);
+}
+
+///the fields below do not exist for questions
+static inline
+u32_t dns_view_ttl(const struct dns_view *v, int section, unsigned int i)
+{
+    return dns_view_u32(v->buf + dns_view_rr(v, section, i)->fixed + 4);
+}
+
+static inline
+u16_t dns_view_rdlength(const struct dns_view *v, int section, unsigned int i)
+{
+    return dns_view_u16(v->buf + dns_view_rr(v, section, i)->fixed + 8);
+}
+
+static inline
+const uchar *dns_view_rdata(const struct dns_view *v, int section, unsigned int i)
+{
+    return v->buf + dns_view_rr(v, section, i)->fixed + sizeof(RR_t);
+}
+
+///end of the question section
+static inline
+size_t dns_view_qend(const struct dns_view *v)
+{
+    unsigned int n = dns_view_count(v, DNS_QUESTION);
+
+    return n ? dns_view_rr(v, DNS_QUESTION, n - 1)->fixed + sizeof(DNS_QUESTION_t)
+             : sizeof(DNS_HEADER_t);
+}
+
+#endif ///MSG_VIEW_H
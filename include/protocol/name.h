@@ -0,0 +1,289 @@
+#ifndef NAME_H
+#define NAME_H
+
+#include <string.h>
+#include <stdbool.h>
+#include <sys/types.h>
+#include "type.h"
+#include "limit.h"
+#include "core/dns_case.h"
+
+/**
+ * **Name decoder**
+ *
+ * dns_name_decode() expands the possibly compressed name at an offset of
+ * a message, either into presentation text, into a lookup key or into the
+ * uncompressed wire name as it was sent.
+ *
+ * Every pointer must point strictly before the run of labels it ends, so
+ * any chain of them is followed and still terminates: a loop, a pointer to
+ * itself or a forward pointer is rejected. Labels are bounded by
+ * LABEL_LIMIT, the expanded wire name by NAME_LIMIT, and nothing is read
+ * past the message.
+ *
+ * Labels are copied a vector at a time: one SSE2 vector for a label of up
+ * to 16 bytes, AVX2 for longer ones when the CPU has it, the kernel being
+ * picked once at startup. The case of a key is folded by the kernels of
+ * dns_case.h, byte compares find the bytes of a text label which need an
+ * escape. Labels near the end of the message or of the output, and every
+ * label on targets without SSE2, are copied byte by byte.
+ */
+enum {
+    NAME_TEXT,  ///"www.sri.com", "." for the root; RFC 1035 5.1 escapes
+    NAME_KEY,   ///uncompressed wire name in lower case, root label included
+    NAME_WIRE,  ///the same, case kept
+};
+
+///longest text: every byte of the longest name escaped as \DDD
+#define NAME_TEXT_LIMIT (NAME_LIMIT * 4)
+
+///bytes a text label spends on @ch
+static inline
+unsigned int dns_name_escape(uchar ch)
+{
+    if(ch == '.' || ch == '\\')
+        return 2;
+    return (ch < '!' || ch > '~') ? 4 : 1;
+}
+
+/**
+ * Copy the @n bytes of one label from @src to @dst, one byte at a time.
+ *
+ * @return bytes written, -1 if more than @room
+ */
+static inline
+ssize_t dns_label_copy(uchar *dst, size_t room, const uchar *src, unsigned int n, int form)
+{
+    size_t w = 0;
+
+    if(form != NAME_TEXT) {
+        if(n > room)
+            return -1;
+        if(form == NAME_WIRE)
+            memcpy(dst, src, n);
+        else
+            for(unsigned int i = 0; i < n; i++)
+                dst[i] = dns_case_fold(src[i]);
+        return n;
+    }
+
+    for(unsigned int i = 0; i < n; i++)
+    {
+        uchar ch = src[i];
+        unsigned int e = dns_name_escape(ch);
+
+        if(w + e > room)
+            return -1;
+        if(e == 1)
+            dst[w] = ch;
+        else if(e == 2) {
+            dst[w] = '\\';
+            dst[w + 1] = ch;
+        }
+        else {
+            dst[w] = '\\';
+            dst[w + 1] = '0' + ch / 100;
+            dst[w + 2] = '0' + ch / 10 % 10;
+            dst[w + 3] = '0' + ch % 10;
+        }
+        w += e;
+    }
+
+    return w;
+}
+
+#if defined(__SSE2__)
+#define NAME_VEC_SSE2  16
+#define NAME_VEC_AVX2  32
+#define name_vec_round(n, v) (((n) + (v) - 1) & ~(size_t) ((v) - 1))
+
+/**
+ * Copy the @n bytes of one label a vector at a time. Whole vectors are
+ * loaded and stored: @src is readable and @dst writable up to @n rounded
+ * up to the vector size.
+ *
+ * @return false if a text label holds a byte which needs an escape; what
+ *         was stored is then garbage and the label is copied again bytewise
+ */
+static inline
+bool dns_label_copy_sse2(uchar *dst, const uchar *src, unsigned int n, int form)
+{
+    const __m128i bang = _mm_set1_epi8('!'), del = _mm_set1_epi8(0x7f);
+    const __m128i dot = _mm_set1_epi8('.'), bslash = _mm_set1_epi8('\\');
+
+    for(unsigned int i = 0; i < n; i += NAME_VEC_SSE2)
+    {
+        __m128i c = _mm_loadu_si128((const __m128i *) (src + i));
+
+        if(form == NAME_KEY)
+            c = dns_case_fold_sse2(c);
+        else if(form == NAME_TEXT) {
+            ///signed compare: controls, space and every byte from 0x80
+            __m128i bad = _mm_or_si128(_mm_cmplt_epi8(c, bang), _mm_cmpeq_epi8(c, del));
+            unsigned int mask;
+
+            bad = _mm_or_si128(bad, _mm_cmpeq_epi8(c, dot));
+            bad = _mm_or_si128(bad, _mm_cmpeq_epi8(c, bslash));
+            mask = (unsigned int) _mm_movemask_epi8(bad);
+            if(n - i < NAME_VEC_SSE2)
+                mask &= (1u << (n - i)) - 1;
+            if(mask)
+                return false;
+        }
+        _mm_storeu_si128((__m128i *) (dst + i), c);
+    }
+
+    return true;
+}
+
+__attribute__((target("avx2")))
+static inline
+bool dns_label_copy_avx2(uchar *dst, const uchar *src, unsigned int n, int form)
+{
+    const __m256i bang = _mm256_set1_epi8('!'), del = _mm256_set1_epi8(0x7f);
+    const __m256i dot = _mm256_set1_epi8('.'), bslash = _mm256_set1_epi8('\\');
+
+    for(unsigned int i = 0; i < n; i += NAME_VEC_AVX2)
+    {
+        __m256i c = _mm256_loadu_si256((const __m256i *) (src + i));
+
+        if(form == NAME_KEY)
+            c = dns_case_fold_avx2(c);
+        else if(form == NAME_TEXT) {
+            __m256i bad = _mm256_or_si256(_mm256_cmpgt_epi8(bang, c), _mm256_cmpeq_epi8(c, del));
+            u32_t mask;
+
+            bad = _mm256_or_si256(bad, _mm256_cmpeq_epi8(c, dot));
+            bad = _mm256_or_si256(bad, _mm256_cmpeq_epi8(c, bslash));
+            mask = (u32_t) _mm256_movemask_epi8(bad);
+            if(n - i < NAME_VEC_AVX2)
+                mask &= (1u << (n - i)) - 1;
+            if(mask)
+                return false;
+        }
+        _mm256_storeu_si256((__m256i *) (dst + i), c);
+    }
+
+    return true;
+}
+
+///copier of labels longer than a SSE2 vector, picked by dns_name_init()
+static bool (*dns_label_copy_long)(uchar *dst, const uchar *src, unsigned int n, int form)
+        = dns_label_copy_sse2;
+static size_t dns_label_vec_long = NAME_VEC_SSE2;
+
+__attribute__((constructor))
+static void dns_name_init(void)
+{
+    __builtin_cpu_init();
+    if(__builtin_cpu_supports("avx2")) {
+        dns_label_copy_long = dns_label_copy_avx2;
+        dns_label_vec_long = NAME_VEC_AVX2;
+    }
+}
+#endif ///__SSE2__
+
+/**
+ * Expand the name at @off of the @len byte message @buf into @out, which
+ * holds @cap bytes: NAME_LIMIT for a NAME_KEY or NAME_WIRE, NAME_TEXT_LIMIT
+ * for any NAME_TEXT. Text is NUL terminated.
+ *
+ * @end, if not NULL, is set to the offset right behind the name where it
+ * is written in the message, that is behind its first pointer.
+ *
+ * @return bytes written, NUL excluded; -1 if the name is malformed, loops,
+ *         runs past @len, exceeds LABEL_LIMIT or NAME_LIMIT, or @out is full
+ */
+static inline
+ssize_t dns_name_decode(const uchar *buf, size_t len, size_t off,
+        uchar *out, size_t cap, int form, size_t *end)
+{
+    size_t run = off;       ///start of the labels being read
+    size_t wire = 0;        ///length of the expanded wire name
+    size_t w = 0;
+    bool jumped = false;
+
+    for(;;)
+    {
+        uchar l;
+
+        if(off >= len)
+            return -1;
+        l = buf[off];
+
+        if((l & 0xC0) == 0xC0) {
+            size_t target;
+
+            if(off + 1 >= len)
+                return -1;
+            target = ((size_t) (l & 0x3F) << 8) | buf[off + 1];
+            if(target >= run)
+                return -1;
+            if(!jumped && end)
+                *end = off + 2;
+            jumped = true;
+            off = run = target;
+            continue;
+        }
+        if(l > LABEL_LIMIT)         ///0x40 and 0x80 label types
+            return -1;
+
+        wire += 1 + l;
+        if(wire > NAME_LIMIT)
+            return -1;
+        if(l == 0)
+            break;
+        if(off + 1 + l > len)
+            return -1;
+
+        if(form != NAME_TEXT) {
+            if(w + 1 >= cap)
+                return -1;
+            out[w++] = l;
+        }
+        else if(w) {
+            if(w + 1 >= cap)
+                return -1;
+            out[w++] = '.';
+        }
+
+        ssize_t n = -1;
+#if defined(__SSE2__)
+        bool small = l <= NAME_VEC_SSE2;
+        size_t span = small ? NAME_VEC_SSE2 : name_vec_round((size_t) l, dns_label_vec_long);
+
+        if(off + 1 + span <= len && w + span < cap) {
+            bool ok = small ? dns_label_copy_sse2(out + w, buf + off + 1, l, form)
+                            : dns_label_copy_long(out + w, buf + off + 1, l, form);
+
+            if(ok)
+                n = l;
+        }
+#endif
+        ///a NUL or the root label is still to come
+        if(n < 0 && (n = dns_label_copy(out + w, cap - w - 1, buf + off + 1, l, form)) < 0)
+            return -1;
+        w += n;
+        off += 1 + l;
+    }
+
+    if(!jumped && end)
+        *end = off + 1;
+
+    if(form != NAME_TEXT) {
+        if(w >= cap)
+            return -1;
+        out[w++] = 0;
+        return w;
+    }
+
+    if(w == 0) {
+        if(cap < 2)
+            return -1;
+        out[w++] = '.';
+    }
+    out[w] = '\0';
+    return w;
+}
+
+#endif ///NAME_H
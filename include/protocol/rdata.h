@@ -0,0 +1,955 @@
+#ifndef RDATA_H
+#define RDATA_H
+
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+#include <strings.h>
+#include <stdbool.h>
+#include <sys/types.h>
+#include <arpa/inet.h>
+#include "type.h"
+#include "limit.h"
+#include "message.h"
+#include "compress.h"
+#include "name.h"
+
+/**
+ * **RDATA codecs**
+ *
+ * One entry of dns_rdata_table per type of std_rr.h, each working on the
+ * RDATA as a zone keeps it: the uncompressed wire form, names in the case
+ * they were given. An entry knows
+ *
+ *   - names:   where the names are, checking the format on the way
+ *   - decode:  expand the RDATA of a message, its names maybe compressed
+ *   - encode:  write it into a message, names compressed (RFC 1035 types)
+ *   - compare: canonical order of RFC 4034 6.3, names in lower case
+ *   - print:   master file text of RFC 1035 5.1, NUL terminated
+ *   - size:    bytes print() needs at most, NUL included
+ *   - scan:    the master file text back into RDATA, names relative to an
+ *              origin; the loader of core/zone_file.h splits the fields
+ *
+ * so handling a record is one indirect call through dns_rdata(type), and a
+ * type is added with a table entry, without touching any switch. Types
+ * without an entry are opaque: copied as they are, compared as octets and
+ * printed in the generic form of RFC 3597.
+ */
+#define RDATA_NAMES     2   ///names in the RDATA of one record at most
+///longest RDATA holding names: MX preference or SOA counters around them
+#define RDATA_NAMED_LIMIT (RDATA_NAMES * NAME_LIMIT + 5 * sizeof(u32_t))
+
+///one field of master file text, pointing into the text; quotes left out
+struct rdata_token {
+    const char                     *s;
+    u32_t                         len;
+    bool                       quoted;
+};
+
+struct dns_rdata_ops {
+    const char *name;   ///mnemonic, NULL for an unknown type
+    int     (*names)(const uchar *rdata, u16_t rdlen, u16_t at[RDATA_NAMES]);
+    ssize_t (*decode)(const uchar *buf, size_t len, size_t off, u16_t rdlen,
+                      uchar *out, size_t cap);
+    ssize_t (*encode)(struct dns_comp *c, uchar *buf, size_t off, size_t cap,
+                      const uchar *rdata, u16_t rdlen);
+    int     (*compare)(const uchar *a, u16_t alen, const uchar *b, u16_t blen);
+    ssize_t (*print)(char *out, size_t cap, const uchar *rdata, u16_t rdlen);
+    size_t  (*size)(const uchar *rdata, u16_t rdlen);
+    ssize_t (*scan)(const struct rdata_token *tok, unsigned int n, const uchar *origin,
+                    uchar *out, size_t cap);
+};
+
+/**
+ * Length of the uncompressed name at @p, within @n bytes.
+ *
+ * @return wire length, root label included; -1 if it is malformed, holds
+ *         a pointer or runs past @n
+ */
+static inline
+ssize_t rdata_name_len(const uchar *p, size_t n)
+{
+    size_t off = 0;
+
+    while(off < n && off < NAME_LIMIT)
+    {
+        if(p[off] > LABEL_LIMIT)
+            return -1;
+        if(p[off] == 0)
+            return (ssize_t) off + 1;
+        off += 1 + p[off];
+    }
+
+    return -1;
+}
+
+///append to the text @out of @cap bytes, @w of them used; false if full
+static inline
+bool rdata_printf(char *out, size_t cap, size_t *w, const char *fmt, ...)
+{
+    va_list ap;
+    int n;
+
+    if(*w >= cap)
+        return false;
+    va_start(ap, fmt);
+    n = vsnprintf(out + *w, cap - *w, fmt, ap);
+    va_end(ap);
+    if(n < 0 || (size_t) n >= cap - *w)
+        return false;
+    *w += n;
+
+    return true;
+}
+
+///the name at @off of @rdata, absolute: with its trailing dot
+static inline
+bool rdata_print_name(char *out, size_t cap, size_t *w, const uchar *rdata, u16_t rdlen, size_t off)
+{
+    ssize_t n;
+
+    if(*w >= cap)
+        return false;
+    n = dns_name_decode(rdata, rdlen, off, (uchar *) out + *w, cap - *w, NAME_TEXT, NULL);
+    if(n < 0)
+        return false;
+    *w += n;
+
+    ///the root is printed as "." already
+    return (n == 1 && out[*w - 1] == '.') || rdata_printf(out, cap, w, ".");
+}
+
+///the <character-string> at @p, quoted
+static inline
+bool rdata_print_string(char *out, size_t cap, size_t *w, const uchar *p)
+{
+    if(!rdata_printf(out, cap, w, "\""))
+        return false;
+    for(unsigned int i = 1; i <= p[0]; i++)
+    {
+        uchar ch = p[i];
+        bool ok;
+
+        if(ch == '"' || ch == '\\')
+            ok = rdata_printf(out, cap, w, "\\%c", ch);
+        else if(ch < ' ' || ch > '~')
+            ok = rdata_printf(out, cap, w, "\\%03u", ch);
+        else
+            ok = rdata_printf(out, cap, w, "%c", ch);
+        if(!ok)
+            return false;
+    }
+
+    return rdata_printf(out, cap, w, "\"");
+}
+
+/**
+ * The character at *@i of the text @s of @n bytes, \X and \DDD decoded,
+ * *@i stepped over it.
+ *
+ * @return the byte, -1 for a broken escape
+ */
+static inline
+int rdata_scan_char(const char *s, size_t n, size_t *i)
+{
+    size_t at = *i;
+    int v;
+
+    if(s[at] != '\\') {
+        *i = at + 1;
+        return (uchar) s[at];
+    }
+    if(at + 1 >= n)
+        return -1;
+    if(s[at + 1] < '0' || s[at + 1] > '9') {
+        *i = at + 2;
+        return (uchar) s[at + 1];
+    }
+
+    if(at + 3 >= n)
+        return -1;
+    v = 0;
+    for(size_t k = at + 1; k <= at + 3; k++)
+    {
+        if(s[k] < '0' || s[k] > '9')
+            return -1;
+        v = v * 10 + (s[k] - '0');
+    }
+    *i = at + 4;
+
+    return v > 0xff ? -1 : v;
+}
+
+/**
+ * The name of @t in the wire form, into @out of @cap bytes: "@" is
+ * @origin, a name without its trailing dot is relative to @origin.
+ *
+ * @return wire length, -1 if malformed or longer than NAME_LIMIT
+ */
+static inline
+ssize_t rdata_scan_name(const struct rdata_token *t, const uchar *origin, uchar *out, size_t cap)
+{
+    size_t lim = cap < NAME_LIMIT ? cap : NAME_LIMIT, label = 0, w = 1, i = 0;
+    ssize_t olen;
+
+    if(t->quoted || t->len == 0 || lim == 0)
+        return -1;
+    if(t->len == 1 && t->s[0] == '@') {
+        if((olen = rdata_name_len(origin, NAME_LIMIT)) < 0 || (size_t) olen > lim)
+            return -1;
+        memcpy(out, origin, olen);
+        return olen;
+    }
+    if(t->len == 1 && t->s[0] == '.') {
+        out[0] = 0;
+        return 1;
+    }
+
+    while(i < t->len)
+    {
+        int ch;
+
+        if(t->s[i] == '.') {
+            if(w == label + 1)
+                return -1;
+            out[label] = (uchar) (w - label - 1);
+            label = w++;
+            ///absolute: the root closes it
+            if(++i == t->len) {
+                out[label] = 0;
+                return (ssize_t) w;
+            }
+            continue;
+        }
+        ch = t->s[i] == '\\' ? rdata_scan_char(t->s, t->len, &i) : (uchar) t->s[i++];
+        if(ch < 0 || w - label - 1 == LABEL_LIMIT || w + 1 >= lim)
+            return -1;
+        out[w++] = (uchar) ch;
+    }
+    out[label] = (uchar) (w - label - 1);
+
+    if((olen = rdata_name_len(origin, NAME_LIMIT)) < 0 || w + olen > lim)
+        return -1;
+    memcpy(out + w, origin, olen);
+
+    return (ssize_t) w + olen;
+}
+
+///the decimal number of @t up to @max
+static inline
+bool rdata_scan_number(const struct rdata_token *t, u32_t max, u32_t *v)
+{
+    u64_t n = 0;
+
+    if(t->quoted || t->len == 0)
+        return false;
+    for(size_t i = 0; i < t->len; i++)
+    {
+        if(t->s[i] < '0' || t->s[i] > '9')
+            return false;
+        n = n * 10 + (t->s[i] - '0');
+        if(n > max)
+            return false;
+    }
+    *v = (u32_t) n;
+
+    return true;
+}
+
+///seconds of @t, a number or one with units as 1h30m: s, m, h, d and w
+static inline
+bool rdata_scan_ttl(const struct rdata_token *t, u32_t *v)
+{
+    u64_t total = 0;
+    size_t i = 0;
+
+    if(t->quoted || t->len == 0)
+        return false;
+    while(i < t->len)
+    {
+        u64_t n = 0, unit = 1;
+
+        if(t->s[i] < '0' || t->s[i] > '9')
+            return false;
+        for(; i < t->len && t->s[i] >= '0' && t->s[i] <= '9'; i++)
+            if((n = n * 10 + (t->s[i] - '0')) > UINT32_MAX)
+                return false;
+        if(i < t->len) {
+            switch(t->s[i++] | 0x20) {
+                case 's': unit = 1; break;
+                case 'm': unit = 60; break;
+                case 'h': unit = 3600; break;
+                case 'd': unit = 86400; break;
+                case 'w': unit = 604800; break;
+                default: return false;
+            }
+        }
+        if((total += n * unit) > UINT32_MAX)
+            return false;
+    }
+    *v = (u32_t) total;
+
+    return true;
+}
+
+///@t as a <character-string> into @out, its length octet first
+static inline
+ssize_t rdata_scan_string(const struct rdata_token *t, uchar *out, size_t cap)
+{
+    size_t lim = cap < 0x100 ? cap : 0x100, w = 1, i = 0;
+
+    if(lim == 0)
+        return -1;
+    while(i < t->len)
+    {
+        ///the bytes up to the next escape as they are
+        const char *esc = memchr(t->s + i, '\\', t->len - i);
+        size_t run = (esc ? (size_t) (esc - t->s) : t->len) - i;
+        int ch;
+
+        if(w + run > lim)
+            return -1;
+        memcpy(out + w, t->s + i, run);
+        w += run, i += run;
+        if(!esc)
+            break;
+        if((ch = rdata_scan_char(t->s, t->len, &i)) < 0 || w == lim)
+            return -1;
+        out[w++] = (uchar) ch;
+    }
+    out[0] = (uchar) (w - 1);
+
+    return (ssize_t) w;
+}
+
+///a field spelled @word, in any case
+static inline
+bool rdata_token_is(const struct rdata_token *t, const char *word)
+{
+    return !t->quoted && strlen(word) == t->len && !strncasecmp(t->s, word, t->len);
+}
+
+static inline
+int rdata_hex(char ch)
+{
+    if(ch >= '0' && ch <= '9')
+        return ch - '0';
+    ch |= 0x20;
+    return ch >= 'a' && ch <= 'f' ? ch - 'a' + 10 : -1;
+}
+
+/**
+ * The generic form of RFC 3597 behind its "\#": a length, then the RDATA
+ * in hex, in as many fields as it likes.
+ */
+static inline
+ssize_t rdata_scan_generic(const struct rdata_token *tok, unsigned int n, uchar *out, size_t cap)
+{
+    u32_t len;
+    size_t w = 0;
+
+    if(n == 0 || !rdata_scan_number(&tok[0], 0xffff, &len) || len > cap)
+        return -1;
+    for(unsigned int k = 1; k < n; k++)
+    {
+        if(tok[k].quoted || tok[k].len % 2)
+            return -1;
+        for(size_t i = 0; i < tok[k].len; i += 2)
+        {
+            int hi = rdata_hex(tok[k].s[i]), lo = rdata_hex(tok[k].s[i + 1]);
+
+            if(hi < 0 || lo < 0 || w == len)
+                return -1;
+            out[w++] = (uchar) (hi << 4 | lo);
+        }
+    }
+
+    return w == len ? (ssize_t) w : -1;
+}
+
+static inline
+int rdata_octets_compare(const uchar *a, u16_t alen, const uchar *b, u16_t blen)
+{
+    int d = memcmp(a, b, alen < blen ? alen : blen);
+
+    if(d)
+        return d;
+    return (alen > blen) - (alen < blen);
+}
+
+/**
+ * Layouts holding names: @pre bytes, @nnames names, @post bytes; every
+ * type of RFC 1035 whose names may be compressed is one of them.
+ */
+static inline
+int rdata_layout_names(const uchar *rdata, u16_t rdlen, u16_t at[RDATA_NAMES],
+                       size_t pre, int nnames, size_t post)
+{
+    size_t off = pre;
+
+    if(rdlen < pre)
+        return -1;
+    for(int i = 0; i < nnames; i++)
+    {
+        ssize_t n = rdata_name_len(rdata + off, rdlen - off);
+
+        if(n < 0)
+            return -1;
+        at[i] = (u16_t) off;
+        off += n;
+    }
+
+    return off + post == rdlen ? nnames : -1;
+}
+
+static inline
+ssize_t rdata_layout_decode(const uchar *buf, size_t len, size_t off, u16_t rdlen,
+                            uchar *out, size_t cap, size_t pre, int nnames, size_t post)
+{
+    size_t end = off + rdlen, w = pre;
+
+    if(end > len || rdlen < pre || cap < pre)
+        return -1;
+    memcpy(out, buf + off, pre);
+    off += pre;
+
+    ///a name may point anywhere before it, but not past the RDATA
+    for(int i = 0; i < nnames; i++)
+    {
+        ssize_t n = dns_name_decode(buf, end, off, out + w, cap - w, NAME_WIRE, &off);
+
+        if(n < 0)
+            return -1;
+        w += n;
+    }
+    if(end - off != post || w + post > cap)
+        return -1;
+    memcpy(out + w, buf + off, post);
+
+    return (ssize_t) (w + post);
+}
+
+static inline
+ssize_t rdata_layout_encode(struct dns_comp *c, uchar *buf, size_t off, size_t cap,
+                            const uchar *rdata, u16_t rdlen, size_t pre, int nnames, size_t post)
+{
+    u16_t at[RDATA_NAMES];
+    size_t w = off, p = 0;
+
+    if(rdata_layout_names(rdata, rdlen, at, pre, nnames, post) < 0)
+        return -1;
+
+    ///the bytes up to each name, the name, the rest
+    for(int i = 0; i < nnames; i++)
+    {
+        ssize_t n;
+
+        if(w + (at[i] - p) > cap)
+            return -1;
+        memcpy(buf + w, rdata + p, at[i] - p);
+        w += at[i] - p;
+        if((n = dns_comp_put(c, buf, w, cap, rdata + at[i])) < 0)
+            return -1;
+        w += n;
+        p = at[i] + rdata_name_len(rdata + at[i], rdlen - at[i]);
+    }
+    if(w + (rdlen - p) > cap)
+        return -1;
+    memcpy(buf + w, rdata + p, rdlen - p);
+    w += rdlen - p;
+
+    return (ssize_t) (w - off);
+}
+
+///@rdata in the canonical form of RFC 4034 6.2, names in lower case
+static inline
+bool rdata_layout_canon(uchar *dst, const uchar *rdata, u16_t rdlen,
+                        size_t pre, int nnames, size_t post)
+{
+    u16_t at[RDATA_NAMES];
+
+    if(rdlen > RDATA_NAMED_LIMIT || rdata_layout_names(rdata, rdlen, at, pre, nnames, post) < 0)
+        return false;
+    memcpy(dst, rdata, rdlen);
+    for(int i = 0; i < nnames; i++)
+        for(size_t k = at[i]; dst[k]; k += 1 + dst[k])
+            for(unsigned int j = 1; j <= dst[k]; j++)
+                dst[k + j] = dns_case_fold(dst[k + j]);
+
+    return true;
+}
+
+static inline
+int rdata_layout_compare(const uchar *a, u16_t alen, const uchar *b, u16_t blen,
+                         size_t pre, int nnames, size_t post)
+{
+    uchar ca[RDATA_NAMED_LIMIT], cb[RDATA_NAMED_LIMIT];
+
+    if(!rdata_layout_canon(ca, a, alen, pre, nnames, post) ||
+       !rdata_layout_canon(cb, b, blen, pre, nnames, post))
+        return rdata_octets_compare(a, alen, b, blen);
+
+    return rdata_octets_compare(ca, alen, cb, blen);
+}
+
+///preference, names, counters
+static inline
+ssize_t rdata_layout_print(char *out, size_t cap, const uchar *rdata, u16_t rdlen,
+                           size_t pre, int nnames, size_t post)
+{
+    u16_t at[RDATA_NAMES];
+    size_t w = 0;
+
+    if(rdata_layout_names(rdata, rdlen, at, pre, nnames, post) < 0)
+        return -1;
+    if(pre && !rdata_printf(out, cap, &w, "%u ", (rdata[0] << 8) | rdata[1]))
+        return -1;
+    for(int i = 0; i < nnames; i++)
+        if((i && !rdata_printf(out, cap, &w, " ")) || !rdata_print_name(out, cap, &w, rdata, rdlen, at[i]))
+            return -1;
+    for(size_t p = rdlen - post; p < rdlen; p += sizeof(u32_t))
+    {
+        u32_t v = ((u32_t) rdata[p] << 24) | (rdata[p + 1] << 16) | (rdata[p + 2] << 8) | rdata[p + 3];
+
+        if(!rdata_printf(out, cap, &w, " %u", v))
+            return -1;
+    }
+
+    return (ssize_t) w;
+}
+
+///each byte of a name is \DDD at worst, numbers are short
+static inline
+size_t rdata_layout_size(const uchar *rdata, u16_t rdlen)
+{
+    return 4 * (size_t) rdlen + 64;
+}
+
+/**
+ * A preference, names, counters: the fields in the order of the RDATA.
+ * The first counter, the SOA serial, is a plain number, the others are
+ * times and may have units.
+ */
+static inline
+ssize_t rdata_layout_scan(const struct rdata_token *tok, unsigned int n, const uchar *origin,
+                          uchar *out, size_t cap, size_t pre, int nnames, size_t post)
+{
+    unsigned int k = 0;
+    size_t w = 0;
+    u32_t v;
+
+    if(n != (pre ? 1 : 0) + nnames + post / sizeof(u32_t) || cap < pre + post)
+        return -1;
+    if(pre) {
+        if(!rdata_scan_number(&tok[k++], 0xffff, &v))
+            return -1;
+        out[w++] = (uchar) (v >> 8), out[w++] = (uchar) v;
+    }
+    for(int i = 0; i < nnames; i++)
+    {
+        ssize_t len = rdata_scan_name(&tok[k++], origin, out + w, cap - post - w);
+
+        if(len < 0)
+            return -1;
+        w += len;
+    }
+    for(size_t p = 0; p < post; p += sizeof(u32_t), k++)
+    {
+        if(!(p ? rdata_scan_ttl(&tok[k], &v) : rdata_scan_number(&tok[k], UINT32_MAX, &v)))
+            return -1;
+        out[w++] = (uchar) (v >> 24), out[w++] = (uchar) (v >> 16);
+        out[w++] = (uchar) (v >> 8), out[w++] = (uchar) v;
+    }
+
+    return (ssize_t) w;
+}
+
+#define RDATA_LAYOUT(kind, pre, nnames, post)                                               \
+static inline                                                                               \
+int rdata_##kind##_names(const uchar *rdata, u16_t rdlen, u16_t at[RDATA_NAMES])            \
+{ return rdata_layout_names(rdata, rdlen, at, pre, nnames, post); }                         \
+static inline                                                                               \
+ssize_t rdata_##kind##_decode(const uchar *buf, size_t len, size_t off, u16_t rdlen,        \
+                              uchar *out, size_t cap)                                       \
+{ return rdata_layout_decode(buf, len, off, rdlen, out, cap, pre, nnames, post); }          \
+static inline                                                                               \
+ssize_t rdata_##kind##_encode(struct dns_comp *c, uchar *buf, size_t off, size_t cap,       \
+                              const uchar *rdata, u16_t rdlen)                              \
+{ return rdata_layout_encode(c, buf, off, cap, rdata, rdlen, pre, nnames, post); }          \
+static inline                                                                               \
+int rdata_##kind##_compare(const uchar *a, u16_t alen, const uchar *b, u16_t blen)          \
+{ return rdata_layout_compare(a, alen, b, blen, pre, nnames, post); }                       \
+static inline                                                                               \
+ssize_t rdata_##kind##_print(char *out, size_t cap, const uchar *rdata, u16_t rdlen)        \
+{ return rdata_layout_print(out, cap, rdata, rdlen, pre, nnames, post); }                   \
+static inline                                                                               \
+size_t rdata_##kind##_size(const uchar *rdata, u16_t rdlen)                                 \
+{ return rdata_layout_size(rdata, rdlen); }                                                 \
+static inline                                                                               \
+ssize_t rdata_##kind##_scan(const struct rdata_token *tok, unsigned int n,                  \
+                            const uchar *origin, uchar *out, size_t cap)                    \
+{ return rdata_layout_scan(tok, n, origin, out, cap, pre, nnames, post); }
+
+///NS, MD, MF, CNAME, MB, MG, MR, PTR
+RDATA_LAYOUT(name,  0, 1, 0)
+RDATA_LAYOUT(soa,   0, 2, 5 * sizeof(u32_t))
+RDATA_LAYOUT(minfo, 0, 2, 0)
+RDATA_LAYOUT(mx,    sizeof(u16_t), 1, 0)
+
+/**
+ * Flat types, without names: rdata_<kind>_names() checks the format and
+ * the RDATA is copied as it is.
+ */
+static inline
+int rdata_a_names(const uchar *rdata, u16_t rdlen, u16_t at[RDATA_NAMES])
+{
+    return rdlen == sizeof(A_t) ? 0 : -1;
+}
+
+static inline
+ssize_t rdata_a_print(char *out, size_t cap, const uchar *rdata, u16_t rdlen)
+{
+    if(rdlen != sizeof(A_t) || !inet_ntop(AF_INET, rdata, out, cap))
+        return -1;
+    return (ssize_t) strlen(out);
+}
+
+static inline
+size_t rdata_a_size(const uchar *rdata, u16_t rdlen)
+{
+    return INET_ADDRSTRLEN;
+}
+
+///the dotted quad of @t, in network order
+static inline
+bool rdata_scan_addr(const struct rdata_token *t, uchar *out)
+{
+    unsigned int part = 0, digits = 0, v = 0;
+
+    if(t->quoted)
+        return false;
+    for(size_t i = 0; i < t->len; i++)
+    {
+        char ch = t->s[i];
+
+        if(ch >= '0' && ch <= '9' && digits < 3) {
+            v = v * 10 + (ch - '0');
+            digits++;
+        }
+        else if(ch == '.' && digits && v <= 0xff && part < 3) {
+            out[part++] = (uchar) v;
+            digits = v = 0;
+        }
+        else
+            return false;
+    }
+    if(part != 3 || !digits || v > 0xff)
+        return false;
+    out[3] = (uchar) v;
+
+    return true;
+}
+
+static inline
+ssize_t rdata_a_scan(const struct rdata_token *tok, unsigned int n, const uchar *origin,
+                     uchar *out, size_t cap)
+{
+    if(n != 1 || cap < sizeof(A_t) || !rdata_scan_addr(&tok[0], out))
+        return -1;
+    return sizeof(A_t);
+}
+
+///@min to @max <character-string>s filling the RDATA
+static inline
+int rdata_strings(const uchar *rdata, u16_t rdlen, unsigned int min, unsigned int max)
+{
+    unsigned int n = 0;
+    size_t off;
+
+    for(off = 0; off < rdlen; off += 1 + rdata[off])
+        n++;
+
+    return off == rdlen && n >= min && n <= max ? 0 : -1;
+}
+
+static inline
+ssize_t rdata_strings_print(char *out, size_t cap, const uchar *rdata, u16_t rdlen)
+{
+    size_t w = 0;
+
+    for(size_t off = 0; off < rdlen; off += 1 + rdata[off])
+        if((off && !rdata_printf(out, cap, &w, " ")) || !rdata_print_string(out, cap, &w, rdata + off))
+            return -1;
+    if(w == 0 && cap)
+        out[0] = '\0';
+
+    return (ssize_t) w;
+}
+
+///quotes and a space for a length octet, \DDD for each byte
+static inline
+size_t rdata_strings_size(const uchar *rdata, u16_t rdlen)
+{
+    return 4 * (size_t) rdlen + 1;
+}
+
+///@n fields of text, quoted or not, one <character-string> each
+static inline
+ssize_t rdata_strings_scan(const struct rdata_token *tok, unsigned int n, uchar *out, size_t cap)
+{
+    size_t w = 0;
+
+    for(unsigned int k = 0; k < n; k++)
+    {
+        ssize_t len = rdata_scan_string(&tok[k], out + w, cap - w);
+
+        if(len < 0 || w + len > 0xffff)
+            return -1;
+        w += len;
+    }
+
+    return (ssize_t) w;
+}
+
+static inline
+int rdata_hinfo_names(const uchar *rdata, u16_t rdlen, u16_t at[RDATA_NAMES])
+{
+    return rdata_strings(rdata, rdlen, 2, 2);
+}
+
+static inline
+ssize_t rdata_hinfo_print(char *out, size_t cap, const uchar *rdata, u16_t rdlen)
+{
+    return rdata_hinfo_names(rdata, rdlen, NULL) < 0 ? -1 : rdata_strings_print(out, cap, rdata, rdlen);
+}
+
+#define rdata_hinfo_size rdata_strings_size
+
+static inline
+ssize_t rdata_hinfo_scan(const struct rdata_token *tok, unsigned int n, const uchar *origin,
+                         uchar *out, size_t cap)
+{
+    return n == 2 ? rdata_strings_scan(tok, n, out, cap) : -1;
+}
+
+static inline
+int rdata_txt_names(const uchar *rdata, u16_t rdlen, u16_t at[RDATA_NAMES])
+{
+    return rdata_strings(rdata, rdlen, 1, rdlen);
+}
+
+static inline
+ssize_t rdata_txt_print(char *out, size_t cap, const uchar *rdata, u16_t rdlen)
+{
+    return rdata_txt_names(rdata, rdlen, NULL) < 0 ? -1 : rdata_strings_print(out, cap, rdata, rdlen);
+}
+
+#define rdata_txt_size rdata_strings_size
+
+static inline
+ssize_t rdata_txt_scan(const struct rdata_token *tok, unsigned int n, const uchar *origin,
+                       uchar *out, size_t cap)
+{
+    return n >= 1 ? rdata_strings_scan(tok, n, out, cap) : -1;
+}
+
+static inline
+int rdata_wks_names(const uchar *rdata, u16_t rdlen, u16_t at[RDATA_NAMES])
+{
+    return rdlen >= offsetof(WKS_t, bmap) ? 0 : -1;
+}
+
+///address, protocol, then the number of every port in the bit map
+static inline
+ssize_t rdata_wks_print(char *out, size_t cap, const uchar *rdata, u16_t rdlen)
+{
+    const size_t bmap = offsetof(WKS_t, bmap);
+    size_t w;
+
+    if(rdlen < bmap || !inet_ntop(AF_INET, rdata, out, cap))
+        return -1;
+    w = strlen(out);
+    if(!rdata_printf(out, cap, &w, " %u", rdata[sizeof(A_t)]))
+        return -1;
+    for(size_t i = bmap; i < rdlen; i++)
+        for(unsigned int bit = 0; bit < 8; bit++)
+            if((rdata[i] & (0x80 >> bit)) &&
+               !rdata_printf(out, cap, &w, " %zu", (i - bmap) * 8 + bit))
+                return -1;
+
+    return (ssize_t) w;
+}
+
+///" 65535" per bit of the map
+static inline
+size_t rdata_wks_size(const uchar *rdata, u16_t rdlen)
+{
+    return 48 * (size_t) rdlen + INET_ADDRSTRLEN + 8;
+}
+
+///mnemonics of the protocols and services a master file may name in a WKS
+static const struct rdata_mnemonic {
+    const char *name;
+    u16_t      value;
+} rdata_wks_protocol[] = {
+    { "ICMP", 1 }, { "TCP", 6 }, { "UDP", 17 },
+}, rdata_wks_service[] = {
+    { "ECHO", 7 }, { "DISCARD", 9 }, { "DAYTIME", 13 }, { "FTP-DATA", 20 },
+    { "FTP", 21 }, { "SSH", 22 }, { "TELNET", 23 }, { "SMTP", 25 }, { "TIME", 37 },
+    { "NAMESERVER", 42 }, { "NICNAME", 43 }, { "DOMAIN", 53 }, { "TFTP", 69 },
+    { "GOPHER", 70 }, { "FINGER", 79 }, { "HTTP", 80 }, { "SUPDUP", 95 },
+    { "HOSTNAMES", 101 }, { "POP3", 110 }, { "SUNRPC", 111 }, { "AUTH", 113 },
+    { "NNTP", 119 }, { "NTP", 123 }, { "IMAP", 143 }, { "SNMP", 161 },
+    { "BGP", 179 }, { "HTTPS", 443 },
+};
+
+///@t as a number up to @max, or one of the @n mnemonics of @m
+static inline
+bool rdata_scan_mnemonic(const struct rdata_token *t, const struct rdata_mnemonic *m, size_t n,
+                         u32_t max, u32_t *v)
+{
+    if(rdata_scan_number(t, max, v))
+        return true;
+    for(size_t i = 0; i < n; i++)
+        if(rdata_token_is(t, m[i].name)) {
+            *v = m[i].value;
+            return true;
+        }
+
+    return false;
+}
+
+///address, protocol, then the services, each setting its bit of the map
+static inline
+ssize_t rdata_wks_scan(const struct rdata_token *tok, unsigned int n, const uchar *origin,
+                       uchar *out, size_t cap)
+{
+    const size_t bmap = offsetof(WKS_t, bmap);
+    size_t w = bmap;
+    u32_t v;
+
+    if(n < 2 || cap < bmap || !rdata_scan_addr(&tok[0], out) ||
+       !rdata_scan_mnemonic(&tok[1], rdata_wks_protocol, ARRAY_SIZE(rdata_wks_protocol), 0xff, &v))
+        return -1;
+    out[sizeof(A_t)] = (uchar) v;
+
+    for(unsigned int k = 2; k < n; k++)
+    {
+        size_t at;
+
+        if(!rdata_scan_mnemonic(&tok[k], rdata_wks_service, ARRAY_SIZE(rdata_wks_service), 0xffff, &v))
+            return -1;
+        at = bmap + v / 8;
+        if(at >= cap)
+            return -1;
+        for(; w <= at; w++)
+            out[w] = 0;
+        out[at] |= (uchar) (0x80 >> (v % 8));
+    }
+
+    return (ssize_t) w;
+}
+
+///NULL and every type without an entry
+static inline
+int rdata_opaque_names(const uchar *rdata, u16_t rdlen, u16_t at[RDATA_NAMES])
+{
+    return 0;
+}
+
+///\# 4 0a000001
+static inline
+ssize_t rdata_opaque_print(char *out, size_t cap, const uchar *rdata, u16_t rdlen)
+{
+    size_t w = 0;
+
+    if(!rdata_printf(out, cap, &w, "\\# %u%s", rdlen, rdlen ? " " : ""))
+        return -1;
+    for(size_t i = 0; i < rdlen; i++)
+        if(!rdata_printf(out, cap, &w, "%02x", rdata[i]))
+            return -1;
+
+    return (ssize_t) w;
+}
+
+static inline
+size_t rdata_opaque_size(const uchar *rdata, u16_t rdlen)
+{
+    return 2 * (size_t) rdlen + sizeof("\\# 65535 ");
+}
+
+///only the generic form: a leading "\#" is taken by the loader
+static inline
+ssize_t rdata_opaque_scan(const struct rdata_token *tok, unsigned int n, const uchar *origin,
+                          uchar *out, size_t cap)
+{
+    return -1;
+}
+
+#define RDATA_FLAT(kind)                                                                    \
+static inline                                                                               \
+ssize_t rdata_##kind##_decode(const uchar *buf, size_t len, size_t off, u16_t rdlen,        \
+                              uchar *out, size_t cap)                                       \
+{                                                                                           \
+    if(off + rdlen > len || rdlen > cap || rdata_##kind##_names(buf + off, rdlen, NULL) < 0)\
+        return -1;                                                                          \
+    memcpy(out, buf + off, rdlen);                                                          \
+    return rdlen;                                                                           \
+}                                                                                           \
+static inline                                                                               \
+ssize_t rdata_##kind##_encode(struct dns_comp *c, uchar *buf, size_t off, size_t cap,       \
+                              const uchar *rdata, u16_t rdlen)                              \
+{                                                                                           \
+    if(off + rdlen > cap || rdata_##kind##_names(rdata, rdlen, NULL) < 0)                   \
+        return -1;                                                                          \
+    memcpy(buf + off, rdata, rdlen);                                                        \
+    return rdlen;                                                                           \
+}                                                                                           \
+static inline                                                                               \
+int rdata_##kind##_compare(const uchar *a, u16_t alen, const uchar *b, u16_t blen)          \
+{ return rdata_octets_compare(a, alen, b, blen); }
+
+RDATA_FLAT(a)
+RDATA_FLAT(hinfo)
+RDATA_FLAT(txt)
+RDATA_FLAT(wks)
+RDATA_FLAT(opaque)
+
+#define RDATA_OPS(mnemonic, kind) {                                                         \
+    .name = mnemonic,               .names = rdata_##kind##_names,                          \
+    .decode = rdata_##kind##_decode, .encode = rdata_##kind##_encode,                       \
+    .compare = rdata_##kind##_compare, .print = rdata_##kind##_print,                       \
+    .size = rdata_##kind##_size,    .scan = rdata_##kind##_scan,                            \
+}
+
+static const struct dns_rdata_ops dns_rdata_table[_TXT + 1] = {
+    [_A]     = RDATA_OPS("A",     a),
+    [_NS]    = RDATA_OPS("NS",    name),
+    [_MD]    = RDATA_OPS("MD",    name),
+    [_MF]    = RDATA_OPS("MF",    name),
+    [_CNAME] = RDATA_OPS("CNAME", name),
+    [_SOA]   = RDATA_OPS("SOA",   soa),
+    [_MB]    = RDATA_OPS("MB",    name),
+    [_MG]    = RDATA_OPS("MG",    name),
+    [_MR]    = RDATA_OPS("MR",    name),
+    [_NULL]  = RDATA_OPS("NULL",  opaque),
+    [_WKS]   = RDATA_OPS("WKS",   wks),
+    [_PTR]   = RDATA_OPS("PTR",   name),
+    [_HINFO] = RDATA_OPS("HINFO", hinfo),
+    [_MINFO] = RDATA_OPS("MINFO", minfo),
+    [_MX]    = RDATA_OPS("MX",    mx),
+    [_TXT]   = RDATA_OPS("TXT",   txt),
+};
+
+static const struct dns_rdata_ops dns_rdata_unknown = RDATA_OPS(NULL, opaque);
+
+///codecs of @type, the opaque ones if it has none
+static inline
+const struct dns_rdata_ops *dns_rdata(u16_t type)
+{
+    if(type < ARRAY_SIZE(dns_rdata_table) && dns_rdata_table[type].names)
+        return &dns_rdata_table[type];
+    return &dns_rdata_unknown;
+}
+
+#endif ///RDATA_H
@@ -0,0 +1,416 @@
+#ifndef REPLY_H
+#define REPLY_H
+
+#include <string.h>
+#include <arpa/inet.h>
+#include "message.h"
+#include "compress.h"
+#include "rdata.h"
+
+/**
+ * **In-place reply writer**
+ *
+ * An authoritative reply starts with the header and the question of its
+ * query, so the received packet is turned into the reply where it lies:
+ * the header flags are flipped, the question bytes stay untouched and the
+ * resource records are appended right behind them.
+ *
+ * Records have to be added answer section first, then authority, then
+ * additional.
+ *
+ * Owner names and names inside RDATA given uncompressed are compressed
+ * against every name already in the reply, the question name included.
+ * A record is added either at once, its owner already encoded and its
+ * RDATA copied as is (dns_reply_add_rr), or its owner and its RDATA encoded
+ * by the codec of its type, see rdata.h (dns_reply_add_rr_name); or piece
+ * by piece between dns_reply_rr_begin() and dns_reply_rr_end(). A record
+ * which does not fit leaves no trace but the TC bit; one whose RDATA is
+ * malformed leaves none at all, since TCP would not carry it any better.
+ *
+ * A message of our own, a query say, is started empty by dns_reply_new()
+ * and given its questions by dns_reply_add_question() before any record.
+ * Several records which have to go together, e.g. an RRset, are taken
+ * back at once from a dns_reply_mark() by dns_reply_rollback().
+ */
+
+struct dns_reply {
+    uchar                  *buf;
+    size_t                  len;    ///bytes of the reply so far
+    size_t                  cap;    ///limit of the transport
+    size_t                 qend;    ///end of the question section
+
+    ///record being built by dns_reply_rr_begin()
+    size_t             rr_start;
+    size_t             rr_rdata;
+    unsigned int        rr_comp;
+    bool                rr_full;
+    bool                 rr_bad;    ///RDATA malformed for its type
+
+    ///set up by the first name written
+    bool             comp_ready;
+    struct dns_comp        comp;
+};
+
+///rollback point of a reply, see dns_reply_mark()
+struct dns_reply_mark {
+    size_t                  len;
+    u16_t              count[3];    ///answer, authority, additional
+    unsigned int           comp;
+};
+
+#define dns_reply_header(r) ((DNS_HEADER_t *) (r)->buf)
+
+/**
+ * Turn the header of the query in @buf into the one of its reply, whose
+ * question section ends at @qend.
+ */
+static inline
+void dns_reply_start(struct dns_reply *r, uchar *buf, size_t qend, size_t cap)
+{
+    DNS_HEADER_t *hdr = (DNS_HEADER_t *) buf;
+
+    r->buf = buf;
+    r->cap = cap;
+
+    dns_header_make_reply(hdr, 0, _NOERROR);
+    hdr->ancount = 0;
+    hdr->nscount = 0;
+    hdr->arcount = 0;
+
+    r->qend = r->len = qend;
+    r->comp_ready = false;
+}
+
+/**
+ * Start a message of our own in @buf, no bigger than @cap: a header of @id,
+ * @opcode and @rd, every count 0.
+ *
+ * @return 0, -1 if not even the header fits
+ */
+static inline
+int dns_reply_new(struct dns_reply *r, uchar *buf, size_t cap, u16_t id, OPCODE_t opcode, bool rd)
+{
+    DNS_HEADER_t *hdr = (DNS_HEADER_t *) buf;
+
+    if(cap < sizeof(DNS_HEADER_t))
+        return -1;
+
+    memset(hdr, 0, sizeof(*hdr));
+    hdr->id = htons(id);
+    hdr->flags = htons(dns_flags_make(0, opcode, 0, 0, rd, 0, 0, _NOERROR));
+
+    r->buf = buf;
+    r->cap = cap;
+    r->qend = r->len = sizeof(DNS_HEADER_t);
+    r->comp_ready = false;
+    return 0;
+}
+
+/**
+ * Take over the query of @len bytes in @buf.
+ *
+ * The reply keeps id, opcode, rd and the question; every other section of
+ * the query is dropped.
+ *
+ * @return 0, -1 if the query has no complete question section, in which
+ *         case only the header is kept (the caller answers FORMERR)
+ */
+static inline
+int dns_reply_init(struct dns_reply *r, uchar *buf, size_t len, size_t cap)
+{
+    DNS_HEADER_t *hdr = (DNS_HEADER_t *) buf;
+    size_t off = sizeof(DNS_HEADER_t);
+    int ret = 0;
+
+    for(u16_t i = ntohs(hdr->qdcount); i > 0; i--)
+    {
+        ssize_t end = dns_name_skip(buf, len, off);
+
+        if(end < 0 || (size_t) end + sizeof(DNS_QUESTION_t) > len) {
+            hdr->qdcount = 0;
+            off = sizeof(DNS_HEADER_t);
+            ret = -1;
+            break;
+        }
+        off = (size_t) end + sizeof(DNS_QUESTION_t);
+    }
+
+    dns_reply_start(r, buf, off, cap);
+    return ret;
+}
+
+static inline
+void dns_reply_rcode(struct dns_reply *r, RCODE_t rcode)
+{
+    dns_flag_set(dns_reply_header(r), DNS_RCODE, rcode);
+}
+
+static inline
+void dns_reply_aa(struct dns_reply *r, bool aa)
+{
+    dns_flag_set(dns_reply_header(r), DNS_AA, aa);
+}
+
+/**
+ * The record does not fit: the client has to ask again over TCP.
+ */
+static inline
+void dns_reply_truncate(struct dns_reply *r)
+{
+    dns_flag_set(dns_reply_header(r), DNS_TC, 1);
+}
+
+static inline
+void dns_reply_count(struct dns_reply *r, int section)
+{
+    ///ancount, nscount and arcount follow each other in the header
+    u16_t *count = &dns_reply_header(r)->ancount + (section - DNS_ANSWER);
+
+    *count = htons(ntohs(*count) + 1);
+}
+
+/**
+ * Append a question for the uncompressed @name to a message started by
+ * dns_reply_new(); questions come before any record.
+ *
+ * @return 0, -1 if it does not fit (TC is set) or a record is already in
+ */
+static inline
+int dns_reply_add_question(struct dns_reply *r, const uchar *name, RR_TYPE_t qtype, RR_CLASS_t qclass)
+{
+    DNS_HEADER_t *hdr = dns_reply_header(r);
+    ssize_t n = rdata_name_len(name, NAME_LIMIT);
+    DNS_QUESTION_t q;
+
+    if(r->len != r->qend || r->comp_ready || n < 0)
+        return -1;
+    if(r->len + n + sizeof(DNS_QUESTION_t) > r->cap) {
+        dns_reply_truncate(r);
+        return -1;
+    }
+
+    q.qtype = htons(qtype);
+    q.qclass = htons(qclass);
+
+    memcpy(r->buf + r->len, name, n);
+    r->len += n;
+    memcpy(r->buf + r->len, &q, sizeof(q));
+    r->len += sizeof(q);
+
+    r->qend = r->len;
+    hdr->qdcount = htons(ntohs(hdr->qdcount) + 1);
+    return 0;
+}
+
+/**
+ * Append one resource record whose owner name is already encoded in
+ * @name (@nlen bytes, compressed or not).
+ *
+ * @return 0, -1 if it does not fit; TC is set then
+ */
+static inline
+int dns_reply_add_rr(struct dns_reply *r, int section, const uchar *name, size_t nlen,
+                     RR_TYPE_t type, RR_CLASS_t class, TTL_t ttl,
+                     const uchar *rdata, u16_t rdlen)
+{
+    uchar *p = r->buf + r->len;
+    RR_t *rr = (RR_t *) (p + nlen);
+
+    if(r->len + nlen + sizeof(RR_t) + rdlen > r->cap) {
+        dns_reply_truncate(r);
+        return -1;
+    }
+
+    memcpy(p, name, nlen);
+    rr->type = htons(type);
+    rr->class = htons(class);
+    rr->ttl = htonl(ttl);
+    rr->rdlength = htons(rdlen);
+    memcpy(p + nlen + sizeof(RR_t), rdata, rdlen);
+    r->len += nlen + sizeof(RR_t) + rdlen;
+
+    dns_reply_count(r, section);
+    return 0;
+}
+
+/**
+ * Same as dns_reply_add_rr(), the owner name being the name at @offset of
+ * the reply, e.g. the question name at 12.
+ */
+static inline
+int dns_reply_add_rr_ptr(struct dns_reply *r, int section, u16_t offset,
+                         RR_TYPE_t type, RR_CLASS_t class, TTL_t ttl,
+                         const uchar *rdata, u16_t rdlen)
+{
+    uchar ptr[2] = { (uchar) (0xC0 | (offset >> 8)), (uchar) offset };
+
+    return dns_reply_add_rr(r, section, ptr, sizeof(ptr), type, class, ttl, rdata, rdlen);
+}
+
+///the dictionary, knowing the question name
+static inline
+struct dns_comp *dns_reply_comp(struct dns_reply *r)
+{
+    if(!r->comp_ready) {
+        dns_comp_init(&r->comp);
+        if(r->qend > sizeof(DNS_HEADER_t))
+            dns_comp_learn(&r->comp, r->buf, r->qend, sizeof(DNS_HEADER_t));
+        r->comp_ready = true;
+    }
+
+    return &r->comp;
+}
+
+///remember the reply as it is in @m; no question may follow
+static inline
+void dns_reply_mark(struct dns_reply *r, struct dns_reply_mark *m)
+{
+    DNS_HEADER_t *hdr = dns_reply_header(r);
+
+    m->len = r->len;
+    m->count[0] = hdr->ancount;
+    m->count[1] = hdr->nscount;
+    m->count[2] = hdr->arcount;
+    m->comp = dns_comp_mark(dns_reply_comp(r));
+}
+
+/**
+ * Take back every record added since @m, names learned for compression
+ * included; the flags, TC among them, stay as they are.
+ */
+static inline
+void dns_reply_rollback(struct dns_reply *r, const struct dns_reply_mark *m)
+{
+    DNS_HEADER_t *hdr = dns_reply_header(r);
+
+    r->len = m->len;
+    hdr->ancount = m->count[0];
+    hdr->nscount = m->count[1];
+    hdr->arcount = m->count[2];
+    dns_comp_rollback(&r->comp, m->comp);
+}
+
+/**
+ * Start a record owned by the uncompressed @name; its RDATA follows through
+ * dns_reply_put() and dns_reply_put_name().
+ */
+static inline
+void dns_reply_rr_begin(struct dns_reply *r, const uchar *name,
+                        RR_TYPE_t type, RR_CLASS_t class, TTL_t ttl)
+{
+    ssize_t n;
+    RR_t rr;
+
+    r->rr_start = r->len;
+    r->rr_comp = dns_comp_mark(dns_reply_comp(r));
+    r->rr_full = false;
+    r->rr_bad = false;
+
+    n = dns_comp_put(&r->comp, r->buf, r->len, r->cap, name);
+    if(n < 0 || r->len + n + sizeof(RR_t) > r->cap) {
+        r->rr_full = true;
+        return;
+    }
+    r->len += n;
+
+    rr.type = htons(type);
+    rr.class = htons(class);
+    rr.ttl = htonl(ttl);
+    rr.rdlength = 0;
+    memcpy(r->buf + r->len, &rr, sizeof(RR_t));
+    r->len += sizeof(RR_t);
+    r->rr_rdata = r->len;
+}
+
+static inline
+void dns_reply_put(struct dns_reply *r, const void *data, size_t n)
+{
+    if(r->rr_full || r->len + n > r->cap) {
+        r->rr_full = true;
+        return;
+    }
+    memcpy(r->buf + r->len, data, n);
+    r->len += n;
+}
+
+///a name of the RDATA, compressed; only for the types of RFC 1035
+static inline
+void dns_reply_put_name(struct dns_reply *r, const uchar *name)
+{
+    ssize_t n;
+
+    if(r->rr_full)
+        return;
+    if((n = dns_comp_put(dns_reply_comp(r), r->buf, r->len, r->cap, name)) < 0)
+        r->rr_full = true;
+    else
+        r->len += n;
+}
+
+///the whole uncompressed RDATA of a record of @type, names compressed
+static inline
+void dns_reply_put_rdata(struct dns_reply *r, RR_TYPE_t type, const uchar *rdata, u16_t rdlen)
+{
+    const struct dns_rdata_ops *ops = dns_rdata(type);
+    u16_t at[RDATA_NAMES];
+    ssize_t n;
+
+    if(r->rr_full || r->rr_bad)
+        return;
+    ///told apart first: encode() fails alike on both
+    if(ops->names(rdata, rdlen, at) < 0) {
+        r->rr_bad = true;
+        return;
+    }
+    n = ops->encode(dns_reply_comp(r), r->buf, r->len, r->cap, rdata, rdlen);
+    if(n < 0)
+        r->rr_full = true;
+    else
+        r->len += n;
+}
+
+/**
+ * Close the record started by dns_reply_rr_begin() in @section.
+ *
+ * @return 0, -1 if it did not fit: it is taken back and TC is set; -2 if
+ *         its RDATA is malformed: it is taken back, TC left alone
+ */
+static inline
+int dns_reply_rr_end(struct dns_reply *r, int section)
+{
+    size_t rdlen = r->rr_full ? 0 : r->len - r->rr_rdata;
+
+    if(r->rr_bad) {
+        r->len = r->rr_start;
+        dns_comp_rollback(&r->comp, r->rr_comp);
+        return -2;
+    }
+    if(r->rr_full || rdlen > 0xFFFF) {
+        r->len = r->rr_start;
+        dns_comp_rollback(&r->comp, r->rr_comp);
+        dns_reply_truncate(r);
+        return -1;
+    }
+
+    r->buf[r->rr_rdata - 2] = (uchar) (rdlen >> 8);
+    r->buf[r->rr_rdata - 1] = (uchar) rdlen;
+    dns_reply_count(r, section);
+    return 0;
+}
+
+/**
+ * Same as dns_reply_add_rr(), the owner being the uncompressed @name and
+ * the names inside @rdata compressed as well. RDATA malformed for @type is
+ * taken back without TC, see dns_reply_rr_end().
+ */
+static inline
+int dns_reply_add_rr_name(struct dns_reply *r, int section, const uchar *name,
+                          RR_TYPE_t type, RR_CLASS_t class, TTL_t ttl,
+                          const uchar *rdata, u16_t rdlen)
+{
+    dns_reply_rr_begin(r, name, type, class, ttl);
+    dns_reply_put_rdata(r, type, rdata, rdlen);
+    return dns_reply_rr_end(r, section);
+}
+
+#endif ///REPLY_H
@@ -116,25 +116,7 @@ typedef struct _RR_ptr {
 
 #define rr_malloc(var) _malloc(RR_ptr_t *, var)
 
-#define rr_assign(var, _name, _type, _class, _ttl, _rd_len, _rdata)\
-    ({\
-    strcpy(var->name, _name); \
-    protocol_struct_member_assign(var, rr,  type,  _type, htons);\
-    protocol_struct_member_assign(var, rr, class, _class, htons);\
-    protocol_struct_member_assign(var, rr,   ttl,   _ttl, htonl);\
-    protocol_struct_member_assign(var, rr, rdlen, _rdlen, htons);\
-    \
-    size_t _s = (strlen(name) + 1) + sizeof(RR_t) + (size_t) rd_len;\
-    protocol_struct_member_assign(var, rr, rdata, _rdata);\
-    _s;})
-
-#define rr_locate_assign(var, locate, _qname, _qtype, _qclass)\
-    ({\
-    rr_locate(var, locate);\
-    size_t _s = rr_assign(var, _id, _qr, _opcode, _aa, _tc,\
-                            _rd, _ra, _z, _rcode, _qdcount,\
-                            _ancount, _nscount, _arcount);\
-    _s;})
+///records are written by the bounds-checked reply builder, see reply.h
 
 /**
  * RR Member
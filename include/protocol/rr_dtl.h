@@ -81,6 +81,7 @@ enum {
     _MINFO   = 14,
     _MX      = 15,
     _TXT     = 16,
+    _OPT     = 41,/**RFC 6891, a pseudo-RR*/
     _AXFR    =252,
     _MAILB   =253,
     _MAILA   =254,
@@ -110,7 +111,9 @@ const char const *_RR_QTYPE[256] = {
     [14] = "_MINFO",
     [15] = "_MX   ",
     [16] = "_TXT  ",
-    [17 ... 251] = "\0",
+    [17 ... 40] = "\0",
+    [41] = "_OPT  ",
+    [42 ... 251] = "\0",
     [252] = "_AXFR ",
     [253] = "_MAILB",
     [254] = "_MAILA",
@@ -16,6 +16,9 @@
 
 #include "type.h"
 
+///<domain-name>s below are interned, see core/intern.h
+struct dns_name;
+
 /**
  * 3.4.1 Address (A) RRs
  * 
@@ -46,7 +49,7 @@ typedef u32_t A_t;
  * NSDNAME         A <domain-name> which specifies a host which should be
  *                 authoritative for the specified class and domain
  */
- typedef char *NN_t;
+ typedef const struct dns_name *NN_t;
 
 /**
  * 3.3.12. Pointer (PTR) RR
@@ -62,7 +65,7 @@ typedef u32_t A_t;
  * PTRDNAME        A <domain-name> which points to some location in the
  *                 domain name space.
  */
-typedef char *PTRDNAME_t;
+typedef const struct dns_name *PTRDNAME_t;
 
 /**
  * 3.3.13. Start of Authority (SOA) RR
@@ -136,8 +139,8 @@ typedef struct _SOA {
 } SOA_t;
 
 typedef struct _SOA_ptr {
-    char        *mname;
-    char        *rname;
+    const struct dns_name *mname;
+    const struct dns_name *rname;
     SOA_t*         soa;
 } SOA_ptr_t;
 
@@ -156,7 +159,7 @@ typedef struct _SOA_ptr {
  * CNAME           A <domain-name> which specifies the canonical or primary
  *                 name for the owner.  The owner name is an alias.
  */
-typedef char *CNAME_t;
+typedef const struct dns_name *CNAME_t;
 
 /**
  * 3.3.2. HINFO RDATA format
@@ -201,7 +204,7 @@ typedef struct _HINFO_ptr {
  * RRs corresponding to MADNAME.
  *
  */
-typedef char *MADNAME_t;
+typedef const struct dns_name *MADNAME_t;
 
 /**
  * 3.3.6. MG RDATA format (EXPERIMENTAL)
@@ -218,7 +221,7 @@ typedef char *MADNAME_t;
  * 
  * MG records cause no additional section processing.
  */
-typedef char *MGMNAME_t;
+typedef const struct dns_name *MGMNAME_t;
 
 /**
  * 3.3.7. MINFO RDATA format (EXPERIMENTAL)
@@ -253,8 +256,8 @@ typedef char *MGMNAME_t;
  */
 ///FIXME: member rename
 typedef struct _MINFO_ptr {
-    char *rmailbx;
-    char *emailbx;
+    const struct dns_name *rmailbx;
+    const struct dns_name *emailbx;
 } MINFO_ptr_t;
 
 /**
@@ -274,7 +277,7 @@ typedef struct _MINFO_ptr {
  * is as a forwarding entry for a user who has moved to a different
  * mailbox.
  */
-typedef char *NEWNAME_t;
+typedef const struct dns_name *NEWNAME_t;
  
 /** 
  * 3.3.9. MX RDATA format
@@ -305,6 +308,12 @@ typedef struct MX {
     char exchange[0];
 } MX_t;
 
+///MX_t with its EXCHANGE interned
+typedef struct _MX_ptr {
+    uint16_t preference;
+    const struct dns_name *exchange;
+} MX_ptr_t;
+
 /** 
  * 3.3.10. NULL RDATA format (EXPERIMENTAL)
  * 
@@ -3,10 +3,12 @@
 
 #include <stdint.h>
 
+#define u64_t uint64_t
 #define u32_t uint32_t
 #define u16_t uint16_t
 #define u8_t uint8_t
 
+#define s64_t int64_t
 #define s32_t int32_t
 #define s16_t int16_t
 #define s8_t int8_t
@@ -0,0 +1,128 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stdlib.h>
+#include <stdio.h>
+#include "type.h"
+#include "limit.h"
+#include "debug.h"
+
+/**
+ * **Message Arena**
+ *
+ * One block taken when a thread starts, carved out front to back by a bump
+ * pointer. Everything decoding or encoding one message needs for a moment,
+ * the structures of the resolver and the text of a record among them, comes
+ * from here and is given back all at once by arena_reset() before the next
+ * message; nothing is freed on its own. A full arena hands out NULL, it
+ * never grows, so the memory of a thread stays what it was at its start.
+ *
+ * An arena belongs to one thread and is not locked, see msg_arena().
+ */
+///alignment of malloc() on x86-64 and aarch64, good for any type
+#define ARENA_ALIGN ((size_t) 16)
+
+struct arena {
+    uchar                 *mem;
+    size_t                size;
+    size_t                used;
+
+    ///statistics
+    size_t                high;     ///most bytes ever in use at once
+    unsigned long long  resets;
+    unsigned long long   fails;     ///arena_alloc() found no room
+};
+
+static inline
+struct arena *arena_new(size_t size)
+{
+    struct arena *a = (struct arena *) calloc(1, sizeof(*a));
+    syserr(!a, "arena_new: calloc()\n");
+
+    a->size = size;
+    a->mem = (uchar *) aligned_alloc(ARENA_ALIGN, (size + ARENA_ALIGN - 1) & ~(ARENA_ALIGN - 1));
+    syserr(!a->mem, "arena_new: aligned_alloc()\n");
+
+    return a;
+}
+
+static inline
+void arena_free(struct arena *a)
+{
+    free(a->mem);
+    free(a);
+}
+
+/**
+ * @return @n bytes aligned for any type, NULL if they do not fit
+ */
+static inline
+void *arena_alloc(struct arena *a, size_t n)
+{
+    size_t at = (a->used + ARENA_ALIGN - 1) & ~(ARENA_ALIGN - 1);
+
+    if(n > a->size || at > a->size - n) {
+        a->fails++;
+        return NULL;
+    }
+
+    a->used = at + n;
+    if(a->used > a->high)
+        a->high = a->used;
+    return a->mem + at;
+}
+
+///give back everything taken from @a
+static inline
+void arena_reset(struct arena *a)
+{
+    a->used = 0;
+    a->resets++;
+}
+
+/**
+ * Scratch space kept only for a while within one message: whatever was
+ * taken since arena_mark() is given back by arena_release() with its mark.
+ */
+static inline
+size_t arena_mark(const struct arena *a)
+{
+    return a->used;
+}
+
+static inline
+void arena_release(struct arena *a, size_t mark)
+{
+    a->used = mark;
+}
+
+static inline
+void arena_stats_show(const struct arena *a)
+{
+    printf("arena: %zu bytes, %zu at most in use, %llu resets, %llu failed\n",
+            a->size, a->high, a->resets, a->fails);
+}
+
+/**
+ * The arena of the calling thread, of ARENA_SIZE bytes, made on first use.
+ * A worker makes it once it is bound to its node, so it comes from there.
+ */
+static __thread struct arena *msg_arena_tls;
+
+static inline
+struct arena *msg_arena(void)
+{
+    if(!msg_arena_tls)
+        msg_arena_tls = arena_new(ARENA_SIZE);
+    return msg_arena_tls;
+}
+
+static inline
+void msg_arena_free(void)
+{
+    if(msg_arena_tls)
+        arena_free(msg_arena_tls);
+    msg_arena_tls = NULL;
+}
+
+#endif ///ARENA_H
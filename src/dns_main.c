@@ -1,6 +1,193 @@
+#include <signal.h>
+#include <getopt.h>
+#include <poll.h>
+#include <sys/signalfd.h>
+
 #include "type.h"
 #include "protocol/message.h"
 #include "core/dns.h"
+#include "core/worker.h"
+#include "core/reactor.h"
+#include "core/uring.h"
+#include "core/restart.h"
+#include "core/rrl.h"
+#include "core/zone_file.h"
+#include "parser.h"
+
+#define Usage "./dns_main [-b <batch size>] [-w <workers, 0: one per cpu>]"\
+              " [-m block|epoll|uring] [-l <addr>[:port]] ... [-T <tcp idle seconds>]"\
+              " [-R <restart socket>] [-P auto|<cpu list>]"\
+              " [-r <responses/s per prefix> [-s <slip>]] [-c <cached replies per worker>]"\
+              " [-f <configuration, see config.sample/COMFIG.CMD>]\n"
+
+struct zone_db *dns_db;
+__thread struct dns_cache *dns_cache;
+
+static volatile sig_atomic_t stop = 0;
+///the sockets were handed to a successor: finish what was taken and leave
+static volatile sig_atomic_t drain = 0;
+///replies each worker caches, 0: none
+static unsigned int cache_entries = CACHE_DEFAULT;
+
+///only there to interrupt a blocking call: the flags tell the worker why
+static void dns_wake(int sig)
+{
+}
+
+/**
+ * One datagram per recvfrom/sendto pair.
+ */
+static void serve(struct dns_worker *w)
+{
+    struct DNS *dns = w->dns;
+    int sk_fd = w->sk_fd[0];
+    ssize_t nBytes;
+
+    struct pktpool *pool = pktpool_new(1, PKT_LIMIT);
+    uchar *buf = pkt_get(pool);
+
+    struct sockaddr_storage clnt_addr = {0};
+    socklen_t clnt_addr_len;
+    bool drained = false;
+    struct rrl_stats rrl_stats = {0};
+
+    while(!stop)
+    {
+        ///the socket backend answers each datagram before taking the next
+        if(drain && !drained) {
+            if(!dns->drain)
+                break;
+            dns->drain(sk_fd);
+            drained = true;
+        }
+
+        dlog("DNS listen\n");
+        clnt_addr_len = sizeof(clnt_addr);
+        nBytes = dns->listen(sk_fd, buf, (struct sockaddr *) &clnt_addr, &clnt_addr_len);
+        if(nBytes < 0 && drained && (errno == EINTR || errno == EAGAIN))
+            break;
+        if(nBytes < 0)
+            continue;
+        dlog("Done!\n");
+
+        nBytes = dns_process(buf, nBytes, EDNS_LIMIT);
+        if(nBytes > 0 && w->rrl)
+            nBytes = rrl_apply(w->rrl, &rrl_stats, (struct sockaddr *) &clnt_addr, buf, nBytes);
+        if(nBytes == 0)
+            continue;
+
+        dlog("DNS respond\n");
+        dns->respond(sk_fd, buf, nBytes, (struct sockaddr *) &clnt_addr, clnt_addr_len);
+        dlog("Done!\n");
+    }
+
+    if(w->rrl) {
+        printf("worker %d: ", w->id);
+        rrl_stats_show(&rrl_stats);
+    }
+    if(socket_tx_errors)
+        printf("worker %d: %llu replies dropped on errors\n", w->id, socket_tx_errors);
+    pkt_put(pool, buf);
+    pktpool_free(pool);
+}
+
+/**
+ * Up to `size` datagrams per recvmmsg, all replies of the batch flushed by
+ * one sendmmsg.
+ */
+static void serve_batch(struct dns_worker *w)
+{
+    struct DNS *dns = w->dns;
+    int sk_fd = w->sk_fd[0];
+    struct pktpool *pool = pktpool_new(w->batch, PKT_LIMIT);
+    struct dns_batch *batch = batch_new(w->batch, pool);
+    struct rrl_stats rrl_stats = {0};
+    struct prefilter_stats filter_stats = {0};
+    ssize_t nBytes;
+
+    ///a batch is answered before the next is taken: nothing is left to drain
+    while(!stop && !drain)
+    {
+        if(dns->listen_batch(sk_fd, batch) < 0)
+            continue;
+        dlog("DNS listen %u datagrams\n", batch->count);
+
+        batch_prefilter(batch, &filter_stats);
+        for(unsigned int k = 0; k < batch->nlive; k++)
+        {
+            unsigned int i = batch->live[k];
+
+            nBytes = dns_process(batch_rbuf(batch, i), batch_rlen(batch, i), EDNS_LIMIT);
+            if(nBytes > 0 && w->rrl)
+                nBytes = rrl_apply(w->rrl, &rrl_stats, (struct sockaddr *) &batch->addr[i],
+                                   batch_rbuf(batch, i), nBytes);
+            if(nBytes > 0)
+                batch_reply(batch, i, nBytes);
+        }
+
+        dlog("DNS respond %u datagrams\n", batch->pending);
+        dns->respond_batch(sk_fd, batch);
+    }
+
+    printf("worker %d: ", w->id);
+    batch_stats_show(batch);
+    prefilter_stats_show(&filter_stats);
+    if(w->rrl)
+        rrl_stats_show(&rrl_stats);
+    pktpool_stats_show(pool);
+    batch_free(batch, pool);
+    pktpool_free(pool);
+}
+
+/**
+ * Every UDP and TCP socket of the worker in one epoll reactor.
+ */
+static void serve_epoll(struct dns_worker *w)
+{
+    struct pktpool *pool = pktpool_new(w->batch + POOL_TCP_SLOTS, PKT_LIMIT);
+    struct reactor *r = reactor_new(dns_process, pool, w->batch, w->idle);
+
+    r->rrl = w->rrl;
+
+    for(unsigned int i = 0; i < w->nsk; i++)
+        reactor_add_listener(r, w->sk_fd[i], w->sk_type[i]);
+
+    reactor_run(r, &stop, &drain);
+
+    printf("worker %d: ", w->id);
+    reactor_stats_show(r);
+    pktpool_stats_show(pool);
+    reactor_free(r);
+    pktpool_free(pool);
+}
+
+static void *worker_main(void *arg)
+{
+    struct dns_worker *w = (struct dns_worker *) arg;
+
+    worker_bind_memory(w);
+    ///first touched here, so the arena lies on the node of the worker
+    msg_arena();
+    if(dns_db && cache_entries)
+        dns_cache = cache_new(cache_entries);
+
+    if(w->mode == WORKER_EPOLL)
+        serve_epoll(w);
+    else if(w->batch > 1 && w->mode == WORKER_BLOCK)
+        serve_batch(w);
+    else
+        serve(w);
+
+    if(dns_cache) {
+        printf("worker %d: ", w->id);
+        cache_stats_show(dns_cache);
+        cache_free(dns_cache);
+    }
+    printf("worker %d: ", w->id);
+    arena_stats_show(msg_arena());
+    msg_arena_free();
+    return NULL;
+}
 
 int main(int argc, char** argv)
 {
@@ -12,56 +199,294 @@ int main(int argc, char** argv)
         //.query
         .listen             = socket_recvfrom,
         .respond           = socket_sendto,
+        //.batch
+        .listen_batch       = socket_recvmmsg,
+        .respond_batch      = socket_sendmmsg,
     };
 
-    ///Socket File Descriptor
-    int sk_fd;
-    ssize_t nBytes;
-
-    uchar rbuf[BUF_SIZE] = {0};
-    uchar wbuf[BUF_SIZE] = {0};
+    struct dns_worker *workers;
 
     /**
      * Default Configuration
      */
-    int sk_domain       = AF_INET;
-    int sk_type         = SOCK_DGRAM;
     int sk_protocol     = 0;
-    struct sockaddr_in serv_addr = {
-        .sin_family         = AF_INET,
-        .sin_addr.s_addr    = htonl(INADDR_ANY),
-        .sin_port           = htons(SERV_PORT),
-    };
+    struct sockaddr_storage serv_addr[LISTEN_LIMIT];
+    socklen_t serv_addr_len[LISTEN_LIMIT];
+    unsigned int naddr = 0;
+
+    int mode = WORKER_BLOCK;
 
-    struct sockaddr clnt_addr = {0};
-    socklen_t clnt_addr_len = sizeof(clnt_addr_len);
+    ///datagrams per syscall, 1 keeps the recvfrom/sendto loop
+    unsigned int batch = 1;
+    ///threads serving the port, each with its own SO_REUSEPORT socket
+    unsigned int nworkers = 1;
+    ///seconds an idle TCP connection is kept open
+    unsigned int idle = TCP_IDLE_TIMEOUT;
+    ///unix socket a successor connects to for the listening sockets
+    const char *restart_path = NULL;
+    int restart_fd = -1, peer_fd = -1;
+    bool handed = false;
+    ///CPUs the workers are pinned to in turn, none: left to the scheduler
+    int cpus[CPU_SETSIZE];
+    int ncpus = 0;
+    ///replies per second to one client prefix, 0: unlimited
+    unsigned int rrl_rate = 0, rrl_slip = 2;
+    struct rrl *rrl = NULL;
+    ///zones to load, none: every query is refused
+    char *config = NULL;
 
+    int opt;
+    while((opt = getopt(argc, argv, "b:w:m:l:T:R:P:r:s:c:f:")) != -1)
+    {
+        switch(opt) {
+            case 'b':
+                batch = (unsigned int) atoi(optarg);
+                if(batch < 1 || batch > BATCH_LIMIT)
+                    elog("batch size should be in [1, %d]\n", BATCH_LIMIT);
+                break;
+            case 'w':
+                nworkers = (unsigned int) atoi(optarg);
+                if(nworkers > WORKER_LIMIT)
+                    elog("at most %d workers\n", WORKER_LIMIT);
+                if(nworkers == 0)
+                    nworkers = MIN(worker_count_online(), WORKER_LIMIT);
+                break;
+            case 'm':
+                if(!strcmp(optarg, "block"))
+                    mode = WORKER_BLOCK;
+                else if(!strcmp(optarg, "epoll"))
+                    mode = WORKER_EPOLL;
+                else if(!strcmp(optarg, "uring"))
+                    mode = WORKER_URING;
+                else
+                    elog("%s", Usage);
+                break;
+            case 'l':
+                if(naddr == LISTEN_LIMIT)
+                    elog("at most %d listen addresses\n", LISTEN_LIMIT);
+                if(socket_addr_parse(optarg, SERV_PORT, &serv_addr[naddr], &serv_addr_len[naddr]) < 0)
+                    elog("bad listen address %s\n", optarg);
+                naddr++;
+                break;
+            case 'T':
+                if(atoi(optarg) < 1)
+                    elog("tcp idle timeout should be at least 1 second\n");
+                idle = (unsigned int) atoi(optarg);
+                break;
+            case 'R':
+                restart_path = optarg;
+                break;
+            case 'P':
+                ncpus = worker_parse_cpus(optarg, cpus, CPU_SETSIZE);
+                if(ncpus < 0)
+                    elog("bad cpu list %s, or a cpu not available\n", optarg);
+                break;
+            case 'r':
+                rrl_rate = (unsigned int) atoi(optarg);
+                if(rrl_rate > RRL_RATE_LIMIT)
+                    elog("rate limit should be at most %d\n", RRL_RATE_LIMIT);
+                break;
+            case 's':
+                rrl_slip = (unsigned int) atoi(optarg);
+                break;
+            case 'c':
+                cache_entries = (unsigned int) atoi(optarg);
+                break;
+            case 'f':
+                config = optarg;
+                break;
+            default:
+                elog("%s", Usage);
+        }
+    }
 
+    if(naddr == 0) {
+        struct sockaddr_in *any = (struct sockaddr_in *) &serv_addr[0];
 
-    ///TODO: Implement: Parser and Load Config File
-    //dns.init();
-    //dns.init_database();
+        memset(any, 0, sizeof(serv_addr[0]));
+        any->sin_family = AF_INET;
+        any->sin_addr.s_addr = htonl(INADDR_ANY);
+        any->sin_port = htons(SERV_PORT);
+        serv_addr_len[naddr++] = sizeof(*any);
+    }
+    if(mode == WORKER_URING) {
+        if(uring_supported()) {
+            dns.init_service = uring_config;
+            dns.listen = uring_recvfrom;
+            dns.respond = uring_sendto;
+            dns.drain = uring_drain;
+        }
+        else {
+            printf("io_uring is not available, falling back to the socket backend\n");
+            mode = WORKER_BLOCK;
+        }
+    }
+    if(mode != WORKER_EPOLL && naddr > 1)
+        elog("several listen addresses need -m epoll\n");
 
-    dlog("DNS initinalize Service\n");
     /**
-     * Initialize the socket and bind it
+     * SIGINT/SIGTERM are only taken by the main thread through a signalfd;
+     * WORKER_SIGNAL only gets workers out of their blocking receive to look
+     * at the stop and drain flags, so statistics get reported. It leaves
+     * stop alone: a draining worker ends on its own once its work is done.
      */
-    sk_fd = dns.init_service(sk_domain, sk_type, sk_protocol, (struct sockaddr *) &serv_addr, (socklen_t) sizeof(serv_addr));
-    dlog("Done!\n");
+    struct sigaction sa = { .sa_handler = dns_wake };
+    sigaction(WORKER_SIGNAL, &sa, NULL);
 
-    while(1)
-    {
-        dlog("DNS listen\n");
-        nBytes = dns.listen(sk_fd, rbuf, &clnt_addr, &clnt_addr_len);
-        dlog("Done!\n");
+    sigset_t sigs;
+    sigemptyset(&sigs);
+    sigaddset(&sigs, SIGINT);
+    sigaddset(&sigs, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &sigs, NULL);
 
-        
+    if(config) {
+        struct startup *cfg = startup_parser(config);
 
-        dlog("DNS respond\n");
-        dns.respond(sk_fd, wbuf, nBytes, &clnt_addr, clnt_addr_len);
+        if(!cfg)
+            elog("cannot read the configuration %s\n", config);
+        dns_db = zone_db_new();
+        for(int i = 0; i < cfg->z_count; i++)
+        {
+            ssize_t n = zone_file_load(dns_db, cfg->zone_path[i], cfg->zone_name[i]);
+
+            if(n < 0)
+                elog("zone %s not loaded from %s\n", cfg->zone_name[i], cfg->zone_path[i]);
+            printf("zone %s: %zd records from %s\n", cfg->zone_name[i], n, cfg->zone_path[i]);
+            free(cfg->zone_name[i]);
+            free(cfg->zone_path[i]);
+        }
+        zone_stats_show(dns_db);
+        free(cfg->root_server_path);
+        free(cfg->zone_name);
+        free(cfg->zone_path);
+        free(cfg);
+    }
+
+    /**
+     * Everything is loaded: a running server may hand its sockets over now.
+     */
+    if(restart_path)
+        peer_fd = restart_connect(restart_path);
+
+    if(peer_fd >= 0) {
+        if(restart_takeover(peer_fd, mode, &workers, &nworkers, &restart_fd) < 0)
+            elog("restart: taking the sockets over failed, the server keeps running\n");
+    }
+    else {
+        dlog("DNS initinalize Service\n");
+        /**
+         * Initialize the sockets of every worker and bind them; the reactor
+         * serves TCP next to UDP on every address.
+         */
+        if((nworkers > 1 || mode == WORKER_EPOLL) && dns.init_service == socket_config)
+            dns.init_service = socket_config_reuseport;
+
+        workers = (struct dns_worker *) calloc(nworkers, sizeof(*workers));
+        syserr(!workers, "calloc workers\n");
+
+        for(unsigned int i = 0; i < nworkers; i++)
+        {
+            for(unsigned int a = 0; a < naddr; a++)
+            {
+                for(int t = 0; t < (mode == WORKER_EPOLL ? 2 : 1); t++)
+                {
+                    int sk_type = t ? SOCK_STREAM : SOCK_DGRAM;
+                    unsigned int k = workers[i].nsk++;
+
+                    workers[i].sk_type[k] = sk_type;
+                    workers[i].sk_fd[k] = dns.init_service(serv_addr[a].ss_family, sk_type, sk_protocol,
+                            (struct sockaddr *) &serv_addr[a], serv_addr_len[a]);
+                }
+            }
+        }
         dlog("Done!\n");
+
+        if(restart_path)
+            restart_fd = restart_listen(restart_path);
+    }
+
+    if(rrl_rate)
+        rrl = rrl_new(rrl_rate, rrl_slip);
+
+    for(unsigned int i = 0; i < nworkers; i++)
+    {
+        workers[i].id = i;
+        workers[i].dns = &dns;
+        workers[i].mode = mode;
+        workers[i].batch = batch;
+        workers[i].idle = idle;
+        workers[i].rrl = rrl;
+        workers[i].cpu = workers[i].node = -1;
+        if(ncpus > 0)
+            worker_place(&workers[i], cpus[i % ncpus]);
+    }
+
+    for(unsigned int i = 0; i < nworkers; i++)
+        worker_start(&workers[i], worker_main);
+    printf("DDNS Server: %u worker(s), %s, %s\n", nworkers,
+            peer_fd >= 0 ? "sockets taken over" : naddr > 1 ? "several addresses" : "one address",
+            mode == WORKER_EPOLL ? "epoll udp+tcp" :
+            mode == WORKER_URING ? "io_uring udp" : "blocking udp");
+    for(unsigned int i = 0; ncpus > 0 && i < nworkers; i++)
+        printf("  worker %u: cpu %d, node %d, %u socket(s)\n",
+                i, workers[i].cpu, workers[i].node, workers[i].nsk);
+    if(rrl)
+        printf("  rrl: %u responses/s per prefix, slip %u\n", rrl_rate, rrl_slip);
+    if(peer_fd >= 0)
+        restart_ack(peer_fd);
+
+    /**
+     * Wait for SIGINT/SIGTERM, or for a successor asking for the sockets.
+     */
+    int sfd = signalfd(-1, &sigs, SFD_CLOEXEC);
+    syserr(sfd < 0, "signalfd()\n");
+
+    while(!handed)
+    {
+        struct pollfd pfd[2] = {
+            { .fd = sfd, .events = POLLIN },
+            { .fd = restart_fd, .events = POLLIN },
+        };
+
+        if(poll(pfd, 2, -1) < 0 && errno == EINTR)
+            continue;
+        if(pfd[0].revents)
+            break;
+        if(pfd[1].revents) {
+            int fd = accept4(restart_fd, NULL, NULL, SOCK_CLOEXEC);
+
+            if(fd < 0)
+                continue;
+            handed = restart_handoff(fd, restart_fd, mode, workers, nworkers) == 0;
+            if(!handed)
+                printf("restart: the successor did not take over, still serving\n");
+            close(fd);
+        }
     }
+    close(sfd);
 
+    if(handed) {
+        printf("DDNS Server: sockets handed over, draining\n");
+        drain = 1;
+    }
+    else
+        stop = 1;
+    worker_stop_all(workers, nworkers);
+
+    for(unsigned int i = 0; i < nworkers; i++)
+        for(unsigned int k = 0; k < workers[i].nsk; k++)
+            close(workers[i].sk_fd[k]);
+    free(workers);
+    if(rrl)
+        rrl_free(rrl);
+    if(dns_db)
+        zone_db_free(dns_db);
+    ///the successor listens on the same control socket now
+    if(restart_fd >= 0) {
+        close(restart_fd);
+        if(!handed)
+            unlink(restart_path);
+    }
     printf("DDNS Server shutdown\n");
     return 0;
 }
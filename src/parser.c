@@ -12,48 +12,63 @@
     while(!fgets(rbuf, 
 }*/
 
+///@file in the directory @dir
+static char *startup_path(const char *dir, const char *file)
+{
+    size_t len = strlen(dir) + 1 + strlen(file) + 1;
+    char *path = (char *) malloc(len);
+
+    syserr(!path, "startup_path: malloc()\n");
+    snprintf(path, len, "%s/%s", dir, file);
+    return path;
+}
+
 struct startup *startup_parser(char* in)
 {
     FILE *fd = fopen(in, "r");
-    //syserr(fd != -1, "fopen fail\n");   
+    if(!fd)
+        return NULL;
 
     char rbuf[MAX_BUFF_SIZE];
-    char info[4][100];
+    char info[7][100];
+    char dname[PATH_LIMIT], tmp[PATH_LIMIT];
 
-    struct startup *ret = (struct startup *) malloc(sizeof(struct startup));
-    ret->zone_name = (char **) malloc(sizeof(char *) * 50);
-    ret->zone_path = (char **) malloc(sizeof(char *) * 50);
+    struct startup *ret = (struct startup *) calloc(1, sizeof(struct startup));
+    ret->zone_name = (char **) malloc(sizeof(char *) * STARTUP_ZONE_LIMIT);
+    ret->zone_path = (char **) malloc(sizeof(char *) * STARTUP_ZONE_LIMIT);
     ret->z_count = 0;
 
+    ///files are named relative to the directory of the configuration
+    snprintf(tmp, sizeof(tmp), "%s", in);
+    snprintf(dname, sizeof(dname), "%s", dirname(tmp));
+
     int i = 0;
-    char *dname = dirname(in);
     while(fgets(rbuf, sizeof(rbuf), fd)) {
         if(rbuf[0] != '\n' && rbuf[0] != ';')
             //puts(rbuf);
         {
-            sscanf(rbuf, "%s%s%s%s", info[0], info[1], info[2], info[3]);
-            dlog("%s %s %s %s\n", info[0], info[1], info[2], info[3]);
+            ///load root server list from file <file>, load zone <name> from file <file>
+            int n = sscanf(rbuf, "%99s%99s%99s%99s%99s%99s%99s",
+                           info[0], info[1], info[2], info[3], info[4], info[5], info[6]);
+            if(n < 6 || strcmp(info[0], "load"))
+                continue;
+            dlog("%s %s %s ... %s\n", info[0], info[1], info[2], info[n - 1]);
+
+            if(n == 7 && !strcmp(info[1], "root") && !strcmp(info[2], "server"))
+            {
+                ret->root_server_path = startup_path(dname, info[6]);
+            }
 
-            if(!strcmp(info[0], "load"))
+            if(n == 6 && !strcmp(info[1], "zone") && i < STARTUP_ZONE_LIMIT)
             {
-                if(!strcmp(info[1], "root") && !strcmp(info[2], "server"))
-                {
-                    ret->root_server_path = strndup(dname, PATH_LIMIT);
-                    strcat(ret->root_server_path, "/");
-                    strcat(ret->root_server_path, info[3]);
-                }
-
-                if(!strcmp(info[1], "zone"))
-                {
-                    ret->zone_name[i] = strdup(info[2]);
-                    ret->zone_path[i] = strndup(dname, PATH_LIMIT);
-                    strcat(ret->zone_path[i], "/");
-                    strcat(ret->zone_path[i], strdup(info[3]));
-                }
+                ret->zone_name[i] = strdup(info[2]);
+                ret->zone_path[i] = startup_path(dname, info[5]);
+                i++;
             }
         }
     }
     ret->z_count = i;
+    fclose(fd);
 
     return ret;
 }
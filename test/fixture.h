@@ -0,0 +1,45 @@
+#ifndef FIXTURE_H
+#define FIXTURE_H
+/**
+ * @file Names and queries the tests build their messages from.
+ */
+#include <string.h>
+
+#include "type.h"
+#include "limit.h"
+#include "protocol/message.h"
+#include "core/dns_util.h"
+
+///@host in wire form into @dns, @return its length
+static inline
+size_t wire(uchar *dns, const char *host)
+{
+    char tmp[NAME_LIMIT];
+
+    strcpy(tmp, host);
+    host_to_dns_name((char *) dns, tmp);
+    return strlen((char *) dns) + 1;
+}
+
+/**
+ * A query for @host @qtype IN with @id and header @flags (DNS_RD, ...) into
+ * @buf, as a client would send it.
+ *
+ * @return its length
+ */
+static inline
+size_t make_query(uchar *buf, u16_t id, const char *host, u16_t qtype, u16_t flags)
+{
+    size_t len = sizeof(DNS_HEADER_t);
+
+    memset(buf, 0, len);
+    buf[0] = (uchar) (id >> 8), buf[1] = (uchar) id;
+    buf[2] = (uchar) (flags >> 8), buf[3] = (uchar) flags;
+    buf[5] = 1;
+    len += wire(buf + len, host);
+    buf[len++] = (uchar) (qtype >> 8), buf[len++] = (uchar) qtype, buf[len++] = 0, buf[len++] = _IN;
+
+    return len;
+}
+
+#endif ///FIXTURE_H
@@ -10,6 +10,9 @@
 #include "debug.h"
 #include "core/dns.h"
 
+struct zone_db *dns_db;
+__thread struct dns_cache *dns_cache;
+
 char dns_server[10][100];
 int dns_server_count = 0;
 
@@ -74,66 +77,15 @@ void dns_get_host_ip(char *host, RR_QTYPE_t qtype)
     /**
      * Construct MESSAGE
      */
-    int qdcount = 1;
-
-    ///declare DNS MESSAGE
-    ///DNS_MESSAGE_ptr_t msg_p;
-    
-    ///DNS Header
-    //DNS_HEADER_t *hdr = (DNS_HEADER_t *) buf;
-    dns_header_declare(hdr);
-    locate += dns_header_locate_assign( hdr,
-                                        buf,
-                           (u16_t) getpid(),/*     id*/
-                                          0,/*     qr*/
-                                          0,/* opcode*/
-                                 _STD_QUERY,/*     aa*/
-                                          0,/*     tc*/
-                                          1,/*     rd*/
-                                          0,/*     ra*/
-                                          0,/*      z*/
-                                   _NOERROR,/*  rcode*/
-                                          1,/*qdcount*/
-                                          0,/*ancount*/
-                                          0,/*nscount*/
-                                          0)/*arcount*/;
-
-    ///DNS Header Assign
-    /*dns_header_assign(     *hdr,
-        (u16_t) htons(getpid()),
-                              0,
-                              0,
-              htons(_STD_QUERY),
-                              0,
-                       htons(1),
-                              0,
-                 htons(_NO_ERR),
-                 htons(qdcount),
-                              0,
-                              0,
-                              0);*/
-    ///DNS Question
-    //DNS_QUESTION_ptr_t *q_list = (DNS_QUESTION_ptr_t *) malloc(qdcount * sizeof(DNS_QUESTION_ptr_t));
-    DNS_QUESTION_ptr_t **q_list = (DNS_QUESTION_ptr_t **) malloc(qdcount * sizeof(DNS_QUESTION_ptr_t *));
-    
-    for(int i = 0; i < qdcount; i++)
-    {
-        q_list[i] = (DNS_QUESTION_ptr_t *) malloc(sizeof(DNS_QUESTION_ptr_t));
-    }
-
-    ///DNS Question Assign
-    //dns_question_locate(q_list[0], &buf[locate]);
-
-    char *_tmp = (char *) malloc(30 *sizeof(char));
-    ch_to_dns_name(host, _tmp);
-    /*locate += strlen(q_list[0].qname) + 1;
+    struct dns_reply query;
+    uchar qname[NAME_LIMIT];
 
-    q_list[0].question = (DNS_QUESTION_t *) &buf[locate];
-    q_list[0].question->qtype = htons(qtype);
-    q_list[0].question->qclass = htons(_IN);
+    ch_to_dns_name(host, (char *) qname);
+    dns_reply_new(&query, (uchar *) buf, UDP_LIMIT, (u16_t) getpid(), _STD_QUERY, true);
+    syserr(dns_reply_add_question(&query, qname, qtype, _IN) < 0, "dns_reply_add_question\n");
+    locate = query.len;
 
-    locate += sizeof(*(q_list[0].question));*/
-    locate += dns_question_locate_assign(q_list[0], &buf[locate], _tmp, qtype, _IN);
+    DNS_HEADER_t *hdr = dns_reply_header(&query);
 
 
     ///Sendto
@@ -0,0 +1,86 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+
+#include "core/dns.h"
+#include <malloc.h>
+#include "fixture.h"
+
+struct zone_db *dns_db;
+__thread struct dns_cache *dns_cache;
+
+int main(int argc, char *argv[])
+{
+    struct arena *a = arena_new(100);
+    uchar *p, *q;
+    size_t mark;
+
+    ///aligned for any type, NULL once full, all of it back on a reset
+    p = arena_alloc(a, 1);
+    q = arena_alloc(a, 8);
+    assert(p && q && q - p == ARENA_ALIGN && (uintptr_t) q % ARENA_ALIGN == 0);
+    assert(!arena_alloc(a, 100) && a->fails == 1);
+    assert(arena_alloc(a, 100 - 2 * ARENA_ALIGN) && !arena_alloc(a, 1) && a->high == 100);
+    arena_reset(a);
+    assert(arena_alloc(a, 8) == p && a->used == 8 && a->high == 100);
+    assert(!arena_alloc(a, (size_t) -1));
+
+    ///scratch space is given back with its mark
+    mark = arena_mark(a);
+    arena_alloc(a, 50);
+    arena_release(a, mark);
+    assert(arena_alloc(a, 8) == q);
+    arena_free(a);
+
+    ///decode structures come from the arena of the thread
+    RR_ptr_t *rr;
+
+    rr_malloc(rr);
+    assert(rr && msg_arena()->used >= sizeof(*rr) && msg_arena()->size == ARENA_SIZE);
+
+    ///answering queries takes the same bytes of the arena, none of the heap
+    uchar buf[UDP_LIMIT], soa[2 * NAME_LIMIT + 20] = {0}, name[NAME_LIMIT], rdata[4] = { 10, 1, 0, 52 };
+    size_t n, high, heap;
+    int loops = 100 * 1000;
+
+    dns_db = zone_db_new();
+    n = wire(soa, "ns.sri.com");
+    n += wire(soa + n, "root.sri.com");
+    wire(name, "sri.com");
+    assert(zone_add(dns_db, name, _SOA, _IN, 3600, soa, n + 20) == 0);
+    wire(name, "kl.sri.com");
+    assert(zone_add(dns_db, name, _A, _IN, 3600, rdata, sizeof(rdata)) == 0);
+
+    assert(dns_process(buf, make_query(buf, 0, "kl.sri.com", _A, 0), UDP_LIMIT) > 0);
+    high = msg_arena()->high;
+    heap = mallinfo2().uordblks;
+    for(int i = 0; i < loops; i++)
+    {
+        assert(dns_process(buf, make_query(buf, i, i & 1 ? "kl.sri.com" : "nope.sri.com", _A, 0), UDP_LIMIT) > 0);
+        assert(msg_arena()->used <= high);
+    }
+    assert(msg_arena()->high == high && mallinfo2().uordblks == heap);
+    assert(msg_arena()->resets == (unsigned long long) loops + 1 && msg_arena()->fails == 0);
+
+    ///with the arena full, rr_show() still steps over the whole record
+    uchar msg[BUF_SIZE] = {0};
+    RR_t fixed = { .type = htons(_A), .class = htons(_IN), .ttl = htonl(60), .rdlength = htons(4) };
+    size_t locate = sizeof(DNS_HEADER_t);
+    RR_ptr_t show;
+
+    n = sizeof(DNS_HEADER_t) + wire(msg + sizeof(DNS_HEADER_t), "kl.sri.com");
+    memcpy(msg + n, &fixed, sizeof(fixed));
+    memcpy(msg + n + sizeof(fixed), rdata, sizeof(rdata));
+    show.rr = (RR_t *) (msg + n);
+    mark = arena_mark(msg_arena());
+    while(arena_alloc(msg_arena(), 64))
+        ;
+    rr_show(&show, msg, &locate);
+    assert(locate == n + sizeof(RR_t) + sizeof(rdata));
+    arena_release(msg_arena(), mark);
+
+    arena_stats_show(msg_arena());
+    msg_arena_free();
+    zone_db_free(dns_db);
+    return 0;
+}
@@ -0,0 +1,126 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <time.h>
+
+#include "core/dns.h"
+#include "fixture.h"
+
+struct zone_db *dns_db;
+__thread struct dns_cache *dns_cache;
+
+static void add_a(const char *owner, uchar last)
+{
+    uchar name[NAME_LIMIT], rdata[4] = { 10, 1, 0, last };
+
+    wire(name, owner);
+    assert(zone_add(dns_db, name, _A, _IN, 3600, rdata, sizeof(rdata)) == 0);
+}
+
+///query for @host @qtype with @id and RD set, answered by dns_process() within @cap
+static size_t ask(uchar *buf, u16_t id, const char *host, u16_t qtype, size_t cap)
+{
+    return dns_process(buf, make_query(buf, id, host, qtype, DNS_RD), cap);
+}
+
+int main(int argc, char *argv[])
+{
+    uchar one[UDP_LIMIT], two[UDP_LIMIT], name[NAME_LIMIT];
+    uchar soa[2 * NAME_LIMIT + 20] = {0};
+    size_t n, len;
+    struct cache_stats *st;
+
+    dns_db = zone_db_new();
+    n = wire(soa, "ns.sri.com");
+    n += wire(soa + n, "root.sri.com");
+    wire(name, "sri.com");
+    assert(zone_add(dns_db, name, _SOA, _IN, 3600, soa, n + 20) == 0);
+    add_a("kl.sri.com", 2);
+    add_a("kl.sri.com", 6);
+
+    dns_cache = cache_new(4);
+    st = &dns_cache->stats;
+
+    ///a miss fills, any case of the name hits, with the ID, RD and case of the query
+    len = ask(one, 1, "KL.sri.com", _A, UDP_LIMIT);
+    assert(len > 0 && st->misses == 1 && st->inserts == 1);
+    assert(ask(two, 2, "kl.SRI.com", _A, UDP_LIMIT) == len && st->hits == 1);
+    assert(two[0] == 0 && two[1] == 2 && dns_flag((DNS_HEADER_t *) two, DNS_RD));
+    assert(!memcmp(two + 12, "\2kl\3SRI\3com", 11));
+    assert(!memcmp(one + 2, two + 2, 10) && !memcmp(one + 28, two + 28, len - 28));
+
+    ///another type is another question
+    ask(two, 3, "kl.sri.com", _MX, UDP_LIMIT);
+    assert(st->hits == 1 && st->misses == 2);
+
+    ///a change of the database: the entry is stale, the next answer new
+    add_a("kl.sri.com", 7);
+    assert(ask(two, 4, "kl.sri.com", _A, UDP_LIMIT) > len && st->stale == 1);
+    assert(ntohs(((DNS_HEADER_t *) two)->ancount) == 3);
+    assert(ask(two, 5, "kl.sri.com", _A, UDP_LIMIT) > len && st->hits == 2);
+
+    ///a reply cut for a small transport is not kept
+    assert(ask(two, 6, "kl.sri.com", _A, 50) > 0 && dns_flag((DNS_HEADER_t *) two, DNS_TC));
+    n = st->inserts;
+    assert(ask(two, 7, "kl.sri.com", _A, 60) > 0 && dns_flag((DNS_HEADER_t *) two, DNS_TC));
+    assert(st->inserts == n && st->hits == 2);
+
+    ///an OPT record is answered with one of ours, behind the cached reply
+    static const uchar opt[11] = { 0, 0, 41, 0x10, 0 };
+
+    n = ask(one, 8, "kl.sri.com", _A, UDP_LIMIT);
+    len = make_query(two, 9, "kl.sri.com", _A, DNS_RD);
+    memcpy(two + len, opt, sizeof(opt));
+    two[11] = 1;
+    assert(dns_process(two, len + sizeof(opt), EDNS_LIMIT) == n + EDNS_OPT_SIZE && st->hits == 4);
+    assert(ntohs(((DNS_HEADER_t *) two)->arcount) == 1 && !memcmp(one + 2, two + 2, 8));
+    assert(two[n + 2] == 41 && two[n + 3] == EDNS_LIMIT >> 8 && two[n + 4] == (EDNS_LIMIT & 0xff));
+
+    ///any other record besides the question, or another version, is not looked up
+    n = st->hits + st->misses;
+    len = make_query(two, 10, "kl.sri.com", _A, DNS_RD);
+    memcpy(two + len, opt, sizeof(opt));
+    two[11] = 1, two[len + 2] = _A;
+    assert(dns_process(two, len + sizeof(opt), EDNS_LIMIT) > 0);
+    len = make_query(two, 11, "kl.sri.com", _A, DNS_RD);
+    memcpy(two + len, opt, sizeof(opt));
+    two[11] = 1, two[len + 6] = 1;
+    assert(dns_process(two, len + sizeof(opt), EDNS_LIMIT) > 0);
+    assert(st->hits + st->misses == n);
+
+    ///one set of four ways: the fifth name evicts the oldest
+    const char *hosts[] = { "a.sri.com", "b.sri.com", "c.sri.com", "d.sri.com", "e.sri.com" };
+
+    cache_free(dns_cache);
+    dns_cache = cache_new(4);
+    st = &dns_cache->stats;
+    for(int i = 0; i < 5; i++)
+        ask(two, i, hosts[i], _A, UDP_LIMIT);
+    ask(two, 9, hosts[4], _A, UDP_LIMIT);
+    ask(two, 9, hosts[1], _A, UDP_LIMIT);
+    assert(st->hits == 2);
+    ask(two, 9, hosts[0], _A, UDP_LIMIT);
+    assert(st->hits == 2);
+    cache_stats_show(dns_cache);
+
+    ///cost of a hit and of the lookup it saves
+    struct timespec t0, t1, t2;
+    int loops = 1000 * 1000;
+
+    ask(two, 10, "kl.sri.com", _A, UDP_LIMIT);
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    for(int i = 0; i < loops; i++)
+        ask(two, i, "kl.sri.com", _A, UDP_LIMIT);
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    cache_free(dns_cache);
+    dns_cache = NULL;
+    for(int i = 0; i < loops; i++)
+        ask(two, i, "kl.sri.com", _A, UDP_LIMIT);
+    clock_gettime(CLOCK_MONOTONIC, &t2);
+    printf("cache: %.1f ns per query on a hit, %.1f ns without the cache\n",
+            ((t1.tv_sec - t0.tv_sec) * 1e9 + (t1.tv_nsec - t0.tv_nsec)) / loops,
+            ((t2.tv_sec - t1.tv_sec) * 1e9 + (t2.tv_nsec - t1.tv_nsec)) / loops);
+
+    zone_db_free(dns_db);
+    return 0;
+}
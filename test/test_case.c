@@ -0,0 +1,102 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <time.h>
+
+#include "fixture.h"
+#include "core/dns_case.h"
+
+///@host in wire form, malloc'ed
+static uchar *wire_new(const char *host)
+{
+    uchar *dns = malloc(NAME_LIMIT + 1);
+
+    wire(dns, host);
+    return dns;
+}
+
+static int by_canonical(const void *a, const void *b)
+{
+    return dns_case_cmp(*(uchar * const *) a, *(uchar * const *) b);
+}
+
+static double elapsed(struct timespec *t0, struct timespec *t1, int n)
+{
+    return ((t1->tv_sec - t0->tv_sec) * 1e9 + (t1->tv_nsec - t0->tv_nsec)) / n;
+}
+
+int main(int argc, char *argv[])
+{
+    ///RFC 4034 6.1, in order
+    const char *sorted[] = {
+        "example", "a.example", "yljkjljk.a.example", "Z.a.example",
+        "zABC.a.EXAMPLE", "z.example", "\001.z.example", "*.z.example", "\200.z.example",
+    };
+    int n = sizeof(sorted) / sizeof(sorted[0]);
+    uchar *names[n];
+    uchar *a = wire_new("Blackjack.SRI.COM"), *b = wire_new("blackJACK.sri.com");
+
+    for(int i = 0; i < n; i++)
+        names[i] = wire_new(sorted[n - 1 - i]);
+    qsort(names, n, sizeof(names[0]), by_canonical);
+    for(int i = 0; i < n; i++)
+    {
+        uchar *want = wire_new(sorted[i]);
+
+        assert(!memcmp(names[i], want, dns_case_len(want)));
+        free(want);
+    }
+
+    assert(dns_case_equal(a, b) && dns_case_cmp(a, b) == 0);
+    assert(dns_case_lower(a) == 19 && !memcmp(a, "\11blackjack\3sri\3com", 19));
+    b[11] = 'X';
+    assert(!dns_case_equal(a, b) && dns_case_cmp(a, b) < 0);
+
+    ///a pointer is not a wire name
+    b[0] = 0xC0;
+    assert(dns_case_len(b) < 0 && !dns_case_equal(b, b) && dns_case_cmp(a, b) < 0);
+
+    ///vectors, their tails and a difference in each
+    uchar x[NAME_LIMIT], y[NAME_LIMIT];
+
+    for(size_t len = 1; len < 100; len++)
+    {
+        for(size_t i = 0; i < len; i++)
+            x[i] = 'A' + i % 40, y[i] = dns_case_fold(x[i]);
+        assert(dns_case_diff_span(x, y, len) == len);
+        for(size_t i = 0; i < len; i++)
+        {
+            y[i] ^= 0x01;
+            assert(dns_case_diff_span(x, y, len) == i);
+            y[i] ^= 0x01;
+        }
+        dns_case_lower_span(x, len);
+        assert(!memcmp(x, y, len));
+    }
+
+    ///folding and comparing a long name, bytewise and vectorized
+    uchar *lng = wire_new("WWW.A-RATHER-LONG-LABEL-FOR-A-HOST.Some-Department.Example-University.EDU");
+    uchar *low = wire_new("www.a-rather-long-label-for-a-host.some-department.example-university.edu");
+    size_t len = dns_case_len(lng), sink = 0;
+    struct timespec t0, t1;
+    int loops = 1000 * 1000;
+    double scalar, vector;
+
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    for(int i = 0; i < loops; i++)
+        sink += dns_case_diff_scalar(lng, low, len);
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    scalar = elapsed(&t0, &t1, loops);
+
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    for(int i = 0; i < loops; i++)
+        sink += dns_case_diff_span(lng, low, len);
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    vector = elapsed(&t0, &t1, loops);
+
+    assert(sink == len * 2 * loops);
+    printf("case: %zu byte name, scalar %.1f ns, vector %.1f ns\n", len, scalar, vector);
+
+    return 0;
+}
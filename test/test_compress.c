@@ -0,0 +1,106 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <ctype.h>
+
+#include "protocol/reply.h"
+#include "protocol/msg_view.h"
+#include "fixture.h"
+
+///expand the name at @off of @buf into dotted text, following pointers
+static void expand(const uchar *buf, size_t off, char *out)
+{
+    char *p = out;
+
+    while(buf[off])
+    {
+        if((buf[off] & 0xC0) == 0xC0) {
+            off = ((buf[off] & 0x3F) << 8) | buf[off + 1];
+            continue;
+        }
+        memcpy(p, buf + off + 1, buf[off]);
+        p += buf[off];
+        *p++ = '.';
+        off += 1 + buf[off];
+    }
+    *p = '\0';
+}
+
+static const char *owner[] = {
+    "CSL.SRI.COM", "CSL.SRI.COM", "GW.CSL.SRI.COM", "GW.CSL.SRI.COM",
+    "B.CSL.SRI.COM", "SMELLY.CSL.SRI.COM", "kl.sri.com", "STRIPE.SRI.COM",
+};
+
+int main(int argc, char *argv[])
+{
+    uchar buf[UDP_LIMIT] = {
+        0x12, 0x34, 0x01, 0x00, 0x00, 0x01, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+        3, 'c', 's', 'l', 3, 's', 'r', 'i', 3, 'c', 'o', 'm', 0, 0x00, 0xff, 0x00, 0x01,
+    };
+    uchar name[NAME_LIMIT], target[NAME_LIMIT];
+    uchar addr[4] = { 192, 12, 33, 2 };
+    struct dns_reply r;
+    struct dns_view v;
+    size_t plain = 29;
+    char text[NAME_LIMIT];
+    int n = sizeof(owner) / sizeof(owner[0]);
+
+    dns_reply_start(&r, buf, 29, sizeof(buf));
+
+    for(int i = 0; i < n; i++)
+    {
+        plain += wire(name, owner[i]) + sizeof(RR_t) + 4;
+        assert(dns_reply_add_rr_name(&r, DNS_ANSWER, name, _A, 1, 3600, addr, 4) == 0);
+    }
+    ///a name in the RDATA is compressed too
+    wire(name, "CSL.SRI.COM");
+    plain += wire(target, "KL.SRI.COM") + 13 + sizeof(RR_t);
+    dns_reply_rr_begin(&r, name, _NS, 1, 3600);
+    dns_reply_put_name(&r, target);
+    assert(dns_reply_rr_end(&r, DNS_AUTHORITY) == 0);
+
+    printf("compress: %zu bytes instead of %zu\n", r.len, plain);
+    assert(r.len < plain * 2 / 3);
+
+    assert(dns_view_parse(&v, buf, r.len) == 0);
+    assert(dns_view_count(&v, DNS_ANSWER) == n);
+    for(int i = 0; i < n; i++)
+    {
+        expand(buf, dns_view_rr(&v, DNS_ANSWER, i)->name, text);
+        assert(!strncasecmp(text, owner[i], strlen(owner[i])));
+    }
+    expand(buf, dns_view_rdata(&v, DNS_AUTHORITY, 0) - buf, text);
+    assert(!strcmp(text, "kl.sri.com."));
+    assert(dns_view_rdlength(&v, DNS_AUTHORITY, 0) == 2);
+
+    ///a record which does not fit leaves nothing behind, not even suffixes
+    size_t len = r.len;
+    r.cap = r.len + 20;
+    wire(name, "VERY.LONG.HOST.NAME.CSL.SRI.COM");
+    assert(dns_reply_add_rr_name(&r, DNS_ADDITIONAL, name, _A, 1, 3600, addr, 4) < 0);
+    assert(r.len == len && dns_flag(dns_reply_header(&r), DNS_TC));
+
+    r.cap = sizeof(buf);
+    wire(name, "NAME.CSL.SRI.COM");
+    assert(dns_reply_add_rr_name(&r, DNS_ADDITIONAL, name, _A, 1, 3600, addr, 4) == 0);
+    assert(dns_view_parse(&v, buf, r.len) == 0);
+    expand(buf, dns_view_rr(&v, DNS_ADDITIONAL, 0)->name, text);
+    assert(!strcasecmp(text, "name.csl.sri.com."));
+
+    ///a name already in, ending in a pointer: its own labels are learnt
+    struct dns_comp comp;
+
+    memcpy(buf + 29, "\4mail\xC0\x0C", 7);
+    dns_comp_init(&comp);
+    dns_comp_learn(&comp, buf, 36, 29);
+    wire(name, "MAIL.CSL.SRI.COM");
+    assert(dns_comp_put(&comp, buf, 36, sizeof(buf), name) == 2);
+    assert(buf[36] == 0xC0 && buf[37] == 29);
+    ///but only towards the front: a pointer to itself is not
+    memcpy(buf + 29, "\4mail\xC0\x1D", 7);
+    dns_comp_init(&comp);
+    dns_comp_learn(&comp, buf, 36, 29);
+    assert(comp.n == 0);
+
+    return 0;
+}
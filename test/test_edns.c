@@ -0,0 +1,136 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+
+#include "core/dns.h"
+#include "fixture.h"
+
+struct zone_db *dns_db;
+__thread struct dns_cache *dns_cache;
+
+///@count addresses for @owner, 16 bytes each in a reply
+static void add_many(const char *owner, int count)
+{
+    uchar name[NAME_LIMIT], rdata[4] = { 10, 2 };
+
+    wire(name, owner);
+    for(int i = 0; i < count; i++)
+    {
+        rdata[2] = (uchar) (i >> 8), rdata[3] = (uchar) i;
+        assert(zone_add(dns_db, name, _A, _IN, 3600, rdata, sizeof(rdata)) == 0);
+    }
+}
+
+/**
+ * Query for @host A with an OPT record of @payload, @version and @flags,
+ * or none for a @payload of 0.
+ */
+static size_t query(uchar *buf, const char *host, u16_t payload, u8_t version, u16_t flags)
+{
+    size_t len = make_query(buf, 0xbeef, host, _A, 0);
+
+    if(payload) {
+        struct dns_edns e = { .present = true, .flags = flags };
+
+        dns_edns_write(buf + len, &e, 0);
+        buf[len + 3] = (uchar) (payload >> 8), buf[len + 4] = (uchar) payload;
+        buf[len + 6] = version;
+        len += EDNS_OPT_SIZE;
+        buf[11] = 1;
+    }
+
+    return len;
+}
+
+///the same, answered by dns_process() within @cap
+static size_t ask(uchar *buf, const char *host, u16_t payload, u8_t version, u16_t flags, size_t cap)
+{
+    return dns_process(buf, query(buf, host, payload, version, flags), cap);
+}
+
+static struct dns_view v;
+static struct dns_edns opt;
+
+///parse the reply of @len bytes in @buf into `v` and `opt`
+static void parse(const uchar *buf, size_t len)
+{
+    assert(dns_view_parse(&v, buf, len) == 0);
+    assert(dns_edns_parse(&opt, &v) == 0);
+}
+
+#define hdr(buf) ((DNS_HEADER_t *) (buf))
+
+///for replies of more records than a view takes: does an OPT end it?
+static bool ends_in_opt(const uchar *buf, size_t len)
+{
+    return ntohs(hdr(buf)->arcount) == 1 && buf[len - EDNS_OPT_SIZE] == 0 &&
+           buf[len - EDNS_OPT_SIZE + 2] == _OPT;
+}
+
+int main(int argc, char *argv[])
+{
+    static uchar buf[TCP_LIMIT];
+    uchar soa[2 * NAME_LIMIT + 20] = {0}, name[NAME_LIMIT];
+    size_t n, len;
+
+    dns_db = zone_db_new();
+    n = wire(soa, "ns.sri.com");
+    n += wire(soa + n, "root.sri.com");
+    wire(name, "sri.com");
+    assert(zone_add(dns_db, name, _SOA, _IN, 3600, soa, n + 20) == 0);
+    add_many("big.sri.com", 40);
+    add_many("huge.sri.com", 100);
+
+    ///no OPT: 512 bytes, TC, no OPT back
+    len = ask(buf, "big.sri.com", 0, 0, 0, EDNS_LIMIT);
+    parse(buf, len);
+    assert(len <= UDP_LIMIT && dns_flag(hdr(buf), DNS_TC) && !opt.present);
+
+    ///the payload asked for, our OPT last
+    len = ask(buf, "big.sri.com", EDNS_LIMIT, 0, 0, EDNS_LIMIT);
+    parse(buf, len);
+    assert(len > UDP_LIMIT && !dns_flag(hdr(buf), DNS_TC) && dns_view_count(&v, DNS_ANSWER) == 40);
+    assert(opt.present && opt.payload == EDNS_LIMIT && opt.version == 0 && opt.flags == 0);
+    assert(dns_view_count(&v, DNS_ADDITIONAL) == 1 && len == dns_view_rr(&v, DNS_ADDITIONAL, 0)->fixed + 10);
+
+    ///more than we take is held to EDNS_LIMIT, the OPT still in; less than 512 is 512
+    len = ask(buf, "huge.sri.com", 4096, 0, EDNS_DO, EDNS_LIMIT);
+    assert(len <= EDNS_LIMIT && len > EDNS_LIMIT - 16 && dns_flag(hdr(buf), DNS_TC));
+    assert(ends_in_opt(buf, len) && buf[len - 4] == EDNS_DO >> 8);
+    len = ask(buf, "big.sri.com", 100, 0, 0, EDNS_LIMIT);
+    parse(buf, len);
+    assert(len <= UDP_LIMIT && len > UDP_LIMIT - 16 && dns_flag(hdr(buf), DNS_TC) && opt.present);
+
+    ///over a stream all of it goes, OPT or not
+    len = ask(buf, "huge.sri.com", 0, 0, 0, TCP_LIMIT);
+    assert(!dns_flag(hdr(buf), DNS_TC) && ntohs(hdr(buf)->ancount) == 100 && !hdr(buf)->arcount);
+    len = ask(buf, "huge.sri.com", 600, 0, 0, TCP_LIMIT);
+    assert(!dns_flag(hdr(buf), DNS_TC) && ntohs(hdr(buf)->ancount) == 100 && ends_in_opt(buf, len));
+
+    ///a version we do not speak: BADVERS, its upper bits in the OPT
+    len = ask(buf, "big.sri.com", EDNS_LIMIT, 1, 0, EDNS_LIMIT);
+    parse(buf, len);
+    assert(dns_flag(hdr(buf), DNS_RCODE) == (_BADVERS & 0xF) && dns_view_count(&v, DNS_ANSWER) == 0);
+    assert(opt.present && buf[len - 6] == _BADVERS >> 4);
+
+    ///rcodes below 16 leave the OPT bits at 0
+    len = ask(buf, "nope.sri.com", EDNS_LIMIT, 0, 0, EDNS_LIMIT);
+    parse(buf, len);
+    assert(dns_flag(hdr(buf), DNS_RCODE) == _NXDOMAIN && dns_flag(hdr(buf), DNS_AA) && opt.present && buf[len - 6] == 0);
+    assert(dns_view_count(&v, DNS_AUTHORITY) == 1);
+
+    ///two OPT records, or one not owned by the root: FORMERR
+    len = query(buf, "big.sri.com", EDNS_LIMIT, 0, 0);
+    memcpy(buf + len, buf + len - EDNS_OPT_SIZE, EDNS_OPT_SIZE);
+    buf[11] = 2;
+    assert(dns_process(buf, len + EDNS_OPT_SIZE, EDNS_LIMIT) > 0 && dns_flag(hdr(buf), DNS_RCODE) == _FORMERR);
+    len = query(buf, "big.sri.com", EDNS_LIMIT, 0, 0);
+    n = len - EDNS_OPT_SIZE;
+    memmove(buf + n + 2, buf + n, EDNS_OPT_SIZE);
+    buf[n] = 1, buf[n + 1] = 'x';
+    assert(dns_process(buf, len + 2, EDNS_LIMIT) > 0 && dns_flag(hdr(buf), DNS_RCODE) == _FORMERR);
+
+    printf("edns: %d byte answers in one datagram, %d before\n", EDNS_LIMIT, UDP_LIMIT);
+    zone_db_free(dns_db);
+    return 0;
+}
@@ -0,0 +1,70 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#include "fixture.h"
+#include "core/intern.h"
+
+static const struct dns_name *intern(struct dns_intern *t, const char *host)
+{
+    uchar dns[NAME_LIMIT + 1];
+
+    wire(dns, host);
+    return dns_intern(t, dns);
+}
+
+int main(int argc, char *argv[])
+{
+    struct dns_intern *t = dns_intern_new(0);
+    const struct dns_name *csl = intern(t, "CSL.SRI.COM");
+    const struct dns_name *sri = intern(t, "sri.com");
+    const struct dns_name *gw = intern(t, "gw.csl.Sri.Com");
+    const struct dns_name *kl = intern(t, "kl.sri.com");
+    const struct dns_name *root;
+
+    ///one copy per name, in lower case, its ancestors shared
+    assert(csl == intern(t, "csl.sri.com") && csl != sri);
+    assert(!memcmp(dns_name_wire(csl), "\3csl\3sri\3com", 13) && csl->len == 13);
+    assert(csl->parent == sri && gw->parent == csl && kl->parent == sri);
+    assert(t->count == 6);
+
+    assert(gw->nlabels == 4 && dns_name_label(gw, 1) == dns_name_wire(gw) + 3);
+    assert(dns_name_label(gw, 3)[0] == 3 && dns_name_label(gw, 3)[1] == 'c');
+
+    root = dns_name_ancestor(gw, 0);
+    assert(root && root->nlabels == 0 && root->len == 1 && !root->parent);
+    assert(dns_name_ancestor(gw, 2) == sri && !dns_name_ancestor(sri, 3));
+
+    assert(dns_name_is_subdomain(gw, sri) && dns_name_is_subdomain(gw, gw));
+    assert(dns_name_is_subdomain(kl, root) && !dns_name_is_subdomain(kl, csl));
+    assert(!dns_name_is_subdomain(sri, gw));
+
+    ///lookups do not intern
+    uchar dns[] = "\3www\3SRI\3com";
+
+    assert(!dns_intern_find(t, dns) && t->count == 6);
+    dns[1] = 'g', dns[2] = 'w', dns[3] = 0, dns[0] = 2;
+    assert(!dns_intern_find(t, dns));
+    memcpy(dns, "\2KL\3sri\3com", 12);
+    assert(dns_intern_find(t, dns) == kl);
+
+    ///a pointer is not a wire name
+    dns[0] = 0xC0;
+    assert(!dns_intern(t, dns));
+
+    ///enough names to grow the table, all still there
+    char host[64];
+    const struct dns_name *first = intern(t, "h0.example.com");
+
+    for(int i = 1; i < 10000; i++)
+    {
+        snprintf(host, sizeof(host), "h%d.example.com", i);
+        assert(intern(t, host)->parent == first->parent);
+    }
+    assert(intern(t, "H0.EXAMPLE.COM") == first);
+    dns_intern_stats_show(t);
+
+    dns_intern_free(t);
+    return 0;
+}
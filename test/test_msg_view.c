@@ -0,0 +1,167 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <time.h>
+
+#include "protocol/msg_view.h"
+
+/**
+ * Reply to `www.sri.com A`: the question, one A record whose owner is a
+ * pointer to the question name, one OPT record in the additional section.
+ */
+static const uchar packet[] = {
+    0x12, 0x34, 0x81, 0x80, 0x00, 0x01, 0x00, 0x01, 0x00, 0x00, 0x00, 0x01,
+    3, 'w', 'w', 'w', 3, 's', 'r', 'i', 3, 'c', 'o', 'm', 0,
+    0x00, 0x01, 0x00, 0x01,
+    0xC0, 0x0C, 0x00, 0x01, 0x00, 0x01, 0x00, 0x00, 0x0e, 0x10, 0x00, 0x04,
+    192, 0, 2, 1,
+    0x00, 0x00, 0x29, 0x10, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+};
+
+///`sri.com A` with an OPT record asking for 1232 bytes
+static const uchar query[] = {
+    0xbe, 0xef, 0x01, 0x00, 0x00, 0x01, 0x00, 0x00, 0x00, 0x00, 0x00, 0x01,
+    3, 's', 'r', 'i', 3, 'c', 'o', 'm', 0, 0x00, 0x01, 0x00, 0x01,
+    0x00, 0x00, 0x29, 0x04, 0xd0, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+};
+
+///the fast path, when it takes @buf, indexes it as the general parser does
+static int same_view(const uchar *buf, size_t len)
+{
+    struct dns_view fast, slow;
+    int ret = dns_view_fast(&fast, buf, len);
+
+    if(ret == 0) {
+        assert(dns_view_parse(&slow, buf, len) == 0);
+        assert(!memcmp(fast.first, slow.first, sizeof(fast.first)));
+        assert(!memcmp(fast.rr, slow.rr, fast.first[DNS_SECTIONS] * sizeof(fast.rr[0])));
+    }
+    assert(dns_view_parse_query(&fast, buf, len) == dns_view_parse(&slow, buf, len));
+    return ret;
+}
+
+static double ns_per_packet(int (*parse)(struct dns_view *, const uchar *, size_t), const uchar *buf, size_t len)
+{
+    struct timespec t0, t1;
+    struct dns_view v;
+    int loops = 1000 * 1000;
+    volatile int sink = 0;
+
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    for(int i = 0; i < loops; i++)
+        sink += parse(&v, buf, len);
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+
+    return ((t1.tv_sec - t0.tv_sec) * 1e9 + (t1.tv_nsec - t0.tv_nsec)) / loops;
+}
+
+int main(int argc, char *argv[])
+{
+    struct dns_view v;
+    uchar bad[sizeof(packet)];
+
+    assert(dns_view_parse(&v, packet, sizeof(packet)) == 0);
+    assert(dns_view_count(&v, DNS_QUESTION) == 1);
+    assert(dns_view_count(&v, DNS_ANSWER) == 1);
+    assert(dns_view_count(&v, DNS_AUTHORITY) == 0);
+    assert(dns_view_count(&v, DNS_ADDITIONAL) == 1);
+
+    assert(dns_view_name(&v, DNS_QUESTION, 0) == packet + 12);
+    assert(dns_view_type(&v, DNS_QUESTION, 0) == _A);
+    assert(dns_view_qend(&v) == 29);
+
+    assert(dns_view_name(&v, DNS_ANSWER, 0)[0] == 0xC0);
+    assert(dns_view_type(&v, DNS_ANSWER, 0) == _A);
+    assert(dns_view_class(&v, DNS_ANSWER, 0) == 1);
+    assert(dns_view_ttl(&v, DNS_ANSWER, 0) == 3600);
+    assert(dns_view_rdlength(&v, DNS_ANSWER, 0) == 4);
+    assert(dns_view_rdata(&v, DNS_ANSWER, 0)[0] == 192);
+
+    assert(dns_view_type(&v, DNS_ADDITIONAL, 0) == 41);
+    assert(dns_view_class(&v, DNS_ADDITIONAL, 0) == 4096);
+
+    ///flags are read in wire order on any host: 0x8180 is QR, RD and RA
+    assert(dns_header_member(dns_view_header(&v), qr) == 1 && dns_header_member(dns_view_header(&v), rd) == 1);
+    assert(dns_flag(dns_view_header(&v), DNS_RA) == 1 && dns_flag(dns_view_header(&v), DNS_AA) == 0);
+    assert(dns_flag(dns_view_header(&v), DNS_OPCODE) == _STD_QUERY && dns_flag(dns_view_header(&v), DNS_RCODE) == 0);
+
+    ///a query with RD and opcode 2 turned into its reply, then changed field by field
+    DNS_HEADER_t *h = (DNS_HEADER_t *) bad;
+
+    memcpy(bad, query, sizeof(query));
+    bad[2] = 0x11, bad[3] = 0x70;
+    dns_header_make_reply(h, DNS_AA | DNS_TC, _NXDOMAIN);
+    assert(bad[2] == 0x95 && bad[3] == 0x03 && dns_flag(h, DNS_OPCODE) == _STATUS_QUERY);
+    dns_flag_set(h, DNS_RCODE, _REFUSED);
+    dns_flag_set(h, DNS_TC, 1);
+    dns_flag_set(h, DNS_Z, 0xf);
+    assert(bad[2] == 0x97 && bad[3] == 0x75 && dns_header_member(h, z) == 7);
+    h->flags = htons(dns_flags_make(0, _UPDATE, 0, 0, 1, 0, 0, _NOERROR));
+    assert(bad[2] == 0x29 && bad[3] == 0x00);
+
+    ///every cut of the packet is rejected
+    for(size_t len = 0; len < sizeof(packet); len++)
+        assert(dns_view_parse(&v, packet, len) < 0);
+
+    ///rdlength past the end
+    memcpy(bad, packet, sizeof(packet));
+    bad[40] = 0x05;
+    assert(dns_view_parse(&v, bad, sizeof(bad)) < 0);
+
+    ///label type 0x40 is not defined
+    memcpy(bad, packet, sizeof(packet));
+    bad[12] = 0x43;
+    assert(dns_view_parse(&v, bad, sizeof(bad)) < 0);
+
+    ///more records than the index holds
+    memcpy(bad, packet, sizeof(packet));
+    bad[10] = 0xff;
+    assert(dns_view_parse(&v, bad, sizeof(bad)) < 0);
+
+    ///plain queries, with or without OPT, take the fast path
+    assert(same_view(query, sizeof(query)) == 0);
+    memcpy(bad, query, sizeof(query));
+    bad[11] = 0;
+    assert(same_view(bad, 25) == 0);
+    assert(same_view(bad, sizeof(query)) == 0);
+    for(size_t len = 0; len < sizeof(query); len++)
+        same_view(query, len);
+
+    ///a question name of NAME_LIMIT bytes at most, on either path
+    uchar big[UDP_LIMIT];
+    size_t off = sizeof(DNS_HEADER_t);
+
+    memcpy(big, query, off);
+    big[11] = 0;
+    for(int i = 0; i < 4; i++, off += 64)
+    {
+        memset(big + off, 'a', 64);
+        big[off] = i < 3 ? 63 : 61;
+    }
+    off -= 2;
+    memcpy(big + off, "\0\0\1\0\1", 5);
+    assert(same_view(big, off + 5) == 0);
+    big[off - 62] = 62;
+    memcpy(big + off + 1, "\0\0\1\0\1", 5);
+    assert(same_view(big, off + 6) < 0 && dns_view_parse(&v, big, off + 6) < 0);
+
+    ///anything else is left to the general parser
+    assert(same_view(packet, sizeof(packet)) < 0);
+    memcpy(bad, query, sizeof(query));
+    bad[5] = 2;
+    assert(same_view(bad, sizeof(query)) < 0);
+    memcpy(bad, query, sizeof(query));
+    bad[25] = 1;
+    assert(same_view(bad, sizeof(query)) < 0);
+    memcpy(bad, query, sizeof(query));
+    bad[12] = 0xC0, bad[13] = 12;
+    assert(same_view(bad, sizeof(query)) < 0);
+    memcpy(bad, query, sizeof(query));
+    bad[34] = 1;
+    assert(same_view(bad, sizeof(query)) < 0);
+
+    printf("msg_view: %.1f ns per query on the fast path, %.1f ns through the parser\n",
+            ns_per_packet(dns_view_fast, query, sizeof(query)),
+            ns_per_packet(dns_view_parse, query, sizeof(query)));
+    return 0;
+}
@@ -0,0 +1,159 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <time.h>
+
+#include "protocol/message.h"
+#include "core/dns_util.h"
+
+/**
+ * dns_to_host_name() as it was before dns_name_decode(): one pointer,
+ * byte by byte, no bounds. Kept to measure against.
+ */
+static void legacy_to_host_name(char *host, uchar *buf, size_t *locate)
+{
+    u16_t offset = 0xFFFF;
+    if( is_compressive(&buf[*locate])) {
+        offset = ((((u16_t) buf[*locate]) << 8) + buf[*locate + 1]) & compression_mask;
+        *locate += 2;
+    }
+    else
+        *locate += strlen((char *) &buf[*locate]) - 1;
+
+    uchar *dn = offset != 0xFFFF ? &buf[offset]: &buf[*locate];
+
+    int i = 0;
+    for(uchar count = dn[0]; count != 0; count = dn[i])
+    {
+        while(count-- != 0) {
+            host[i] = dn[i + 1];
+            i++;
+        }
+        host[i++] = '.';
+    }
+    host[i - 1] = '\0';
+}
+
+static double elapsed(struct timespec *t0, struct timespec *t1, int n)
+{
+    return ((t1->tv_sec - t0->tv_sec) * 1e9 + (t1->tv_nsec - t0->tv_nsec)) / n;
+}
+
+static void bench(const char *what, uchar *buf, size_t at, int n)
+{
+    struct timespec t0, t1;
+    char host[NAME_TEXT_LIMIT];
+    uchar key[NAME_LIMIT];
+    volatile size_t sink = 0;
+    double legacy, text, lookup;
+
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    for(int i = 0; i < n; i++)
+    {
+        size_t locate = at;
+
+        legacy_to_host_name(host, buf, &locate);
+        sink += locate + host[0];
+    }
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    legacy = elapsed(&t0, &t1, n);
+
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    for(int i = 0; i < n; i++)
+        sink += dns_name_decode(buf, UDP_LIMIT, at, (uchar *) host, sizeof(host), NAME_TEXT, NULL);
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    text = elapsed(&t0, &t1, n);
+
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    for(int i = 0; i < n; i++)
+        sink += dns_name_decode(buf, UDP_LIMIT, at, key, sizeof(key), NAME_KEY, NULL);
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    lookup = elapsed(&t0, &t1, n);
+
+    printf("name: %-6s legacy %.1f ns, text %.1f ns, key %.1f ns\n", what, legacy, text, lookup);
+}
+
+int main(int argc, char *argv[])
+{
+    uchar buf[UDP_LIMIT] = {
+        0x12, 0x34, 0x81, 0x80, 0x00, 0x01, 0x00, 0x01, 0x00, 0x00, 0x00, 0x00,
+        3, 'W', 'w', 'W', 3, 's', 'r', 'i', 3, 'c', 'o', 'm', 0,
+        0x00, 0x01, 0x00, 0x01,
+        ///29: "ns" and a pointer to "sri.com", 34: a pointer to that
+        2, 'n', 's', 0xC0, 0x10,
+        0xC0, 0x1D,
+    };
+    char host[NAME_TEXT_LIMIT];
+    uchar key[NAME_LIMIT];
+    size_t end, locate;
+
+    assert(dns_name_decode(buf, 36, 12, (uchar *) host, sizeof(host), NAME_TEXT, &end) == 11);
+    assert(!strcmp(host, "WwW.sri.com") && end == 25);
+
+    assert(dns_name_decode(buf, 36, 12, key, sizeof(key), NAME_KEY, NULL) == 13);
+    assert(!memcmp(key, "\3www\3sri\3com", 13));
+
+    ///a chain of pointers, the end is behind the first one
+    assert(dns_name_decode(buf, 36, 34, (uchar *) host, sizeof(host), NAME_TEXT, &end) == 10);
+    assert(!strcmp(host, "ns.sri.com") && end == 36);
+
+    assert(dns_name_decode(buf, 36, 24, (uchar *) host, sizeof(host), NAME_TEXT, NULL) == 1);
+    assert(!strcmp(host, "."));
+
+    ///the wire name as it was sent, case kept
+    assert(dns_name_decode(buf, UDP_LIMIT, 12, key, sizeof(key), NAME_WIRE, NULL) == 13);
+    assert(!memcmp(key, "\3WwW\3sri\3com", 13));
+
+    ///dns_to_host_name() steps over the name it expands
+    locate = 29;
+    dns_to_host_name(host, buf, &locate);
+    assert(!strcmp(host, "ns.sri.com") && locate == 34);
+
+    ///cut short, forward pointer, pointer to itself, a loop
+    assert(dns_name_decode(buf, 35, 34, key, sizeof(key), NAME_KEY, NULL) < 0);
+    assert(dns_name_decode(buf, 24, 12, key, sizeof(key), NAME_KEY, NULL) < 0);
+    buf[35] = 0x30;
+    assert(dns_name_decode(buf, 36, 34, key, sizeof(key), NAME_KEY, NULL) < 0);
+    buf[35] = 0x22;
+    assert(dns_name_decode(buf, 36, 34, key, sizeof(key), NAME_KEY, NULL) < 0);
+    buf[33] = 0x1D;
+    assert(dns_name_decode(buf, 36, 29, key, sizeof(key), NAME_KEY, NULL) < 0);
+    ///failing behind a pointer, dns_to_host_name() does not step anywhere
+    buf[33] = 0x10, buf[20] = 0x40;
+    locate = 29;
+    dns_to_host_name(host, buf, &locate);
+    assert(host[0] == '\0' && locate == 29);
+    buf[20] = 3;
+
+    ///labels of 64 and more, names longer than NAME_LIMIT, escapes
+    memset(buf + 40, 'a', 300);
+    buf[40] = 64, buf[105] = 0;
+    assert(dns_name_decode(buf, UDP_LIMIT, 40, key, sizeof(key), NAME_KEY, NULL) < 0);
+    for(int i = 0; i < 5; i++)
+        buf[40 + 52 * i] = 51;
+    buf[40 + 52 * 5] = 0;
+    assert(dns_name_decode(buf, UDP_LIMIT, 40, key, sizeof(key), NAME_KEY, NULL) < 0);
+    buf[40 + 52 * 4] = 0;
+    assert(dns_name_decode(buf, UDP_LIMIT, 40, key, sizeof(key), NAME_KEY, NULL) == 52 * 4 + 1);
+    buf[41] = '.', buf[42] = 0, buf[43] = 'A';
+    assert(dns_name_decode(buf, UDP_LIMIT, 40, (uchar *) host, sizeof(host), NAME_TEXT, NULL) > 0);
+    assert(!strncmp(host, "\\.\\000Aaa", 9));
+    assert(dns_name_decode(buf, UDP_LIMIT, 40, (uchar *) host, 64, NAME_TEXT, NULL) < 0);
+    ///escaped text well over NAME_LIMIT still fits a host of NAME_TEXT_LIMIT
+    memset(buf + 41, 0, 51);
+    buf[105] = 'a';
+    locate = 40;
+    dns_to_host_name(host, buf, &locate);
+    assert(strlen(host) == 51 * 4 + 3 * 52 && locate == 40 + 52 * 4 + 1);
+
+    ///the owner of an answer: a pointer to the question
+    memcpy(buf + 12, "\3www\3sri\3com\0\0\1\0\1\xC0\x0C", 19);
+    bench("short", buf, 29, 1000 * 1000);
+
+    memcpy(buf + 12, "\x3f" "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789-"
+            "\x1f" "abcdefghijklmnopqrstuvwxyz01234" "\3com\0\0\1\0\1\xC0\x0C", 107);
+    bench("long", buf, 117, 1000 * 1000);
+
+    return 0;
+}
@@ -0,0 +1,37 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <assert.h>
+
+#include "core/pktpool.h"
+
+int main(int argc, char *argv[])
+{
+    struct pktpool *pool = pktpool_new(4, 1500);
+    uchar *slot[4];
+
+    assert(pool->slot_size == 1536);
+
+    for(int i = 0; i < 4; i++)
+    {
+        slot[i] = pkt_get(pool);
+        assert(slot[i]);
+        assert(((uintptr_t) slot[i] & (CACHE_LINE - 1)) == 0);
+        assert(pkt_owns(pool, slot[i]));
+    }
+    assert(!pkt_get(pool));
+    assert(pool->misses == 1);
+    assert(pool->high_water == 4);
+
+    pkt_put(pool, slot[2]);
+    assert(pkt_get(pool) == slot[2]);
+
+    for(int i = 0; i < 4; i++)
+        pkt_put(pool, slot[i]);
+    assert(pool->nfree == 4);
+    assert(pool->high_water == 4);
+
+    pktpool_stats_show(pool);
+    pktpool_free(pool);
+    return 0;
+}
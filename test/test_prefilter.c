@@ -0,0 +1,94 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <time.h>
+
+#include "core/dns.h"
+#include "fixture.h"
+
+struct zone_db *dns_db;
+__thread struct dns_cache *dns_cache;
+
+///query for @host A into slot @i of @b, as recvmmsg() would leave it
+static size_t query(struct dns_batch *b, unsigned int i, const char *host)
+{
+    size_t len = make_query(batch_rbuf(b, i), 0xbe00 | i, host, _A, 0);
+
+    b->rmsg[i].msg_len = (unsigned int) len;
+    return len;
+}
+
+int main(int argc, char *argv[])
+{
+    struct pktpool *pool = pktpool_new(16, PKT_LIMIT);
+    struct dns_batch *b = batch_new(16, pool);
+    struct prefilter_stats st = {0};
+    uchar *buf;
+
+    ///one good query in every other slot, junk of each kind in between
+    for(unsigned int i = 0; i < 12; i++)
+        query(b, i, "kl.sri.com");
+    b->rmsg[1].msg_len = sizeof(DNS_HEADER_t) + 4;
+    dns_flag_set((DNS_HEADER_t *) batch_rbuf(b, 3), DNS_QR, 1);
+    dns_flag_set((DNS_HEADER_t *) batch_rbuf(b, 5), DNS_OPCODE, _UPDATE);
+    batch_rbuf(b, 7)[5] = 0;
+    batch_rbuf(b, 9)[5] = 100;
+    b->rmsg[11].msg_len -= 10;
+    b->count = 12;
+
+    assert(batch_prefilter(b, &st) == 6 && b->nlive == 6);
+    for(unsigned int k = 0; k < b->nlive; k++)
+        assert(b->live[k] == 2 * k);
+    assert(st.count[FILTER_PASS] == 6);
+    for(int i = 0; i < FILTER_PASS; i++)
+        assert(st.count[i] == (i == FILTER_QDCOUNT ? 2 : 1));
+
+    ///the first reason found is the one counted
+    buf = batch_rbuf(b, 0);
+    assert(prefilter_check(buf, 3) == FILTER_SHORT);
+    dns_flag_set((DNS_HEADER_t *) buf, DNS_OPCODE, _NOTTIFY);
+    buf[5] = 0;
+    assert(prefilter_check(buf, b->rmsg[0].msg_len) == FILTER_OPCODE);
+
+    ///a question may be the root, but no label may point or run past the end
+    query(b, 0, "kl.sri.com");
+    buf[12] = 0xc0;
+    assert(prefilter_check(buf, b->rmsg[0].msg_len) == FILTER_QUESTION);
+    buf[12] = 0;
+    assert(prefilter_check(buf, sizeof(DNS_HEADER_t) + 5) == FILTER_PASS);
+    assert(prefilter_check(buf, sizeof(DNS_HEADER_t) + 4) == FILTER_SHORT);
+    buf[12] = 2;
+    assert(prefilter_check(buf, b->rmsg[0].msg_len) == FILTER_PASS);
+    assert(prefilter_check(buf, sizeof(DNS_HEADER_t) + 3 + 5) == FILTER_QUESTION);
+    prefilter_stats_show(&st);
+
+    ///cost of a flood of junk: dropped up front or answered FORMERR
+    struct timespec t0, t1, t2;
+    int loops = 100 * 1000;
+    volatile ssize_t sink = 0;
+
+    for(unsigned int i = 0; i < b->size; i++)
+    {
+        query(b, i, "kl.sri.com");
+        batch_rbuf(b, i)[12] = 0xc0;
+    }
+    b->count = b->size;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    for(int n = 0; n < loops; n++)
+        sink += batch_prefilter(b, &st);
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    for(int n = 0; n < loops; n++)
+        for(unsigned int i = 0; i < b->count; i++)
+        {
+            batch_rbuf(b, i)[2] = 0, batch_rbuf(b, i)[5] = 1, batch_rbuf(b, i)[12] = 0xc0;
+            sink += dns_process(batch_rbuf(b, i), batch_rlen(b, i), EDNS_LIMIT);
+        }
+    clock_gettime(CLOCK_MONOTONIC, &t2);
+    printf("prefilter: %.1f ns per junk datagram, %.1f ns to answer it\n",
+            ((t1.tv_sec - t0.tv_sec) * 1e9 + (t1.tv_nsec - t0.tv_nsec)) / loops / b->size,
+            ((t2.tv_sec - t1.tv_sec) * 1e9 + (t2.tv_nsec - t1.tv_nsec)) / loops / b->size);
+
+    batch_free(b, pool);
+    pktpool_free(pool);
+    return 0;
+}
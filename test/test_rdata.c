@@ -0,0 +1,139 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+
+#include "protocol/rdata.h"
+#include "protocol/reply.h"
+#include "protocol/msg_view.h"
+#include "fixture.h"
+
+static const uchar query[] = {
+    0x12, 0x34, 0x01, 0x00, 0x00, 0x01, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    3, 's', 'r', 'i', 3, 'c', 'o', 'm', 0, 0x00, 0xff, 0x00, 0x01,
+};
+
+/**
+ * Put the record of @type and @rdata into a reply owned by kl.sri.com, then
+ * decode it back out of the message and print it.
+ *
+ * @return rdlength in the message, the names in it compressed
+ */
+static u16_t round_trip(u16_t type, const uchar *rdata, u16_t rdlen, const char *text)
+{
+    const struct dns_rdata_ops *ops = dns_rdata(type);
+    uchar buf[UDP_LIMIT], owner[NAME_LIMIT], out[UDP_LIMIT];
+    char str[4096];
+    struct dns_reply r;
+    struct dns_view v;
+    u16_t at[RDATA_NAMES];
+    ssize_t n;
+
+    assert(ops->names(rdata, rdlen, at) >= 0);
+
+    memcpy(buf, query, sizeof(query));
+    dns_reply_start(&r, buf, sizeof(query), sizeof(buf));
+    wire(owner, "kl.sri.com");
+    assert(dns_reply_add_rr_name(&r, DNS_ANSWER, owner, type, _IN, 3600, rdata, rdlen) == 0);
+    assert(dns_view_parse(&v, buf, r.len) == 0 && dns_view_count(&v, DNS_ANSWER) == 1);
+
+    n = ops->decode(buf, r.len, dns_view_rdata(&v, DNS_ANSWER, 0) - buf,
+                    dns_view_rdlength(&v, DNS_ANSWER, 0), out, sizeof(out));
+    ///a name compressed against another takes the case of that one
+    assert(n == rdlen && ops->compare(out, n, rdata, rdlen) == 0);
+
+    n = ops->print(str, sizeof(str), rdata, rdlen);
+    assert(n == (ssize_t) strlen(text) && !strcmp(str, text));
+    assert((size_t) n < ops->size(rdata, rdlen));
+
+    return dns_view_rdlength(&v, DNS_ANSWER, 0);
+}
+
+int main(int argc, char *argv[])
+{
+    uchar rdata[1024], other[1024];
+    size_t n;
+
+    static const uchar a[] = { 10, 1, 0, 52 };
+    assert(round_trip(_A, a, sizeof(a), "10.1.0.52") == 4);
+
+    ///names below sri.com shrink to a label and a pointer
+    n = wire(rdata, "Stripe.SRI.com");
+    assert(round_trip(_NS, rdata, n, "Stripe.SRI.com.") == 1 + 6 + 2);
+    assert(round_trip(_PTR, rdata, n, "Stripe.SRI.com.") == 1 + 6 + 2);
+    n = wire(rdata, "sri-nic.arpa");
+    assert(round_trip(_CNAME, rdata, n, "sri-nic.arpa.") == n);
+    rdata[0] = 0;
+    assert(round_trip(_MB, rdata, 1, ".") == 1);
+
+    rdata[0] = 0, rdata[1] = 10;
+    n = 2 + wire(rdata + 2, "kl.sri.com");
+    assert(round_trip(_MX, rdata, n, "10 kl.sri.com.") == 2 + 2);
+
+    n = wire(rdata, "ns.sri.com");
+    n += wire(rdata + n, "root.sri.com");
+    static const uchar counters[20] = { 0, 0, 0, 1, 0, 0, 0x0e, 0x10, 0, 0, 0x02, 0x58,
+                                        0, 0x09, 0x3a, 0x80, 0, 0, 0x0e, 0x10 };
+    memcpy(rdata + n, counters, sizeof(counters));
+    n += sizeof(counters);
+    assert(round_trip(_SOA, rdata, n, "ns.sri.com. root.sri.com. 1 3600 600 604800 3600") ==
+           1 + 2 + 2 + 1 + 4 + 2 + 20);
+
+    n = wire(rdata, "owner-list.sri.com");
+    n += wire(rdata + n, "errors.sri.com");
+    assert(round_trip(_MINFO, rdata, n, "owner-list.sri.com. errors.sri.com.") < n);
+
+    static const uchar hinfo[] = "\x0a" "DEC-2060\\\"" "\x05" "TOPS2";
+    assert(round_trip(_HINFO, hinfo, sizeof(hinfo) - 1, "\"DEC-2060\\\\\\\"\" \"TOPS2\"") == 17);
+    static const uchar txt[] = "\x02" "hi" "\x00" "\x03" "a\tb";
+    assert(round_trip(_TXT, txt, sizeof(txt) - 1, "\"hi\" \"\" \"a\\009b\"") == 8);
+
+    ///TCP: ports 21, 23, 25
+    static const uchar wks[] = { 10, 0, 0, 51, 6, 0, 0, 0x05, 0x40 };
+    assert(round_trip(_WKS, wks, sizeof(wks), "10.0.0.51 6 21 23 25") == sizeof(wks));
+
+    static const uchar blob[] = { 0xde, 0xad, 0x00 };
+    assert(round_trip(_NULL, blob, sizeof(blob), "\\# 3 dead00") == 3);
+    assert(round_trip(99, blob, sizeof(blob), "\\# 3 dead00") == 3);
+    assert(round_trip(99, blob, 0, "\\# 0") == 0);
+    assert(dns_rdata(_MX)->name && !strcmp(dns_rdata(_MX)->name, "MX") && !dns_rdata(99)->name);
+
+    ///malformed RDATA is refused by every entry point
+    u16_t at[RDATA_NAMES];
+
+    assert(dns_rdata(_A)->names(a, 3, at) < 0);
+    assert(dns_rdata(_WKS)->names(wks, 4, at) < 0);
+    assert(dns_rdata(_HINFO)->names(txt, sizeof(txt) - 1, at) < 0);
+    assert(dns_rdata(_TXT)->names(txt, 2, at) < 0 && dns_rdata(_TXT)->names(txt, 0, at) < 0);
+    rdata[0] = 0, rdata[1] = 10, rdata[2] = 0xC0, rdata[3] = 12;
+    assert(dns_rdata(_MX)->names(rdata, 4, at) < 0);
+    n = wire(rdata, "kl.sri.com");
+    assert(dns_rdata(_NS)->names(rdata, n - 1, at) < 0 && dns_rdata(_NS)->names(rdata, n + 1, at) < 0);
+    assert(dns_rdata(_SOA)->names(rdata, n, at) < 0);
+
+    ///a pointer in a message may only point back
+    uchar msg[64] = { 3, 'c', 'o', 'm', 0, 2, 'k', 'l', 0xC0, 0, 0xC0, 12 };
+
+    assert(dns_rdata(_NS)->decode(msg, sizeof(msg), 5, 5, other, sizeof(other)) == 8);
+    assert(!memcmp(other, "\2kl\3com", 8));
+    assert(dns_rdata(_NS)->decode(msg, sizeof(msg), 10, 2, other, sizeof(other)) < 0);
+    assert(dns_rdata(_NS)->decode(msg, sizeof(msg), 5, 4, other, sizeof(other)) < 0);
+    assert(dns_rdata(_NS)->decode(msg, sizeof(msg), 5, 5, other, 4) < 0);
+
+    ///canonical order: names without case, then octets, shorter first
+    n = wire(rdata, "A.sri.com");
+    wire(other, "a.SRI.COM");
+    assert(dns_rdata(_NS)->compare(rdata, n, other, n) == 0);
+    wire(other, "b.sri.com");
+    assert(dns_rdata(_NS)->compare(rdata, n, other, n) < 0);
+    assert(dns_rdata(_TXT)->compare(txt, 3, txt, 4) < 0);
+    assert(dns_rdata(_A)->compare(a, 4, wks, 4) > 0);
+
+    ///nothing is written past the end of the text
+    char small[8];
+
+    assert(dns_rdata(_WKS)->print(small, sizeof(small), wks, sizeof(wks)) < 0);
+    assert(dns_rdata(_MX)->print(small, sizeof(small), rdata, n) < 0);
+
+    printf("rdata: %zu types\n", ARRAY_SIZE(dns_rdata_table) - 1);
+    return 0;
+}
@@ -0,0 +1,158 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <signal.h>
+
+#include "core/dns.h"
+#include "core/reactor.h"
+
+struct zone_db *dns_db;
+__thread struct dns_cache *dns_cache;
+
+///queries of one client: more than a pipeline holds
+#define QUERIES (3 * PIPELINE_LIMIT)
+
+///answers by setting QR, as a reply of the query's length
+static ssize_t echo(uchar *buf, ssize_t len, size_t cap)
+{
+    dns_flag_set((DNS_HEADER_t *) buf, DNS_QR, 1);
+    return len;
+}
+
+static int tcp_connect(struct sockaddr_in *addr)
+{
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+
+    assert(fd >= 0 && connect(fd, (struct sockaddr *) addr, sizeof(*addr)) == 0);
+    return fd;
+}
+
+/**
+ * A connection taken before the handoff, its queries sent but not read yet,
+ * the client closing its side after them if @done. Every query must be
+ * answered before the reactor leaves.
+ */
+static void handoff(int lfd, struct sockaddr_in *addr, bool done)
+{
+    volatile sig_atomic_t stop = 0, drain = 0;
+    struct pktpool *pool = pktpool_new(4 + POOL_TCP_SLOTS, PKT_LIMIT);
+    struct reactor *r = reactor_new(echo, pool, 4, 1);
+    uchar out[QUERIES][2 + sizeof(DNS_HEADER_t)], in[sizeof(out)];
+    size_t got;
+    ssize_t n;
+    int fd, late;
+
+    reactor_add_listener(r, lfd, SOCK_STREAM);
+    fd = tcp_connect(addr);
+    reactor_accept(r, &r->lfd[0]);
+    assert(r->nconns == 1);
+
+    memset(out, 0, sizeof(out));
+    for(int i = 0; i < QUERIES; i++)
+    {
+        out[i][1] = sizeof(DNS_HEADER_t);
+        out[i][2] = (uchar) (i >> 8), out[i][3] = (uchar) i;
+    }
+    assert(write(fd, out, sizeof(out)) == sizeof(out));
+    if(done)
+        assert(shutdown(fd, SHUT_WR) == 0);
+
+    ///a connection still waiting on the listener belongs to the successor
+    late = tcp_connect(addr);
+
+    /**
+     * The handoff: stop stays clear, the reactor leaves once all is answered
+     * and the connection closed. A client which does not close is sent a FIN
+     * after its replies and let go when it goes idle.
+     */
+    drain = 1;
+    reactor_run(r, &stop, &drain);
+    assert(r->nconns == 0 && r->accepted == 1 && r->tcp_queries == QUERIES);
+    assert(r->timeouts == !done);
+
+    for(got = 0; (n = read(fd, in + got, sizeof(in) - got)) > 0; got += n)
+        ;
+    assert(n == 0 && got == sizeof(in));
+    for(int i = 0; i < QUERIES; i++)
+    {
+        DNS_HEADER_t *hdr = (DNS_HEADER_t *) (in + i * sizeof(out[0]) + 2);
+
+        assert(ntohs(hdr->id) == i && dns_flag(hdr, DNS_QR));
+    }
+
+    n = accept(lfd, NULL, NULL);
+    assert(n >= 0);
+    close(n);
+
+    close(late);
+    close(fd);
+    reactor_stats_show(r);
+    reactor_free(r);
+    pktpool_free(pool);
+}
+
+/**
+ * A reply the kernel refuses to send is dropped alone: the rest of the
+ * batch still goes out.
+ */
+static void send_errors(void)
+{
+    struct sockaddr_in addr = { .sin_family = AF_INET, .sin_addr.s_addr = htonl(INADDR_LOOPBACK) };
+    socklen_t len = sizeof(addr);
+    struct pktpool *pool = pktpool_new(4, PKT_LIMIT);
+    struct dns_batch *b = batch_new(4, pool);
+    int rfd = socket(AF_INET, SOCK_DGRAM, 0), wfd = socket(AF_INET, SOCK_DGRAM, 0);
+    uchar buf[16];
+
+    assert(rfd >= 0 && wfd >= 0 && bind(rfd, (struct sockaddr *) &addr, sizeof(addr)) == 0);
+    assert(getsockname(rfd, (struct sockaddr *) &addr, &len) == 0);
+
+    for(unsigned int i = 0; i < 4; i++)
+    {
+        memcpy(&b->addr[i], &addr, sizeof(addr));
+        b->rmsg[i].msg_hdr.msg_namelen = sizeof(addr);
+        batch_rbuf(b, i)[0] = (uchar) i;
+        batch_reply(b, i, 1);
+    }
+    ///no IPv6 destination for an IPv4 socket
+    ((struct sockaddr *) &b->addr[1])->sa_family = AF_INET6;
+    b->wmsg[1].msg_hdr.msg_namelen = sizeof(struct sockaddr_in6);
+
+    socket_sendmmsg(wfd, b);
+    assert(b->pending == 0 && b->tx_pkts == 3 && b->tx_errors == 1);
+    for(unsigned int i = 0; i < 4; i++)
+        if(i != 1)
+            assert(recv(rfd, buf, sizeof(buf), 0) == 1 && buf[0] == i);
+    batch_stats_show(b);
+
+    ///one datagram at a time, as serve() sends them
+    for(unsigned int i = 0; i < 4; i++)
+        socket_sendto(wfd, batch_rbuf(b, i), 1, (struct sockaddr *) &b->addr[i],
+                      b->wmsg[i].msg_hdr.msg_namelen);
+    assert(socket_tx_errors == 1);
+    for(unsigned int i = 0; i < 4; i++)
+        if(i != 1)
+            assert(recv(rfd, buf, sizeof(buf), 0) == 1 && buf[0] == i);
+
+    close(rfd);
+    close(wfd);
+    batch_free(b, pool);
+    pktpool_free(pool);
+}
+
+int main(int argc, char *argv[])
+{
+    struct sockaddr_in addr = { .sin_family = AF_INET, .sin_addr.s_addr = htonl(INADDR_LOOPBACK) };
+    socklen_t len = sizeof(addr);
+    int lfd = socket(AF_INET, SOCK_STREAM, 0);
+
+    assert(lfd >= 0 && bind(lfd, (struct sockaddr *) &addr, sizeof(addr)) == 0);
+    assert(getsockname(lfd, (struct sockaddr *) &addr, &len) == 0);
+
+    handoff(lfd, &addr, true);
+    handoff(lfd, &addr, false);
+    send_errors();
+
+    close(lfd);
+    return 0;
+}
@@ -9,6 +9,9 @@
 #include "debug.h"
 #include "type.h"
 
+struct zone_db *dns_db;
+__thread struct dns_cache *dns_cache;
+
 char dns_server[10][100];
 int dns_server_count = 0;
 
@@ -55,43 +58,15 @@ void dns_get_host_ip(char *host, RR_QTYPE_t qtype)
     /**
      * Construct MESSAGE
      */
-    int qdcount = 1;
-
-    ///declare DNS MESSAGE
-    ///DNS_MESSAGE_ptr_t msg_p;
-    
-    ///DNS Header
-    //DNS_HEADER_t *hdr = (DNS_HEADER_t *) buf;
-    dns_header_declare(hdr);
-    locate += dns_header_locate_assign( hdr,
-                                        buf,
-                           (u16_t) getpid(),
-                                          0,
-                                          0,
-                                 _STD_QUERY,
-                                          0,
-                                          1,
-                                          0,
-                                          0,
-                                   _NOERROR,
-                                          1,
-                                          0,
-                                          0,
-                                          0);
-
-    ///DNS Question
-    DNS_QUESTION_ptr_t **q_list = (DNS_QUESTION_ptr_t **) malloc(qdcount * sizeof(DNS_QUESTION_ptr_t *));
-    
-    for(int i = 0; i < qdcount; i++)
-    {
-        q_list[i] = (DNS_QUESTION_ptr_t *) malloc(sizeof(DNS_QUESTION_ptr_t));
-    }
+    struct dns_reply query;
+    uchar qname[NAME_LIMIT];
 
-    ///DNS Question Assign
-    char *_tmp = (char *) malloc(30 *sizeof(char));
-    host_to_dns_name(_tmp, host);
+    host_to_dns_name((char *) qname, host);
+    dns_reply_new(&query, buf, UDP_LIMIT, (u16_t) getpid(), _STD_QUERY, true);
+    syserr(dns_reply_add_question(&query, qname, qtype, _IN) < 0, "dns_reply_add_question\n");
+    locate = query.len;
 
-    locate += dns_question_locate_assign(q_list[0], &buf[locate], _tmp, qtype, _IN);
+    DNS_HEADER_t *hdr = dns_reply_header(&query);
 
     //dns_question_member(q_list[0], qtype) = qtype;
     //dns_question_member(q_list[0], qname) = "name";
@@ -0,0 +1,59 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <fcntl.h>
+#include <errno.h>
+
+#include "core/restart.h"
+
+///descriptors open in the process
+static int open_fds(void)
+{
+    int n = 0;
+
+    for(int fd = 0; fd < 1024; fd++)
+        n += fcntl(fd, F_GETFD) >= 0;
+    return n;
+}
+
+int main(int argc, char *argv[])
+{
+    struct restart_hello hello = { .magic = RESTART_MAGIC, .mode = WORKER_BLOCK, .nworkers = 1 };
+    struct dns_worker *w;
+    unsigned int n;
+    int sv[2], fds[4], got[4], lfd, base;
+
+    assert(socketpair(AF_UNIX, SOCK_STREAM, 0, sv) == 0);
+    for(int i = 0; i < 4; i++)
+        assert((fds[i] = dup(0)) >= 0);
+    base = open_fds();
+
+    ///what does not fit the caller's array is closed, not written past it
+    assert(restart_send(sv[0], &hello, sizeof(hello), fds, 4) == 0);
+    assert(restart_recv(sv[1], &hello, sizeof(hello), got, 1) == 1);
+    assert(open_fds() == base + 1);
+    close(got[0]);
+    assert(restart_send(sv[0], &hello, sizeof(hello), fds, 4) == 0);
+    assert(restart_recv(sv[1], &hello, sizeof(hello), NULL, 0) == 0);
+    assert(open_fds() == base);
+
+    ///a short message: the descriptors which came along are closed
+    assert(restart_send(sv[0], &hello, sizeof(hello) - 1, fds, 2) == 0);
+    shutdown(sv[0], SHUT_WR);
+    assert(restart_recv(sv[1], &hello, sizeof(hello), got, 4) < 0);
+    assert(open_fds() == base);
+    close(sv[0]);
+    close(sv[1]);
+
+    ///no worker array sized by a count out of bounds
+    assert(socketpair(AF_UNIX, SOCK_STREAM, 0, sv) == 0);
+    hello.nworkers = WORKER_LIMIT + 1;
+    assert(restart_send(sv[0], &hello, sizeof(hello), NULL, 0) == 0);
+    assert(restart_takeover(sv[1], WORKER_BLOCK, &w, &n, &lfd) < 0);
+    close(sv[0]);
+    close(sv[1]);
+
+    for(int i = 0; i < 4; i++)
+        close(fds[i]);
+    return 0;
+}
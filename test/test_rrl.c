@@ -0,0 +1,95 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <arpa/inet.h>
+
+#include "core/rrl.h"
+
+static struct sockaddr_in client(const char *ip)
+{
+    struct sockaddr_in sin = { .sin_family = AF_INET };
+
+    inet_pton(AF_INET, ip, &sin.sin_addr);
+    return sin;
+}
+
+int main(int argc, char *argv[])
+{
+    struct rrl *rl = rrl_new(10, 2);
+    struct sockaddr_in a = client("192.0.2.1"), b = client("192.0.2.77"), c = client("198.51.100.1");
+    u64_t ha = rrl_hash(rl, (struct sockaddr *) &a, RRL_ANSWER);
+    u64_t now = 1000000;
+    int drop = 0, slip = 0;
+
+    ///one /24, one bucket per kind of reply
+    assert(ha == rrl_hash(rl, (struct sockaddr *) &b, RRL_ANSWER));
+    assert(ha != rrl_hash(rl, (struct sockaddr *) &c, RRL_ANSWER));
+    assert(ha != rrl_hash(rl, (struct sockaddr *) &a, RRL_NXDOMAIN));
+
+    for(int i = 0; i < 10; i++)
+        assert(rrl_admit(rl, ha, now) == RRL_PASS);
+    for(int i = 0; i < 10; i++)
+    {
+        int v = rrl_admit(rl, ha, now);
+
+        assert(v != RRL_PASS);
+        drop += v == RRL_DROP;
+        slip += v == RRL_SLIP;
+    }
+    assert(drop == 5 && slip == 5);
+
+    ///a token every 100 ms, the fraction is kept
+    assert(rrl_admit(rl, ha, now + 99) != RRL_PASS);
+    assert(rrl_admit(rl, ha, now + 100) == RRL_PASS);
+    assert(rrl_admit(rl, ha, now + 150) != RRL_PASS);
+    assert(rrl_admit(rl, ha, now + 200) == RRL_PASS);
+
+    ///never more than a second worth of tokens
+    now += 60 * 1000;
+    for(int i = 0; i < 10; i++)
+        assert(rrl_admit(rl, ha, now) == RRL_PASS);
+    assert(rrl_admit(rl, ha, now) != RRL_PASS);
+
+    ///keys of the same set take ways of their own while one is free
+    u64_t key[5];
+
+    for(int i = 0; i < 5; i++)
+        key[i] = (ha & (RRL_SLOTS - RRL_WAYS)) | (u64_t) (i & (RRL_WAYS - 1)) << 16
+                 | (RRL_TAG(ha) ^ (u64_t) (i + 1)) << 40;
+    for(int k = 0; k < 3; k++)
+    {
+        for(int i = 0; i < 10; i++)
+            assert(rrl_admit(rl, key[k], now) == RRL_PASS);
+        assert(rrl_admit(rl, key[k], now) != RRL_PASS);
+    }
+    assert(rrl_admit(rl, ha, now) != RRL_PASS);
+
+    ///every way busy: a key is charged to the bucket of its way, the way of ha
+    assert(rrl_admit(rl, key[4], now) != RRL_PASS);
+    assert(rrl_admit(rl, ha, now + 100) == RRL_PASS && rrl_admit(rl, key[4], now + 100) != RRL_PASS);
+
+    ///and takes an idle one over
+    now += 2000;
+    for(int i = 0; i < 10; i++)
+        assert(rrl_admit(rl, key[4], now) == RRL_PASS);
+    assert(rrl_admit(rl, key[4], now) != RRL_PASS && rrl_admit(rl, ha, now) == RRL_PASS);
+
+    ///cost of the admission of a flood spread over many prefixes
+    struct timespec t0, t1;
+    int n = 10 * 1000 * 1000;
+    unsigned int pass = 0;
+
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    for(int i = 0; i < n; i++)
+    {
+        a.sin_addr.s_addr = htonl(0x0a000000 | ((i & 0xfff) << 8));
+        pass += rrl_admit(rl, rrl_hash(rl, (struct sockaddr *) &a, RRL_ANSWER), rrl_now()) == RRL_PASS;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+
+    printf("rrl: %.1f ns per admission, %u of %d passed\n",
+            ((t1.tv_sec - t0.tv_sec) * 1e9 + (t1.tv_nsec - t0.tv_nsec)) / n, pass, n);
+
+    rrl_free(rl);
+    return 0;
+}
@@ -0,0 +1,167 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <time.h>
+
+#include "core/zone.h"
+#include "fixture.h"
+
+static void add(struct zone_db *db, const char *owner, u16_t type, const uchar *rdata, u16_t rdlen)
+{
+    uchar name[NAME_LIMIT];
+
+    wire(name, owner);
+    assert(zone_add(db, name, type, _IN, 3600, rdata, rdlen) == 0);
+}
+
+static void add_name(struct zone_db *db, const char *owner, u16_t type, u16_t pref, const char *target)
+{
+    uchar rdata[NAME_LIMIT + 2] = { pref >> 8, pref };
+    size_t off = type == _MX ? 2 : 0;
+
+    add(db, owner, type, rdata, off + wire(rdata + off, target));
+}
+
+static void add_a(struct zone_db *db, const char *owner, uchar a, uchar b, uchar c, uchar d)
+{
+    uchar rdata[4] = { a, b, c, d };
+
+    add(db, owner, _A, rdata, sizeof(rdata));
+}
+
+static void add_soa(struct zone_db *db, const char *apex)
+{
+    uchar rdata[2 * NAME_LIMIT + 20];
+    size_t n = wire(rdata, "KL.SRI.COM");
+
+    n += wire(rdata + n, "DLE.STRIPE.SRI.COM");
+    memset(rdata + n, 0, 20);
+    add(db, apex, _SOA, rdata, n + 20);
+}
+
+static uchar buf[UDP_LIMIT];
+static struct dns_view reply;
+
+///ask @db for @host @qtype; the reply is parsed into `reply`
+static size_t ask(struct zone_db *db, const char *host, u16_t qtype, size_t cap)
+{
+    struct dns_view v;
+    struct dns_reply r;
+    size_t len = make_query(buf, 0xbeef, host, qtype, 0);
+
+    assert(dns_view_parse(&v, buf, len) == 0);
+    dns_reply_start(&r, buf, len, cap);
+    zone_answer(db, &r, &v);
+    assert(dns_view_parse(&reply, buf, r.len) == 0);
+
+    return r.len;
+}
+
+#define rcode()     (dns_flag(dns_view_header(&reply), DNS_RCODE))
+#define aa()        (dns_flag(dns_view_header(&reply), DNS_AA))
+#define count(s)    dns_view_count(&reply, s)
+
+static const char *text(int section, unsigned int i)
+{
+    static uchar host[NAME_TEXT_LIMIT];
+
+    assert(dns_name_decode(buf, reply.len, dns_view_rr(&reply, section, i)->name,
+                           host, sizeof(host), NAME_TEXT, NULL) > 0);
+    return (char *) host;
+}
+
+int main(int argc, char *argv[])
+{
+    struct zone_db *db = zone_db_new();
+
+    add_soa(db, "SRI.COM");
+    add_name(db, "SRI.COM", _NS, 0, "KL.SRI.COM");
+    add_name(db, "SRI.COM", _NS, 0, "STRIPE.SRI.COM");
+    add_name(db, "SRI.COM", _MX, 10, "KL.SRI.COM");
+    add_a(db, "KL.SRI.COM", 10, 1, 0, 2);
+    add_a(db, "KL.SRI.COM", 128, 18, 10, 6);
+    add_a(db, "STRIPE.SRI.COM", 10, 4, 0, 2);
+    add_name(db, "NIC.SRI.COM", _CNAME, 0, "SRI-NIC.ARPA");
+    add_name(db, "WWW.SRI.COM", _CNAME, 0, "KL.SRI.COM");
+    add_name(db, "OLD.SRI.COM", _CNAME, 0, "GONE.SRI.COM");
+    add_name(db, "GW.SRI.COM", _CNAME, 0, "1.1.18.128.IN-ADDR.ARPA");
+    add_name(db, "PTR.SRI.COM", _CNAME, 0, "9.9.18.128.IN-ADDR.ARPA");
+    ///a delegation, glue included
+    add_name(db, "ISTC.SRI.COM", _NS, 0, "NS.ISTC.SRI.COM");
+    add_a(db, "NS.ISTC.SRI.COM", 128, 18, 4, 2);
+    ///1.18.128.in-addr.arpa is an empty non-terminal
+    add_soa(db, "18.128.IN-ADDR.ARPA");
+    add_name(db, "1.1.18.128.IN-ADDR.ARPA", _PTR, 0, "GW.CSL.SRI.COM");
+    zone_stats_show(db);
+
+    ask(db, "Kl.Sri.Com", _A, UDP_LIMIT);
+    assert(rcode() == _NOERROR && aa() && count(DNS_ANSWER) == 2);
+    assert(!strcmp(text(DNS_ANSWER, 0), "Kl.Sri.Com"));
+    assert(dns_view_rdata(&reply, DNS_ANSWER, 1)[0] == 128);
+
+    ///glue for the exchange, names compressed against each other
+    ask(db, "sri.com", _MX, UDP_LIMIT);
+    assert(count(DNS_ANSWER) == 1 && count(DNS_ADDITIONAL) == 2);
+    assert(dns_view_rdlength(&reply, DNS_ANSWER, 0) == 2 + 3 + 2);
+    assert(!strcmp(text(DNS_ADDITIONAL, 0), "kl.sri.com"));
+
+    ask(db, "sri.com", _wildcard, UDP_LIMIT);
+    assert(count(DNS_ANSWER) == 4);
+
+    ask(db, "www.sri.com", _A, UDP_LIMIT);
+    assert(count(DNS_ANSWER) == 3 && dns_view_type(&reply, DNS_ANSWER, 0) == _CNAME);
+    assert(!strcmp(text(DNS_ANSWER, 2), "kl.sri.com"));
+
+    ask(db, "nic.sri.com", _A, UDP_LIMIT);
+    assert(rcode() == _NOERROR && count(DNS_ANSWER) == 1 && count(DNS_AUTHORITY) == 0);
+
+    ///the last name of a chain gives the rcode and the SOA, of its own zone
+    ask(db, "www.sri.com", _MX, UDP_LIMIT);
+    assert(rcode() == _NOERROR && count(DNS_ANSWER) == 1 && count(DNS_AUTHORITY) == 1);
+    assert(!strcmp(text(DNS_AUTHORITY, 0), "sri.com"));
+    ask(db, "old.sri.com", _A, UDP_LIMIT);
+    assert(rcode() == _NXDOMAIN && aa() && count(DNS_ANSWER) == 1 && count(DNS_AUTHORITY) == 1);
+    assert(dns_view_type(&reply, DNS_AUTHORITY, 0) == _SOA);
+    ask(db, "gw.sri.com", _A, UDP_LIMIT);
+    assert(rcode() == _NOERROR && count(DNS_ANSWER) == 1 && count(DNS_AUTHORITY) == 1);
+    assert(!strcmp(text(DNS_AUTHORITY, 0), "18.128.in-addr.arpa"));
+    ask(db, "ptr.sri.com", _PTR, UDP_LIMIT);
+    assert(rcode() == _NXDOMAIN && count(DNS_ANSWER) == 1 && count(DNS_AUTHORITY) == 1);
+    assert(!strcmp(text(DNS_AUTHORITY, 0), "18.128.in-addr.arpa"));
+
+    ///no data, no name, no zone
+    ask(db, "kl.sri.com", _MX, UDP_LIMIT);
+    assert(rcode() == _NOERROR && count(DNS_ANSWER) == 0 && count(DNS_AUTHORITY) == 1);
+    assert(dns_view_type(&reply, DNS_AUTHORITY, 0) == _SOA);
+    ask(db, "1.18.128.in-addr.arpa", _PTR, UDP_LIMIT);
+    assert(rcode() == _NOERROR && count(DNS_AUTHORITY) == 1);
+    ask(db, "gw.csl.sri.com", _A, UDP_LIMIT);
+    assert(rcode() == _NXDOMAIN && aa() && count(DNS_AUTHORITY) == 1);
+    assert(!strcmp(text(DNS_AUTHORITY, 0), "sri.com"));
+    ask(db, "example.org", _A, UDP_LIMIT);
+    assert(rcode() == _REFUSED && !aa());
+
+    ///a referral is not authoritative
+    ask(db, "host.istc.sri.com", _A, UDP_LIMIT);
+    assert(rcode() == _NOERROR && !aa() && count(DNS_ANSWER) == 0);
+    assert(count(DNS_AUTHORITY) == 1 && count(DNS_ADDITIONAL) == 1);
+
+    ///what does not fit is cut and marked
+    ask(db, "kl.sri.com", _A, 50);
+    assert(count(DNS_ANSWER) == 1 && dns_flag(dns_view_header(&reply), DNS_TC));
+
+    ///cost of a whole answer with glue
+    struct timespec t0, t1;
+    int n = 1000 * 1000;
+    size_t len = ask(db, "sri.com", _MX, UDP_LIMIT);
+
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    for(int i = 0; i < n; i++)
+        assert(ask(db, "sri.com", _MX, UDP_LIMIT) == len);
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    printf("zone: %.1f ns per query and answer of %zu bytes\n",
+            ((t1.tv_sec - t0.tv_sec) * 1e9 + (t1.tv_nsec - t0.tv_nsec)) / n, len);
+
+    zone_db_free(db);
+    return 0;
+}
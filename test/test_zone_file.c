@@ -0,0 +1,211 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <time.h>
+
+#include "core/dns.h"
+#include "core/zone_file.h"
+#include "fixture.h"
+
+struct zone_db *dns_db;
+__thread struct dns_cache *dns_cache;
+
+///the records of the last file read, their RDATA printed
+#define SEEN_LIMIT 64
+
+static struct seen {
+    uchar      owner[NAME_LIMIT];
+    u16_t                    type;
+    u16_t                   class;
+    u32_t                     ttl;
+    uchar    rdata[UDP_LIMIT];
+    u16_t                   rdlen;
+    char       text[4 * UDP_LIMIT];
+} seen[SEEN_LIMIT];
+static int nseen;
+
+static int keep(void *arg, const uchar *owner, u16_t type, u16_t class, u32_t ttl,
+                const uchar *rdata, u16_t rdlen)
+{
+    struct seen *s = &seen[nseen++];
+
+    assert(nseen <= SEEN_LIMIT && rdlen <= sizeof(s->rdata));
+    memcpy(s->owner, owner, rdata_name_len(owner, NAME_LIMIT));
+    s->type = type, s->class = class, s->ttl = ttl;
+    memcpy(s->rdata, rdata, rdlen);
+    s->rdlen = rdlen;
+    assert(dns_rdata(type)->print(s->text, sizeof(s->text), rdata, rdlen) >= 0);
+
+    return 0;
+}
+
+static int count(void *arg, const uchar *owner, u16_t type, u16_t class, u32_t ttl,
+                 const uchar *rdata, u16_t rdlen)
+{
+    *(size_t *) arg += rdlen;
+    return 0;
+}
+
+///@text as the file @path
+static void put(const char *path, const char *text)
+{
+    FILE *f = fopen(path, "w");
+
+    assert(f);
+    fputs(text, f);
+    fclose(f);
+}
+
+static ssize_t scan(const char *path, const char *origin)
+{
+    nseen = 0;
+    return zone_file_scan(path, origin, keep, NULL);
+}
+
+static bool owner_is(const struct seen *s, const char *host)
+{
+    uchar name[NAME_LIMIT];
+
+    return !memcmp(s->owner, name, wire(name, host));
+}
+
+int main(int argc, char *argv[])
+{
+    uchar name[NAME_LIMIT];
+
+    ///the sample zone: an SOA over lines, blank owners, relative names, a WKS by mnemonics
+    assert(scan("config.sample/SRI.ZONE", "SRI.COM.") == 18);
+    assert(seen[0].type == _SOA && seen[0].class == _IN && owner_is(&seen[0], "SRI.COM"));
+    assert(!strcmp(seen[0].text, "KL.SRI.COM. DLE.STRIPE.SRI.COM. 870407 1800 600 604800 86400"));
+    assert(seen[0].ttl == 86400 && seen[17].ttl == 86400);
+    assert(seen[3].type == _MX && owner_is(&seen[3], "SRI.COM") && !strcmp(seen[3].text, "10 KL.SRI.COM."));
+    assert(seen[4].type == _A && owner_is(&seen[4], "KL.SRI.COM") && !strcmp(seen[4].text, "10.1.0.2"));
+    assert(owner_is(&seen[5], "KL.SRI.COM") && !strcmp(seen[5].text, "128.18.10.6"));
+    assert(seen[12].type == _HINFO && !strcmp(seen[12].text, "\"VAX-11/780\" \"UNIX\""));
+    assert(seen[13].type == _WKS && !strcmp(seen[13].text, "128.18.2.1 6 21 23"));
+    assert(seen[17].type == _MX && !strcmp(seen[17].text, "10 CSL.SRI.COM.SRI.COM."));
+
+    ///directives, either order of TTL and class, quoting, the generic form
+    put("/tmp/test_zone_file.inc",
+        "$ORIGIN sub\n"
+        "www 60 A 10.0.0.9\n");
+    put("/tmp/test_zone_file.zone",
+        "$TTL 1h\n"
+        "@ IN SOA ns root ( 1 2 3 4 5 ) ; comment\n"
+        "  NS ns.example.com.\n"
+        "ns 300 IN A 10.0.0.1\n"
+        "mail IN 1d30m MX 5 @\n"
+        "txt TXT \"a \\\"b\\\"; c\" d\\032e\n"
+        "box MINFO admin errors\n"
+        "any TYPE99 \\# 3 0a0B 0c\n"
+        "$INCLUDE test_zone_file.inc in.example.com.\n"
+        "  A 10.0.0.2\n"
+        "$ORIGIN other.\n"
+        "x CH PTR y\n");
+    assert(scan("/tmp/test_zone_file.zone", "example.com") == 10);
+    assert(owner_is(&seen[0], "example.com") && seen[0].ttl == 3600);
+    assert(!strcmp(seen[0].text, "ns.example.com. root.example.com. 1 2 3 4 5"));
+    assert(owner_is(&seen[1], "example.com") && seen[1].type == _NS);
+    assert(owner_is(&seen[2], "ns.example.com") && seen[2].ttl == 300);
+    assert(seen[3].ttl == 88200 && !strcmp(seen[3].text, "5 example.com."));
+    assert(seen[4].type == _TXT && !strcmp(seen[4].text, "\"a \\\"b\\\"; c\" \"d e\""));
+    assert(seen[5].type == _MINFO && !strcmp(seen[5].text, "admin.example.com. errors.example.com."));
+    assert(seen[6].type == 99 && seen[6].rdlen == 3 && !memcmp(seen[6].rdata, "\x0a\x0b\x0c", 3));
+    assert(owner_is(&seen[7], "www.sub.in.example.com") && seen[7].ttl == 60);
+    ///after the include: the owner and origin of this file again
+    assert(owner_is(&seen[8], "any.example.com") && seen[8].type == _A && seen[8].ttl == 3600);
+    assert(owner_is(&seen[9], "x.other") && seen[9].class == _CH && !strcmp(seen[9].text, "y.other."));
+
+    ///what is printed is read back the same, for every type
+    for(int i = 0; i < nseen; i++)
+    {
+        char file[4 * UDP_LIMIT + 64];
+        struct seen s = seen[i];
+
+        if(!dns_rdata(s.type)->name)
+            continue;
+        snprintf(file, sizeof(file), "@ %u TYPE%u %s\n", s.ttl, s.type, s.text);
+        put("/tmp/test_zone_file.zone", file);
+        assert(scan("/tmp/test_zone_file.zone", ".") == 1);
+        assert(seen[0].rdlen == s.rdlen && !memcmp(seen[0].rdata, s.rdata, s.rdlen));
+    }
+
+    ///errors are reported with their line, nothing is read past them
+    const char *bad[] = {
+        "a A 10.0.0.1\n",                           ///no TTL
+        "$TTL 60\n  A 10.0.0.1\n",                  ///no owner
+        "$TTL 60\na A 10.0.0\n",
+        "$TTL 60\na MX 10\n",
+        "$TTL 60\na SOA ( ns root 1 2 3 4 5\n",
+        "$TTL 60\na TXT \"open\n",
+        "$TTL 60\na XYZ 1\n",
+        "$TTL 60\na..b A 10.0.0.1\n",
+        "$TTL 60\n$INCLUDE /nonexistent\n",
+        "$TTL 60\na NULL 1\n",
+        "$TTL 60\na WKS 10.0.0.1 TCP NOSUCH\n",
+        "a SOA \\# 2 0000\n",                      ///no MINIMUM to take the TTL from
+    };
+
+    for(size_t i = 0; i < ARRAY_SIZE(bad); i++)
+    {
+        put("/tmp/test_zone_file.zone", bad[i]);
+        assert(scan("/tmp/test_zone_file.zone", "example.com.") < 0 && nseen == 0);
+    }
+
+    ///every sample zone loads and answers
+    const char *zones[][2] = {
+        { "SRI.COM.", "config.sample/SRI.ZONE" },
+        { "CSL.SRI.COM.", "config.sample/CSL.ZONE" },
+        { "ISTC.SRI.COM.", "config.sample/ISTC.ZONE" },
+        { "18.128.IN-ADDR.ARPA.", "config.sample/SRINET.ZONE" },
+        { "33.12.192.IN-ADDR.ARPA.", "config.sample/SRI-CSL-NET.ZONE" },
+    };
+    uchar buf[UDP_LIMIT];
+    size_t len;
+
+    dns_db = zone_db_new();
+    for(size_t i = 0; i < ARRAY_SIZE(zones); i++)
+        assert(zone_file_load(dns_db, zones[i][1], zones[i][0]) > 0);
+    len = make_query(buf, 0, "tsc.istc.sri.com", _A, 0);
+    assert(dns_process(buf, len, UDP_LIMIT) > 0);
+    assert(dns_flag((DNS_HEADER_t *) buf, DNS_AA) && ntohs(((DNS_HEADER_t *) buf)->ancount) == 3);
+    zone_stats_show(dns_db);
+    zone_db_free(dns_db);
+
+    ///speed on a large zone
+    const char *big = "/tmp/test_zone_file.big";
+    FILE *f = fopen(big, "w");
+    struct timespec t0, t1, t2;
+    size_t bytes = 0, records = 200 * 1000;
+    struct stat st;
+
+    assert(f);
+    fprintf(f, "$TTL 3600\n@ SOA ns root ( 2024010101 1h 15m 1w 1d )\n  NS ns\n");
+    for(size_t i = 0; i < records; i++)
+    {
+        fprintf(f, "host%zu A 10.%zu.%zu.%zu ; host %zu\n", i, i >> 16 & 0xff, i >> 8 & 0xff, i & 0xff, i);
+        fprintf(f, "  MX 10 mail%zu.example.com.\n", i % 100);
+        fprintf(f, "  TXT \"v=spf1 -all\" \"id %zu\"\n", i);
+    }
+    fclose(f);
+    stat(big, &st);
+
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    assert(zone_file_scan(big, "example.com.", count, &bytes) == (ssize_t) (3 * records + 2));
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    dns_db = zone_db_new();
+    assert(zone_file_load(dns_db, big, "example.com.") == (ssize_t) (3 * records + 2));
+    clock_gettime(CLOCK_MONOTONIC, &t2);
+    wire(name, "host4242.example.com");
+    assert(zone_node_find(dns_db, dns_intern_find(dns_db->names, name)));
+    printf("zone file: %.0f MB/s parsed, %.0f MB/s into the database, %zu MB\n",
+            st.st_size / 1e6 / ((t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) / 1e9),
+            st.st_size / 1e6 / ((t2.tv_sec - t1.tv_sec) + (t2.tv_nsec - t1.tv_nsec) / 1e9),
+            (size_t) st.st_size >> 20);
+
+    zone_db_free(dns_db);
+    unlink(big);
+    unlink("/tmp/test_zone_file.zone");
+    unlink("/tmp/test_zone_file.inc");
+    return 0;
+}